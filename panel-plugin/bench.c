@@ -0,0 +1,856 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bench.h"
+#include "counters.h"
+#include "disk.h"
+#include "diskstats.h"
+#include "history.h"
+#include "output.h"
+#include "utils.h"
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The windows of the history, as the defaults of the plugin */
+#define BENCH_SMOOTH 4
+#define BENCH_SCALE 20
+
+/* With an automatic number of ticks, each stage handles about this many
+   devices in total, within these bounds */
+#define BENCH_WORK 1000000
+#define BENCH_MIN_TICKS 20
+#define BENCH_MAX_TICKS 10000
+
+/* A large /proc/diskstats of which only a few devices are monitored */
+#define BENCH_SELECT_LINES 10000
+#define BENCH_SELECT_SPEC "bench17 bench9000"
+#define BENCH_SELECT_DEVICES 2
+
+/* The stages, which can be combined */
+enum {
+  STAGE_SAMPLE = 1 << 0,
+  STAGE_SMOOTH = 1 << 1,
+  STAGE_FORMAT = 1 << 2,
+  STAGE_TICK = STAGE_SAMPLE | STAGE_SMOOTH | STAGE_FORMAT
+};
+
+static const struct {
+  const char *name;
+  int stages;
+} STAGES[] = {{"sample", STAGE_SAMPLE},
+              {"smooth", STAGE_SMOOTH},
+              {"format", STAGE_FORMAT},
+              {"tick", STAGE_TICK}};
+
+/* The cost of a run */
+typedef struct {
+  uint64_t ns;
+  unsigned long allocations;
+  /* -1 if unknown */
+  long long syscalls;
+  /* The lines of /proc/diskstats that were parsed, 0 if it does not apply */
+  unsigned long long lines;
+} bench_cost;
+
+/* Where the parsed counters go, so that the parsing is not optimized away */
+static volatile uint64_t sink;
+
+/* The counters of a device as they were kept before the counter store, with
+   the two samples in the struct of the device */
+typedef struct {
+  diskstat cur, prev;
+  uint64_t delta[STAT_NFIELDS];
+  double rate[STAT_NFIELDS];
+} bench_row;
+
+static const char *const COUNTERS_STAGES[COUNTERS_NIMPLS] = {
+    "counters-scalar", "counters-sse2", "counters-avx2"};
+
+#ifdef HAVE_MALLOC_WRAP
+/* Every allocation of the tool and of the core goes through these, when it
+   is linked with --wrap, and so does every open and close of a file. The
+   opens and closes are not in /proc/self/io, which only counts the reads
+   and writes */
+static unsigned long allocations;
+static unsigned long opens;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+int __real_open(const char *path, int flags, ...);
+int __real_openat(int dirfd, const char *path, int flags, ...);
+int __real_close(int fd);
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_fclose(FILE *fp);
+
+/* -------------------------------------------------------------------------- */
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+/* -------------------------------------------------------------------------- */
+void *__wrap_calloc(size_t n, size_t size) {
+  allocations++;
+  return __real_calloc(n, size);
+}
+
+/* -------------------------------------------------------------------------- */
+void *__wrap_realloc(void *p, size_t size) {
+  allocations++;
+  return __real_realloc(p, size);
+}
+
+/* -------------------------------------------------------------------------- */
+int __wrap_open(const char *path, int flags, ...) {
+  mode_t mode = 0;
+  va_list args;
+
+  if (flags & O_CREAT) {
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  opens++;
+  return __real_open(path, flags, mode);
+}
+
+/* -------------------------------------------------------------------------- */
+int __wrap_openat(int dirfd, const char *path, int flags, ...) {
+  mode_t mode = 0;
+  va_list args;
+
+  if (flags & O_CREAT) {
+    va_start(args, flags);
+    mode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  opens++;
+  return __real_openat(dirfd, path, flags, mode);
+}
+
+/* -------------------------------------------------------------------------- */
+int __wrap_close(int fd) {
+  opens++;
+  return __real_close(fd);
+}
+
+/* -------------------------------------------------------------------------- */
+FILE *__wrap_fopen(const char *path, const char *mode) {
+  opens++;
+  return __real_fopen(path, mode);
+}
+
+/* -------------------------------------------------------------------------- */
+int __wrap_fclose(FILE *fp) {
+  opens++;
+  return __real_fclose(fp);
+}
+#endif /* HAVE_MALLOC_WRAP */
+
+/******************************************************************************
+ *
+ * count_syscalls()
+ *
+ * read the number of read and write system calls of the process from
+ * /proc/self/io, and add the opens and closes of files that the wrappers
+ * counted. Reading it costs system calls too, which the caller subtracts
+ *
+ * returns the number of calls, or -1 if it is unknown
+ *
+ *****************************************************************************/
+
+static long long count_syscalls(void) {
+  char buf[512];
+  const char *p;
+  long long syscr = -1, syscw = -1;
+  ssize_t len;
+  int fd;
+
+  if ((fd = open("/proc/self/io", O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+  len = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (len <= 0)
+    return -1;
+  buf[len] = '\0';
+
+  if ((p = strstr(buf, "syscr: ")) != NULL)
+    syscr = strtoll(p + 7, NULL, 10);
+  if ((p = strstr(buf, "syscw: ")) != NULL)
+    syscw = strtoll(p + 7, NULL, 10);
+  if (syscr < 0 || syscw < 0)
+    return -1;
+#ifdef HAVE_MALLOC_WRAP
+  return syscr + syscw + opens;
+#else
+  return syscr + syscw;
+#endif
+}
+
+/******************************************************************************
+ *
+ * make_tree()
+ *
+ * create a fake /proc/diskstats with a number of devices named bench<i>
+ * under root, and an empty /sys/block
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int make_tree(const char *root, int ndevices) {
+  char path[PATH_MAX];
+  FILE *fp;
+  int i;
+
+  snprintf(path, PATH_MAX, "%s/proc", root);
+  if (mkdir(path, 0700) != 0)
+    return 1;
+  snprintf(path, PATH_MAX, "%s/sys", root);
+  if (mkdir(path, 0700) != 0)
+    return 1;
+  snprintf(path, PATH_MAX, "%s/sys/block", root);
+  if (mkdir(path, 0700) != 0)
+    return 1;
+
+  snprintf(path, PATH_MAX, "%s/proc/diskstats", root);
+  if ((fp = fopen(path, "w")) == NULL)
+    return 1;
+  /* Counters of the size of a disk that has been up for a while */
+  for (i = 0; i < ndevices; i++)
+    fprintf(fp,
+            "%4d %7d bench%d %d 1234 %d 987654 %d 4321 %d 1234567 0 %d %d "
+            "0 0 0 0 0 0\n",
+            8 + i / 256, i % 256, i, 1000000 + i, 200000000 + i, 300000 + i,
+            400000000 + i, 2000000 + i, 3000000 + i);
+  return fclose(fp) != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void remove_tree(const char *root) {
+  char path[PATH_MAX];
+
+  snprintf(path, PATH_MAX, "%s/proc/diskstats", root);
+  unlink(path);
+  snprintf(path, PATH_MAX, "%s/proc", root);
+  rmdir(path);
+  snprintf(path, PATH_MAX, "%s/sys/block", root);
+  rmdir(path);
+  snprintf(path, PATH_MAX, "%s/sys", root);
+  rmdir(path);
+  rmdir(root);
+}
+
+/******************************************************************************
+ *
+ * run_stages()
+ *
+ * run some stages for a number of ticks, as the plugin would on every
+ * update, and measure what it costs
+ *
+ *****************************************************************************/
+
+static void run_stages(int stages, long ticks, diskset *set, history *hist,
+                       bench_cost *cost) {
+  char buffer[64];
+  long long syscalls, overhead;
+  uint64_t start;
+  unsigned long start_allocations = 0;
+  long tick;
+  int i;
+
+  /* The cost of reading /proc/self/io itself */
+  syscalls = count_syscalls();
+  overhead = count_syscalls() - syscalls;
+
+#ifdef HAVE_MALLOC_WRAP
+  start_allocations = allocations;
+#endif
+  syscalls = count_syscalls();
+  start = now_ns();
+
+  for (tick = 0; tick < ticks; tick++) {
+    if (stages & STAGE_SAMPLE)
+      update_diskset(set);
+
+    for (i = 0; i < set->ndisks; i++) {
+      if (stages & STAGE_SMOOTH) {
+        history_push(&hist[2 * i], set->disks[i].cur_in);
+        history_push(&hist[2 * i + 1], set->disks[i].cur_out);
+        if (history_average(&hist[2 * i]) > history_max(&hist[2 * i]) ||
+            history_average(&hist[2 * i + 1]) > history_max(&hist[2 * i + 1]))
+          break;
+      }
+      if (stages & STAGE_FORMAT) {
+        format_byte_humanreadable(buffer, sizeof(buffer) - 1,
+                                  set->disks[i].cur_in, 2, FALSE);
+        format_byte_humanreadable(buffer, sizeof(buffer) - 1,
+                                  set->disks[i].cur_out, 2, FALSE);
+      }
+    }
+  }
+
+  cost->ns = now_ns() - start;
+  cost->syscalls = syscalls < 0 ? -1 : count_syscalls() - syscalls - overhead;
+#ifdef HAVE_MALLOC_WRAP
+  cost->allocations = allocations - start_allocations;
+#else
+  (void)start_allocations;
+  cost->allocations = 0;
+#endif
+  cost->lines = 0;
+}
+
+/******************************************************************************
+ *
+ * run_parse()
+ *
+ * parse a copy of /proc/diskstats in memory for a number of ticks, which
+ * measures the parser alone, without the system calls that read the file
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int run_parse(const char *root, long ticks, bench_cost *cost) {
+  char path[PATH_MAX];
+  struct stat sb;
+  const char *p, *end, *name;
+  char *buf;
+  unsigned int major, minor;
+  size_t namelen;
+  diskstat st;
+  uint64_t start, sum = 0;
+  long tick;
+  ssize_t len;
+  int fd;
+
+  snprintf(path, PATH_MAX, "%s/proc/diskstats", root);
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return 1;
+  if (fstat(fd, &sb) != 0 || (buf = malloc(sb.st_size + 1)) == NULL) {
+    close(fd);
+    return 1;
+  }
+  len = read(fd, buf, sb.st_size);
+  close(fd);
+  if (len != sb.st_size) {
+    free(buf);
+    return 1;
+  }
+  end = buf + len;
+
+  memset(cost, 0, sizeof(bench_cost));
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++) {
+    for (p = buf; p < end; cost->lines++)
+      if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen,
+                               &st) == 0)
+        sum += st.field[STAT_RD_SECTORS];
+  }
+  cost->ns = now_ns() - start;
+  /* Nothing is allocated and the file is only read once */
+  cost->syscalls = 0;
+  sink = sum;
+
+  free(buf);
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void print_cost(const char *stage, int ndevices, long ticks,
+                       const bench_cost *cost) {
+  put_string("{\"stage\":");
+  put_json_string(stage);
+  put_string(",\"devices\":");
+  put_uint(ndevices);
+  put_string(",\"ticks\":");
+  put_uint(ticks);
+  put_string(",\"ns_per_tick\":");
+  put_fixed((double)cost->ns / ticks);
+  put_string(",\"allocs_per_tick\":");
+#ifdef HAVE_MALLOC_WRAP
+  put_fixed((double)cost->allocations / ticks);
+#else
+  put_string("null");
+#endif
+  put_string(",\"syscalls_per_tick\":");
+  if (cost->syscalls < 0)
+    put_string("null");
+  else
+    put_fixed((double)cost->syscalls / ticks);
+  if (cost->lines) {
+    put_string(",\"lines_per_second\":");
+    put_fixed(cost->ns ? cost->lines * 1e9 / cost->ns : 0);
+  }
+  put_string("}\n");
+}
+
+/******************************************************************************
+ *
+ * make_samples()
+ *
+ * make two samples of the counters of a number of devices. Between the first
+ * and the second, every seventh counter is reset, as when a device goes away
+ * and comes back, so that the branch of the per-struct code is not always
+ * taken
+ *
+ *****************************************************************************/
+
+static void make_samples(diskstat *samples, int ndevices) {
+  int i, f;
+
+  for (i = 0; i < ndevices; i++) {
+    samples[i].nfields = STAT_NFIELDS;
+    samples[ndevices + i].nfields = STAT_NFIELDS;
+    for (f = 0; f < STAT_NFIELDS; f++) {
+      samples[i].field[f] = 1000000ull * (i + 1) + 1000 * f;
+      samples[ndevices + i].field[f] =
+          (i * STAT_NFIELDS + f) % 7 ? samples[i].field[f] + 100 * (f + 1)
+                                     : (uint64_t)f;
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void update_rows(bench_row *rows, const diskstat *sample, int ndevices,
+                        double inv_dt) {
+  uint64_t prev, cur;
+  int i, f;
+
+  for (i = 0; i < ndevices; i++) {
+    rows[i].cur = sample[i];
+    for (f = 0; f < STAT_NFIELDS; f++) {
+      prev = rows[i].prev.field[f];
+      cur = rows[i].cur.field[f];
+      rows[i].delta[f] = cur >= prev ? cur - prev : 0;
+      rows[i].rate[f] = (double)rows[i].delta[f] * inv_dt;
+    }
+    rows[i].prev = rows[i].cur;
+  }
+}
+
+/******************************************************************************
+ *
+ * run_counters()
+ *
+ * measure the differences and rates of the counters of a number of devices,
+ * computed per struct as they were before the counter store, then with the
+ * store and each implementation of its update that the CPU supports. The
+ * samples alternate, so that every tick has differences and resets. The
+ * costs are printed as stages of their own
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int run_counters(int ndevices, long ticks) {
+  counter_store store;
+  bench_cost cost;
+  diskstat *samples, *sample;
+  bench_row *rows;
+  uint64_t start;
+  long tick;
+  int impl, i;
+
+  samples = malloc(2 * ndevices * sizeof(diskstat));
+  rows = calloc(ndevices, sizeof(bench_row));
+  counter_store_init(&store);
+  if (samples == NULL || rows == NULL ||
+      counter_store_resize(&store, ndevices) != 0) {
+    free(samples);
+    free(rows);
+    return 1;
+  }
+  make_samples(samples, ndevices);
+  memset(&cost, 0, sizeof(bench_cost));
+
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++)
+    update_rows(rows, &samples[(tick & 1) * ndevices], ndevices, 50.0);
+  cost.ns = now_ns() - start;
+  sink = rows[0].delta[0];
+  if (reserve_output() == 0)
+    print_cost("counters-struct", ndevices, ticks, &cost);
+
+  for (impl = 0; impl < COUNTERS_NIMPLS; impl++) {
+    if (!counter_store_has_impl(impl))
+      continue;
+    start = now_ns();
+    for (tick = 0; tick < ticks; tick++) {
+      sample = &samples[(tick & 1) * ndevices];
+      for (i = 0; i < ndevices; i++)
+        counter_store_set(&store, i, &sample[i]);
+      counter_store_update_impl(&store, 50.0, impl);
+    }
+    cost.ns = now_ns() - start;
+    sink = store.delta[0][0];
+    if (reserve_output() == 0)
+      print_cost(COUNTERS_STAGES[impl], ndevices, ticks, &cost);
+  }
+
+  counter_store_free(&store);
+  free(rows);
+  free(samples);
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * get_stat_stdio()
+ *
+ * read the stat file of a disk the way get_stat() did before it kept the
+ * file open: fopen(), fscanf() and fclose() on every sample
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int get_stat_stdio(const char *path, diskstat *st) {
+  FILE *fp;
+  int n;
+
+  if ((fp = fopen(path, "r")) == NULL)
+    return 1;
+  n = fscanf(fp, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+                 " %" SCNu64,
+             &st->field[0], &st->field[1], &st->field[2], &st->field[3],
+             &st->field[4], &st->field[5], &st->field[6], &st->field[7],
+             &st->field[8], &st->field[9], &st->field[10]);
+  fclose(fp);
+  return n != STAT_MIN_FIELDS;
+}
+
+/******************************************************************************
+ *
+ * run_single()
+ *
+ * measure a sample of a single disk from /sys/block/<dev>/stat, read with
+ * stdio as it was before (single-stdio) and with the descriptor that the
+ * disk keeps open (single-pread). /proc/self/io only counts reads and
+ * writes, so the open() and close() of every stdio sample are not in its
+ * system calls
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int run_single(long ticks) {
+  char root[] = "/tmp/diskspeed-bench.XXXXXX";
+  char sysfs[PATH_MAX], procfs[PATH_MAX], path[PATH_MAX];
+  long long syscalls, overhead;
+  bench_cost cost;
+  diskdata data;
+  diskstat st;
+  uint64_t start;
+  long tick;
+  FILE *fp;
+  int result = 1;
+
+  if (mkdtemp(root) == NULL)
+    return 1;
+  if (make_tree(root, 0) != 0)
+    goto out;
+  snprintf(path, PATH_MAX, "%s/sys/block/bench0", root);
+  if (mkdir(path, 0700) != 0)
+    goto out;
+  snprintf(path, PATH_MAX, "%s/sys/block/bench0/stat", root);
+  if ((fp = fopen(path, "w")) == NULL)
+    goto out;
+  fprintf(fp, "1000000 1234 200000000 300000 4321 987654 400000000 1234567 "
+              "0 2000000 3000000 0 0 0 0 0 0\n");
+  if (fclose(fp) != 0)
+    goto out;
+
+  snprintf(sysfs, PATH_MAX, "%s/sys", root);
+  snprintf(procfs, PATH_MAX, "%s/proc", root);
+  set_disk_roots(sysfs, procfs);
+  memset(&data, 0, sizeof(diskdata));
+  data.fd = -1;
+  if (!init_diskspeed(&data, "bench0"))
+    goto out;
+  if (ticks == 0)
+    ticks = BENCH_MAX_TICKS;
+  memset(&cost, 0, sizeof(bench_cost));
+
+  syscalls = count_syscalls();
+  overhead = count_syscalls() - syscalls;
+
+  syscalls = count_syscalls();
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++)
+    get_stat_stdio(path, &st);
+  cost.ns = now_ns() - start;
+  cost.syscalls = syscalls < 0 ? -1 : count_syscalls() - syscalls - overhead;
+  sink = st.field[STAT_RD_SECTORS];
+  if (reserve_output() == 0)
+    print_cost("single-stdio", 1, ticks, &cost);
+
+  syscalls = count_syscalls();
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++)
+    get_current_diskspeed(&data, NULL, NULL, NULL);
+  cost.ns = now_ns() - start;
+  cost.syscalls = syscalls < 0 ? -1 : count_syscalls() - syscalls - overhead;
+  if (reserve_output() == 0)
+    print_cost("single-pread", 1, ticks, &cost);
+
+  close_diskspeed(&data);
+  result = flush_output();
+
+out:
+  snprintf(path, PATH_MAX, "%s/sys/block/bench0/stat", root);
+  unlink(path);
+  snprintf(path, PATH_MAX, "%s/sys/block/bench0", root);
+  rmdir(path);
+  remove_tree(root);
+  return result;
+}
+
+/******************************************************************************
+ *
+ * sample_scan()
+ *
+ * sample some devices of /proc/diskstats the way sample_diskset() did before
+ * the device table: parse every line and look its name up among the
+ * devices
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int sample_scan(int fd, char *buf, size_t size,
+                       const char (*names)[DISK_NAME_LENGTH], int nnames,
+                       diskstat *stats) {
+  const char *p, *end, *name;
+  unsigned int major, minor;
+  size_t namelen;
+  diskstat st;
+  ssize_t len;
+  int i;
+
+  if ((len = pread(fd, buf, size, 0)) < 0)
+    return 1;
+
+  p = buf;
+  end = buf + len;
+  while (p < end) {
+    if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen, &st) !=
+        0)
+      continue;
+    for (i = 0; i < nnames; i++) {
+      if (strncmp(names[i], name, namelen) == 0 && names[i][namelen] == '\0') {
+        stats[i] = st;
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * run_select()
+ *
+ * measure a tick that monitors a few devices of a large /proc/diskstats,
+ * with a scan of every line as it was before (select-scan) and with the
+ * device table (select-table)
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int run_select(long ticks) {
+  char root[] = "/tmp/diskspeed-bench.XXXXXX";
+  char sysfs[PATH_MAX], procfs[PATH_MAX], path[PATH_MAX];
+  char names[BENCH_SELECT_DEVICES][DISK_NAME_LENGTH];
+  diskstat stats[BENCH_SELECT_DEVICES];
+  long long syscalls, overhead;
+  bench_cost cost;
+  diskset set;
+  struct stat sb;
+  uint64_t start;
+  char *buf = NULL;
+  long tick;
+  int fd = -1, i, result = 1;
+
+  if (mkdtemp(root) == NULL)
+    return 1;
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  if (make_tree(root, BENCH_SELECT_LINES) != 0)
+    goto out;
+
+  snprintf(path, PATH_MAX, "%s/proc/diskstats", root);
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &sb) != 0 ||
+      (buf = malloc(sb.st_size)) == NULL)
+    goto out;
+  if (sscanf(BENCH_SELECT_SPEC, "%31s %31s", names[0], names[1]) !=
+      BENCH_SELECT_DEVICES)
+    goto out;
+
+  snprintf(sysfs, PATH_MAX, "%s/sys", root);
+  snprintf(procfs, PATH_MAX, "%s/proc", root);
+  set_disk_roots(sysfs, procfs);
+  if (!init_diskset(&set, BENCH_SELECT_SPEC) ||
+      set.ndisks != BENCH_SELECT_DEVICES)
+    goto out;
+  if (ticks == 0)
+    ticks = BENCH_WORK / BENCH_SELECT_LINES;
+  memset(&cost, 0, sizeof(bench_cost));
+
+  syscalls = count_syscalls();
+  overhead = count_syscalls() - syscalls;
+
+  syscalls = count_syscalls();
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++)
+    sample_scan(fd, buf, sb.st_size, names, BENCH_SELECT_DEVICES, stats);
+  cost.ns = now_ns() - start;
+  cost.syscalls = syscalls < 0 ? -1 : count_syscalls() - syscalls - overhead;
+  for (i = 0; i < BENCH_SELECT_DEVICES; i++)
+    sink = stats[i].field[STAT_RD_SECTORS];
+  if (reserve_output() == 0)
+    print_cost("select-scan", BENCH_SELECT_DEVICES, ticks, &cost);
+
+  syscalls = count_syscalls();
+  start = now_ns();
+  for (tick = 0; tick < ticks; tick++)
+    update_diskset(&set);
+  cost.ns = now_ns() - start;
+  cost.syscalls = syscalls < 0 ? -1 : count_syscalls() - syscalls - overhead;
+  if (reserve_output() == 0)
+    print_cost("select-table", BENCH_SELECT_DEVICES, ticks, &cost);
+
+  result = flush_output();
+
+out:
+  close_diskset(&set);
+  if (fd >= 0)
+    close(fd);
+  free(buf);
+  remove_tree(root);
+  return result;
+}
+
+/******************************************************************************
+ *
+ * run_count()
+ *
+ * benchmark every stage with a number of devices
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int run_count(int ndevices, long ticks) {
+  char root[] = "/tmp/diskspeed-bench.XXXXXX";
+  char sysfs[PATH_MAX], procfs[PATH_MAX];
+  diskset set;
+  history *hist;
+  bench_cost cost;
+  size_t s;
+  int i, result = 1;
+
+  if (mkdtemp(root) == NULL)
+    return 1;
+  if (make_tree(root, ndevices) != 0 ||
+      (hist = calloc(2 * ndevices, sizeof(history))) == NULL) {
+    remove_tree(root);
+    return 1;
+  }
+
+  snprintf(sysfs, PATH_MAX, "%s/sys", root);
+  snprintf(procfs, PATH_MAX, "%s/proc", root);
+  set_disk_roots(sysfs, procfs);
+
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  if (init_diskset(&set, "bench*") && set.ndisks == ndevices) {
+    for (i = 0; i < 2 * ndevices; i++)
+      history_init(&hist[i], BENCH_SMOOTH, BENCH_SCALE);
+    if (ticks == 0)
+      ticks = BENCH_WORK / ndevices < BENCH_MIN_TICKS ? BENCH_MIN_TICKS
+              : BENCH_WORK / ndevices > BENCH_MAX_TICKS
+                  ? BENCH_MAX_TICKS
+                  : BENCH_WORK / ndevices;
+
+    for (s = 0; s < sizeof(STAGES) / sizeof(STAGES[0]); s++) {
+      /* One untimed tick, so that every buffer has grown already */
+      run_stages(STAGES[s].stages, 1, &set, hist, &cost);
+      run_stages(STAGES[s].stages, ticks, &set, hist, &cost);
+      if (reserve_output() != 0)
+        break;
+      print_cost(STAGES[s].name, ndevices, ticks, &cost);
+    }
+    if (s == sizeof(STAGES) / sizeof(STAGES[0]) &&
+        run_parse(root, ticks, &cost) == 0 && reserve_output() == 0)
+      print_cost("parse", ndevices, ticks, &cost);
+    if (run_counters(ndevices, ticks) != 0)
+      result = 1;
+    else
+      result = flush_output();
+
+    for (i = 0; i < 2 * ndevices; i++)
+      history_free(&hist[i]);
+  }
+
+  close_diskset(&set);
+  free(hist);
+  remove_tree(root);
+
+  return result;
+}
+
+/* -------------------------------------------------------------------------- */
+int run_benchmark(const char *counts, long ticks) {
+  const char *p = counts;
+  char *end;
+  long n;
+
+  if (run_single(ticks) != 0 || run_select(ticks) != 0)
+    return 1;
+
+  while (*p) {
+    n = strtol(p, &end, 10);
+    if (end == p || n <= 0 || (*end != ',' && *end != '\0'))
+      return 1;
+    if (run_count(n, ticks) != 0)
+      return 1;
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  return 0;
+}
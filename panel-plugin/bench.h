@@ -0,0 +1,62 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+/* The numbers of devices that are benchmarked by default */
+#define BENCH_COUNTS "1,10,100,1000,10000"
+
+/**
+ * Measures what one tick costs with fake devices, for each number of
+ * devices. First, a sample of a single disk is measured, read from its stat
+ * file with stdio as it was before (single-stdio) and with the descriptor
+ * that is kept open (single-pread). Then two of the devices of a
+ * /proc/diskstats with 10000 lines are sampled, with a scan of every line as
+ * it was before (select-scan) and with the device table (select-table). The
+ * disks are read from a fake /sys and /proc tree in a temporary directory.
+ * Each stage is run on its own, then all of them together, and then the
+ * parser alone:
+ *
+ * sample   update_diskset()
+ * smooth   the history of the two bars of every disk
+ * format   format_byte_humanreadable() for the two speeds of every disk
+ * tick     all of the above
+ * parse    parse_diskstats_line() over a copy of /proc/diskstats in memory
+ *
+ * The differences and rates of the counters are then measured on their own,
+ * kept per device as they were before the counter store (counters-struct)
+ * and in the store with each implementation of its update that the CPU
+ * supports (counters-scalar, counters-sse2 and counters-avx2).
+ *
+ * One JSON object is printed per stage and number of devices, with the
+ * time, the allocations and the system calls per tick. The system calls are
+ * the reads and writes, and the opens and closes of files. The allocations
+ * are null if the tool was linked without --wrap, and then the opens and
+ * closes are not counted. The system calls are null without /proc/self/io.
+ * The parse stage also has the number of lines parsed per second.
+ * @param   counts      The numbers of devices, separated by commas
+ * @param   ticks       The number of ticks per stage, 0 to pick one from the
+ *                      number of devices
+ * @return  0 if successful, 1 in case of error
+ */
+int run_benchmark(const char *counts, long ticks);
+
+#endif /* BENCH_H */
@@ -0,0 +1,635 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cgroup.h"
+#include "disk.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* The events of a directory that change the tree. The removal of a
+   directory is taken from its parent, as the IN_IGNORED of the directory
+   itself only comes once its open io.stat is closed */
+#define CGROUP_EVENTS (IN_CREATE | IN_DELETE | IN_ONLYDIR)
+
+/* The size of the buffer for io.stat. A line per device is about 80 bytes,
+   and the lines that do not fit are not counted */
+#define CGROUP_BUFSIZE 8192
+
+/* The number of reads between two looks at the clock */
+#define CGROUP_CLOCK_STEP 32
+
+/* -------------------------------------------------------------------------- */
+void cgroup_init(cgroup_tree *cg) {
+  memset(cg, 0, sizeof(cgroup_tree));
+  cg->inotify_fd = -1;
+}
+
+/* -------------------------------------------------------------------------- */
+static void close_node(cgroup_tree *cg, cgroup_node *node) {
+  if (node->fd >= 0) {
+    close(node->fd);
+    node->fd = -1;
+    cg->nfds--;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void free_node(cgroup_tree *cg, cgroup_node *node) {
+  close_node(cg, node);
+  free(node->path);
+}
+
+/* -------------------------------------------------------------------------- */
+static void stop_watching(cgroup_tree *cg) {
+  int i;
+
+  if (cg->inotify_fd >= 0)
+    close(cg->inotify_fd);
+  cg->inotify_fd = -1;
+  for (i = 0; i < cg->nnodes; i++)
+    cg->nodes[i].wd = -1;
+}
+
+/******************************************************************************
+ *
+ * add_node()
+ *
+ * add a cgroup to the tree and watch its directory. If the directory cannot
+ * be watched, e.g. because there are too many watches, the whole tree is
+ * walked again from time to time instead. A parent that was a leaf is no
+ * longer read, and gives up its io.stat
+ *
+ * returns the index of the node, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static int add_node(cgroup_tree *cg, int parent, const char *path) {
+  char full[PATH_MAX];
+  cgroup_node *nodes, *node;
+  int capacity;
+
+  if (snprintf(full, PATH_MAX, "%s/%s", cg->root, path) >= PATH_MAX)
+    return -1;
+
+  if (cg->nnodes == cg->capacity) {
+    capacity = cg->capacity > 0 ? cg->capacity * 2 : 64;
+    if ((nodes = realloc(cg->nodes, capacity * sizeof(cgroup_node))) == NULL)
+      return -1;
+    cg->nodes = nodes;
+    cg->capacity = capacity;
+  }
+
+  node = &cg->nodes[cg->nnodes];
+  memset(node, 0, sizeof(cgroup_node));
+  if ((node->path = strdup(path)) == NULL)
+    return -1;
+  node->parent = parent;
+  node->fd = -1;
+  node->wd = -1;
+
+  if (cg->inotify_fd >= 0) {
+    if ((node->wd = inotify_add_watch(cg->inotify_fd, full, CGROUP_EVENTS)) <
+        0)
+      stop_watching(cg);
+  }
+
+  if (parent >= 0 && cg->nodes[parent].nchildren++ == 0)
+    close_node(cg, &cg->nodes[parent]);
+
+  return cg->nnodes++;
+}
+
+/******************************************************************************
+ *
+ * walk()
+ *
+ * add a cgroup and all the cgroups under it to the tree
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int walk(cgroup_tree *cg, int parent, const char *path) {
+  char full[PATH_MAX], child[PATH_MAX];
+  struct dirent *de;
+  struct stat st;
+  DIR *dir;
+  int index, ret = 0;
+
+  if ((index = add_node(cg, parent, path)) < 0)
+    return 1;
+
+  if (snprintf(full, PATH_MAX, "%s/%s", cg->root, path) >= PATH_MAX ||
+      (dir = opendir(full)) == NULL)
+    return 0;
+
+  while (ret == 0 && (de = readdir(dir)) != NULL) {
+    if (de->d_name[0] == '.')
+      continue;
+    /* A cgroup whose path does not fit is left out */
+    if (snprintf(child, PATH_MAX, "%s%s%s", path, *path ? "/" : "",
+                 de->d_name) >= PATH_MAX ||
+        snprintf(full, PATH_MAX, "%s/%s", cg->root, child) >= PATH_MAX)
+      continue;
+    if (de->d_type == DT_UNKNOWN) {
+      if (stat(full, &st) != 0 || !S_ISDIR(st.st_mode))
+        continue;
+    } else if (de->d_type != DT_DIR) {
+      continue;
+    }
+    ret = walk(cg, index, child);
+  }
+  closedir(dir);
+
+  return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+static int compare_nodes(const void *a, const void *b) {
+  return strcmp(((const cgroup_node *)a)->path,
+                ((const cgroup_node *)b)->path);
+}
+
+/******************************************************************************
+ *
+ * rewalk()
+ *
+ * build the tree again from scratch. The counters of the leaves that were
+ * already known are kept, so that their speed is not lost
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int rewalk(cgroup_tree *cg) {
+  cgroup_node *old = cg->nodes, *found;
+  int nold = cg->nnodes, i, ret;
+
+  cg->nodes = NULL;
+  cg->nnodes = 0;
+  cg->capacity = 0;
+  cg->cursor = 0;
+  /* The ranked paths point into the old nodes */
+  cg->ntop = 0;
+
+  /* Dropping the inotify instance drops all its watches */
+  if (cg->inotify_fd >= 0) {
+    close(cg->inotify_fd);
+    cg->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  }
+
+  ret = walk(cg, -1, "");
+  cg->stale = 0;
+  cg->walked = now_ns();
+
+  for (i = 0; i < nold; i++) {
+    if (old[i].fd >= 0) {
+      close(old[i].fd);
+      cg->nfds--;
+    }
+  }
+  if (nold > 0)
+    qsort(old, nold, sizeof(cgroup_node), compare_nodes);
+  for (i = 0; i < cg->nnodes && nold > 0; i++) {
+    found = bsearch(&cg->nodes[i], old, nold, sizeof(cgroup_node),
+                    compare_nodes);
+    /* A cgroup that was not a leaf was not read */
+    if (found != NULL && found->nchildren == 0) {
+      memcpy(cg->nodes[i].count, found->count, sizeof(found->count));
+      memcpy(cg->nodes[i].rate, found->rate, sizeof(found->rate));
+      cg->nodes[i].stamp = found->stamp;
+    }
+  }
+  for (i = 0; i < nold; i++)
+    free(old[i].path);
+  free(old);
+
+  return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+int cgroup_open(cgroup_tree *cg, const char *root, int budget) {
+  struct stat st;
+
+  cgroup_close(cg);
+
+  cg->budget = (uint64_t)budget * 1000u;
+  snprintf(cg->root, PATH_MAX, "%s", root);
+  if (stat(root, &st) != 0 || !S_ISDIR(st.st_mode))
+    return 1;
+
+  cg->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (rewalk(cg) != 0) {
+    cgroup_close(cg);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int find_wd(const cgroup_tree *cg, int wd) {
+  int i;
+
+  for (i = 0; i < cg->nnodes; i++) {
+    if (cg->nodes[i].wd == wd)
+      return i;
+  }
+  return -1;
+}
+
+/******************************************************************************
+ *
+ * remove_node()
+ *
+ * remove a cgroup whose directory is gone. The last node takes its place.
+ * A cgroup can only be removed once it has no children. A parent that is
+ * left without children becomes a leaf, which starts over from its next
+ * read
+ *
+ *****************************************************************************/
+
+static void remove_node(cgroup_tree *cg, int index) {
+  int last = cg->nnodes - 1, i;
+  cgroup_node *parent;
+
+  if (cg->nodes[index].parent >= 0) {
+    parent = &cg->nodes[cg->nodes[index].parent];
+    if (--parent->nchildren == 0) {
+      parent->stamp = 0;
+      memset(parent->rate, 0, sizeof(parent->rate));
+    }
+  }
+  free_node(cg, &cg->nodes[index]);
+
+  if (index != last) {
+    cg->nodes[index] = cg->nodes[last];
+    for (i = 0; i < last; i++) {
+      if (cg->nodes[i].parent == last)
+        cg->nodes[i].parent = index;
+    }
+  }
+  cg->nnodes--;
+}
+
+/* -------------------------------------------------------------------------- */
+static int find_child(const cgroup_tree *cg, int parent, const char *name) {
+  char path[PATH_MAX];
+  int i;
+
+  if (snprintf(path, PATH_MAX, "%s%s%s", cg->nodes[parent].path,
+               *cg->nodes[parent].path ? "/" : "", name) >= PATH_MAX)
+    return -1;
+  for (i = 0; i < cg->nnodes; i++) {
+    if (strcmp(cg->nodes[i].path, path) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+static void add_created(cgroup_tree *cg, int parent, const char *name) {
+  char path[PATH_MAX];
+
+  /* It may have been walked already, along with its parent */
+  if (find_child(cg, parent, name) >= 0)
+    return;
+
+  if (snprintf(path, PATH_MAX, "%s%s%s", cg->nodes[parent].path,
+               *cg->nodes[parent].path ? "/" : "", name) >= PATH_MAX)
+    return;
+  if (walk(cg, parent, path) != 0)
+    cg->stale = 1;
+}
+
+/******************************************************************************
+ *
+ * apply_events()
+ *
+ * take the pending inotify events and add or remove the cgroups that they
+ * tell of. If events were lost, or the root is gone, the tree is walked
+ * again
+ *
+ *****************************************************************************/
+
+static void apply_events(cgroup_tree *cg) {
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *ev;
+  ssize_t len;
+  char *p;
+  int index;
+
+  while (cg->inotify_fd >= 0 &&
+         (len = read(cg->inotify_fd, buf, sizeof(buf))) > 0) {
+    for (p = buf; p < buf + len; p += sizeof(*ev) + ev->len) {
+      ev = (const struct inotify_event *)p;
+      if (ev->mask & IN_Q_OVERFLOW) {
+        cg->stale = 1;
+      } else if ((ev->mask & IN_CREATE) && (ev->mask & IN_ISDIR)) {
+        if ((index = find_wd(cg, ev->wd)) >= 0)
+          add_created(cg, index, ev->name);
+      } else if ((ev->mask & IN_DELETE) && (ev->mask & IN_ISDIR)) {
+        if ((index = find_wd(cg, ev->wd)) >= 0 &&
+            (index = find_child(cg, index, ev->name)) >= 0) {
+          /* A cgroup only goes once it has no children */
+          if (cg->nodes[index].nchildren == 0)
+            remove_node(cg, index);
+          else
+            cg->stale = 1;
+        }
+      } else if ((ev->mask & IN_IGNORED) && find_wd(cg, ev->wd) == 0) {
+        cg->stale = 1;
+      }
+      /* add_created() may have given up on inotify */
+      if (cg->inotify_fd < 0)
+        return;
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+int cgroup_select(cgroup_tree *cg, const char *sysfs,
+                  const char *const *names, int n) {
+  char path[PATH_MAX];
+  unsigned int *majors, *minors;
+  FILE *fp;
+  int i;
+
+  majors = realloc(cg->majors, (n > 0 ? n : 1) * sizeof(unsigned int));
+  if (majors != NULL)
+    cg->majors = majors;
+  minors = realloc(cg->minors, (n > 0 ? n : 1) * sizeof(unsigned int));
+  if (minors != NULL)
+    cg->minors = minors;
+  cg->ndevs = 0;
+  if (majors == NULL || minors == NULL)
+    return 1;
+
+  for (i = 0; i < n; i++) {
+    if (snprintf(path, PATH_MAX, "%s/class/block/%s/dev", sysfs, names[i]) >=
+            PATH_MAX ||
+        (fp = fopen(path, "r")) == NULL)
+      continue;
+    if (fscanf(fp, "%u:%u", &majors[cg->ndevs], &minors[cg->ndevs]) == 2)
+      cg->ndevs++;
+    fclose(fp);
+  }
+
+  /* The counters now cover other devices */
+  for (i = 0; i < cg->nnodes; i++)
+    cg->nodes[i].stamp = 0;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_selected(const cgroup_tree *cg, unsigned int major,
+                       unsigned int minor) {
+  int i;
+
+  for (i = 0; i < cg->ndevs; i++) {
+    if (cg->majors[i] == major && cg->minors[i] == minor)
+      return 1;
+  }
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * parse_iostat()
+ *
+ * add up the counters of the selected devices in the contents of io.stat.
+ * Each line is a major:minor number followed by key=value pairs
+ *
+ *****************************************************************************/
+
+static void parse_iostat(const cgroup_tree *cg, const char *buf,
+                         uint64_t *count) {
+  static const char *const keys[CGROUP_NSTATS] = {"rbytes=", "wbytes=",
+                                                  "rios=", "wios="};
+  const char *p = buf;
+  unsigned long major, minor;
+  char *end;
+  int s;
+
+  memset(count, 0, CGROUP_NSTATS * sizeof(uint64_t));
+  while (*p) {
+    major = strtoul(p, &end, 10);
+    minor = *end == ':' ? strtoul(end + 1, &end, 10) : ULONG_MAX;
+    if (is_selected(cg, major, minor)) {
+      for (p = end; *p && *p != '\n';) {
+        while (*p == ' ')
+          p++;
+        for (s = 0; s < CGROUP_NSTATS; s++) {
+          if (strncmp(p, keys[s], strlen(keys[s])) == 0) {
+            count[s] += strtoull(p + strlen(keys[s]), NULL, 10);
+            break;
+          }
+        }
+        p += strcspn(p, " \n");
+      }
+    }
+    if ((p = strchr(p, '\n')) == NULL)
+      break;
+    p++;
+  }
+}
+
+/******************************************************************************
+ *
+ * read_node()
+ *
+ * read the io.stat of a leaf and compute its speed since its last read. The
+ * file stays open while there are fewer than CGROUP_MAX_FDS
+ *
+ *****************************************************************************/
+
+static void read_node(cgroup_tree *cg, cgroup_node *node) {
+  char buf[CGROUP_BUFSIZE], path[PATH_MAX];
+  uint64_t count[CGROUP_NSTATS], stamp;
+  ssize_t len;
+  double dt;
+  int fd = node->fd, s;
+
+  if (fd < 0) {
+    if (snprintf(path, PATH_MAX, "%s/%s/io.stat", cg->root, node->path) >=
+        PATH_MAX) {
+      node->missing = 1;
+      return;
+    }
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+      node->missing = errno == ENOENT;
+      return;
+    }
+  }
+
+  len = pread(fd, buf, sizeof(buf) - 1, 0);
+  stamp = now_ns();
+  /* The cgroup is being removed */
+  if (len < 0 && node->fd >= 0) {
+    close(node->fd);
+    node->fd = -1;
+    cg->nfds--;
+    return;
+  }
+  if (node->fd < 0) {
+    if (len >= 0 && cg->nfds < CGROUP_MAX_FDS) {
+      node->fd = fd;
+      cg->nfds++;
+    } else {
+      close(fd);
+    }
+  }
+  if (len < 0)
+    return;
+  buf[len] = '\0';
+
+  parse_iostat(cg, buf, count);
+  if (node->stamp != 0 && stamp > node->stamp) {
+    dt = (stamp - node->stamp) / 1e9;
+    for (s = 0; s < CGROUP_NSTATS; s++)
+      node->rate[s] = count[s] >= node->count[s]
+                          ? (count[s] - node->count[s]) / dt
+                          : 0;
+  }
+  memcpy(node->count, count, sizeof(count));
+  node->stamp = stamp;
+}
+
+/******************************************************************************
+ *
+ * visit_leaves()
+ *
+ * read the leaves of the tree in turn from the cursor, until the deadline or
+ * until all of them were read once
+ *
+ *****************************************************************************/
+
+static void visit_leaves(cgroup_tree *cg, uint64_t deadline) {
+  cgroup_node *node;
+  int n;
+
+  cg->visited = 0;
+  if (cg->cursor >= cg->nnodes)
+    cg->cursor = 0;
+  for (n = 0; n < cg->nnodes; n++) {
+    node = &cg->nodes[cg->cursor];
+    cg->cursor = cg->cursor + 1 < cg->nnodes ? cg->cursor + 1 : 0;
+    if (node->nchildren > 0 || node->missing)
+      continue;
+
+    read_node(cg, node);
+    if (++cg->visited % CGROUP_CLOCK_STEP == 0 && now_ns() >= deadline)
+      break;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static inline double node_speed(const cgroup_node *node) {
+  return node->rate[CGROUP_RBYTES] + node->rate[CGROUP_WBYTES];
+}
+
+/******************************************************************************
+ *
+ * rank_leaves()
+ *
+ * find the ntop leaves with the highest byte speeds by insertion into a short
+ * sorted list
+ *
+ *****************************************************************************/
+
+static void rank_leaves(cgroup_tree *cg, int ntop) {
+  const cgroup_node *ranked[CGROUP_MAX_TOP];
+  const cgroup_node *node;
+  int i, j, n = 0;
+
+  for (i = 0; i < cg->nnodes; i++) {
+    node = &cg->nodes[i];
+    if (node->nchildren > 0 || node->missing || node_speed(node) <= 0)
+      continue;
+    if (n == ntop && node_speed(node) <= node_speed(ranked[n - 1]))
+      continue;
+
+    j = n < ntop ? n++ : n - 1;
+    for (; j > 0 && node_speed(ranked[j - 1]) < node_speed(node); j--)
+      ranked[j] = ranked[j - 1];
+    ranked[j] = node;
+  }
+
+  for (j = 0; j < n; j++) {
+    cg->top[j].path = *ranked[j]->path ? ranked[j]->path : ".";
+    memcpy(cg->top[j].rate, ranked[j]->rate, sizeof(ranked[j]->rate));
+  }
+  cg->ntop = n;
+}
+
+/* -------------------------------------------------------------------------- */
+int cgroup_update(cgroup_tree *cg, int ntop) {
+  uint64_t start = now_ns();
+
+  if (*cg->root == '\0')
+    return 1;
+  if (ntop > CGROUP_MAX_TOP)
+    ntop = CGROUP_MAX_TOP;
+
+  if (cg->inotify_fd >= 0)
+    apply_events(cg);
+  else if (start - cg->walked >= CGROUP_REWALK)
+    cg->stale = 1;
+  if (cg->stale && rewalk(cg) != 0)
+    return 1;
+
+  visit_leaves(cg, start + cg->budget);
+  if (ntop > 0)
+    rank_leaves(cg, ntop);
+  else
+    cg->ntop = 0;
+
+  cg->cost = now_ns() - start;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void cgroup_close(cgroup_tree *cg) {
+  int i;
+
+  for (i = 0; i < cg->nnodes; i++)
+    free_node(cg, &cg->nodes[i]);
+  free(cg->nodes);
+  free(cg->majors);
+  free(cg->minors);
+  if (cg->inotify_fd >= 0)
+    close(cg->inotify_fd);
+  cgroup_init(cg);
+}
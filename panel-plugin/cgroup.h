@@ -0,0 +1,163 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <limits.h>
+#include <stdint.h>
+
+/* The mount point of the unified hierarchy */
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+/* The most cgroups that cgroup_update() ranks */
+#define CGROUP_MAX_TOP 10
+
+/* The time that one update may take by default, in us */
+#define CGROUP_BUDGET 1000
+
+/* The most io.stat files that are kept open between updates. The others are
+   opened on every read */
+#define CGROUP_MAX_FDS 512
+
+/* How often the tree is walked again when it cannot be watched, in ns */
+#define CGROUP_REWALK 10000000000u
+
+/* The counters of io.stat that are read */
+enum {
+  CGROUP_RBYTES,
+  CGROUP_WBYTES,
+  CGROUP_RIOS,
+  CGROUP_WIOS,
+  CGROUP_NSTATS
+};
+
+/* A cgroup of the tree */
+typedef struct {
+  /* Relative to the root of the tree, "" for the root itself */
+  char *path;
+  /* The index of the parent, -1 for the root, and the number of children */
+  int parent;
+  int nchildren;
+  /* The inotify watch of the directory, -1 if it is not watched */
+  int wd;
+  /* Its io.stat, -1 if not kept open. Only leaves keep it open */
+  int fd;
+  /* TRUE if it has no io.stat, as the root of the hierarchy */
+  int missing;
+  /* The counters of the selected devices at the last read, the time of
+     the read in ns, 0 before the first one, and the speeds since the
+     previous one, per second. Only leaves are read */
+  uint64_t count[CGROUP_NSTATS];
+  uint64_t stamp;
+  double rate[CGROUP_NSTATS];
+} cgroup_node;
+
+/* A cgroup that is ranked by its speed */
+typedef struct {
+  /* Points into the node, so it is only valid until the next update */
+  const char *path;
+  double rate[CGROUP_NSTATS];
+} cgroup_top;
+
+/* The cgroups under a directory of the unified hierarchy and their I/O, from
+   their io.stat files. The tree is walked once and then kept up to date from
+   the inotify events of its directories, so that an update only reads the
+   io.stat files. Without inotify, the tree is walked again every
+   CGROUP_REWALK. The counters of io.stat include those of the descendants,
+   so only the leaves are read and ranked. As with the processes, every
+   update continues where the last one stopped and ends when its budget is
+   spent, so that a full round over many cgroups is spread over many
+   updates */
+typedef struct {
+  char root[PATH_MAX];
+  cgroup_node *nodes;
+  int nnodes;
+  int capacity;
+  int nfds;
+  /* Non-blocking, -1 if the tree is walked again instead */
+  int inotify_fd;
+  /* TRUE if the tree must be walked again, and when it last was */
+  int stale;
+  uint64_t walked;
+
+  /* The node that the next update reads first */
+  int cursor;
+  /* The time that an update may take, in ns */
+  uint64_t budget;
+  /* What the last update cost: its time in ns, and the number of leaves
+     that it read */
+  uint64_t cost;
+  int visited;
+
+  /* The major:minor numbers of the devices that are counted */
+  unsigned int *majors;
+  unsigned int *minors;
+  int ndevs;
+
+  /* The heaviest leaves, from the last update */
+  cgroup_top top[CGROUP_MAX_TOP];
+  int ntop;
+} cgroup_tree;
+
+/**
+ * Initializes a closed object.
+ * @param   cg          The object
+ */
+void cgroup_init(cgroup_tree *cg);
+
+/**
+ * Walks the cgroups under a directory and watches them for changes.
+ * @param   cg          The object
+ * @param   root        The directory, e.g. CGROUP_ROOT "/system.slice"
+ * @param   budget      The time that an update may take, in us
+ * @return  0 if successful, 1 in case of error
+ */
+int cgroup_open(cgroup_tree *cg, const char *root, int budget);
+
+/**
+ * Selects the devices whose I/O is counted, by looking up their major:minor
+ * numbers in sysfs. Devices that are not found are left out.
+ * @param   cg          The object
+ * @param   sysfs       The root of sysfs, usually /sys
+ * @param   names       The names of the devices
+ * @param   n           The number of devices
+ * @return  0 if successful, 1 in case of error
+ */
+int cgroup_select(cgroup_tree *cg, const char *sysfs,
+                  const char *const *names, int n);
+
+/**
+ * Applies the changes to the tree, reads the io.stat of as many leaves as
+ * the budget allows, and ranks the leaves by the sum of their byte speeds.
+ * A leaf is ranked with the speed of its last two reads.
+ * @param   cg          The object
+ * @param   ntop        The number of cgroups to rank, up to CGROUP_MAX_TOP
+ * @return  0 if successful, 1 in case of error
+ */
+int cgroup_update(cgroup_tree *cg, int ntop);
+
+/**
+ * Closes all the files and releases the tree.
+ * @param   cg          The object
+ */
+void cgroup_close(cgroup_tree *cg);
+
+#endif /* CGROUP_H */
@@ -0,0 +1,463 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "bench.h"
+#include "disk.h"
+#include "output.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <getopt.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* The whole disks of the usual drivers, if no device is given */
+#define DEFAULT_SPEC                                                           \
+  "sd[a-z] sd[a-z][a-z] vd[a-z] xvd[a-z] hd[a-z] nvme*n[0-9] mmcblk[0-9]"
+
+#define DEFAULT_INTERVAL 1000
+
+enum { FORMAT_TABLE, FORMAT_CSV, FORMAT_JSON };
+
+/* The long options without a short form */
+enum {
+  OPTION_SYSFS = 256,
+  OPTION_PROCFS,
+  OPTION_RECORD,
+  OPTION_RECORD_SIZE,
+  OPTION_REPLAY,
+  OPTION_FAST,
+  OPTION_BENCH
+};
+
+/* The default size of a trace before it is rotated, in MiB */
+#define DEFAULT_RECORD_SIZE 64
+
+/* -------------------------------------------------------------------------- */
+static void usage(FILE *stream) {
+  fprintf(stream,
+          "Usage: diskspeed [OPTION]... [DEVICE]...\n"
+          "Print the speed of block devices at a regular interval.\n"
+          "\n"
+          "  -f, --format=FORMAT    table (default), csv or json, one object "
+          "per line\n"
+          "  -i, --interval=MS      the interval in ms (default %d)\n"
+          "  -c, --count=N          stop after N intervals (default: never)\n"
+          "      --sysfs=DIR        read sysfs from DIR instead of /sys\n"
+          "      --procfs=DIR       read procfs from DIR instead of /proc\n"
+          "      --record=FILE      also append the samples to FILE\n"
+          "      --record-size=MIB  rotate FILE to FILE.1 above MIB MiB "
+          "(default %d)\n"
+          "      --replay=FILE      print the samples recorded in FILE "
+          "instead\n"
+          "      --fast             replay as fast as possible rather than "
+          "at the\n"
+          "                         recorded pace\n"
+          "      --bench[=COUNTS]   measure the cost of a tick with fake "
+          "devices,\n"
+          "                         for each number of devices of COUNTS "
+          "(default\n"
+          "                         %s), -c ticks per stage\n"
+          "  -h, --help             show this help\n"
+          "\n"
+          "Devices are names or glob patterns of /proc/diskstats, e.g. "
+          "'nvme*n1'.\n"
+          "A name prefixed with + adds the devices it is stacked on, e.g. "
+          "'+md0'.\n"
+          "A path stands for the device under it, e.g. "
+          "'/var/lib/postgresql',\n"
+          "or for its mount if it is on NFS.\n",
+          DEFAULT_INTERVAL, DEFAULT_RECORD_SIZE, BENCH_COUNTS);
+}
+
+/* -------------------------------------------------------------------------- */
+static void print_header(int format) {
+  switch (format) {
+  case FORMAT_TABLE:
+    put_string("Device         Read/s      Write/s"
+               "       r/s       w/s r_await w_await  aqu-sz  %util\n");
+    break;
+
+  case FORMAT_CSV:
+    put_string("time,device,avail,read_bytes,write_bytes,read_iops,"
+               "write_iops,r_await,w_await,queue,util\n");
+    break;
+  }
+}
+
+/******************************************************************************
+ *
+ * print_disk()
+ *
+ * append one line for a disk to the output buffer. The rates of the table are
+ * formatted like in the panel, the others are plain numbers
+ *
+ *****************************************************************************/
+
+static void print_disk(int format, uint64_t time_ms, const diskdata *data) {
+  char buffer[64];
+  char number[128];
+
+  switch (format) {
+  case FORMAT_TABLE:
+    put_padded(data->dev_name, 8, TRUE);
+    if (!data->avail) {
+      put_string("  unavailable\n");
+      break;
+    }
+    format_bytes(buffer, sizeof(buffer), data->cur_in, 2, UNITS_IEC, 13);
+    put_string(buffer);
+    format_bytes(buffer, sizeof(buffer), data->cur_out, 2, UNITS_IEC, 13);
+    put_string(buffer);
+    snprintf(number, sizeof(number), "%10.1f%10.1f%8.2f%8.2f%8.2f%7.1f",
+             get_metric(data, METRIC_RD_IOPS), get_metric(data, METRIC_WR_IOPS),
+             get_metric(data, METRIC_R_AWAIT), get_metric(data, METRIC_W_AWAIT),
+             get_metric(data, METRIC_QUEUE), get_metric(data, METRIC_UTIL));
+    put_string(number);
+    put_char('\n');
+    break;
+
+  case FORMAT_CSV:
+    put_uint(time_ms);
+    put_char(',');
+    put_string(data->dev_name);
+    put_char(',');
+    put_char(data->avail ? '1' : '0');
+    put_char(',');
+    put_uint(data->cur_in);
+    put_char(',');
+    put_uint(data->cur_out);
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_RD_IOPS));
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_WR_IOPS));
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_R_AWAIT));
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_W_AWAIT));
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_QUEUE));
+    put_char(',');
+    put_fixed(get_metric(data, METRIC_UTIL));
+    put_char('\n');
+    break;
+
+  case FORMAT_JSON:
+    put_string("{\"time\":");
+    put_uint(time_ms);
+    put_string(",\"device\":");
+    put_json_string(data->dev_name);
+    if (!data->avail) {
+      put_string(",\"avail\":false}\n");
+      break;
+    }
+    put_string(",\"avail\":true,\"read_bytes\":");
+    put_uint(data->cur_in);
+    put_string(",\"write_bytes\":");
+    put_uint(data->cur_out);
+    put_string(",\"read_iops\":");
+    put_fixed(get_metric(data, METRIC_RD_IOPS));
+    put_string(",\"write_iops\":");
+    put_fixed(get_metric(data, METRIC_WR_IOPS));
+    put_string(",\"r_await\":");
+    put_fixed(get_metric(data, METRIC_R_AWAIT));
+    put_string(",\"w_await\":");
+    put_fixed(get_metric(data, METRIC_W_AWAIT));
+    put_string(",\"queue\":");
+    put_fixed(get_metric(data, METRIC_QUEUE));
+    put_string(",\"util\":");
+    put_fixed(get_metric(data, METRIC_UTIL));
+    put_string("}\n");
+    break;
+  }
+}
+
+/******************************************************************************
+ *
+ * print_set()
+ *
+ * print one line per disk of the set, and write the output
+ *
+ * returns 0 if successful, 1 if the output could not be written
+ *
+ *****************************************************************************/
+
+static int print_set(int format, uint64_t time_ms, const diskset *set) {
+  int i;
+
+  for (i = 0; i < set->ndisks; i++) {
+    if (reserve_output() != 0)
+      return 1;
+    print_disk(format, time_ms, &set->disks[i]);
+  }
+  if (format == FORMAT_TABLE && set->ndisks > 1)
+    put_char('\n');
+  return flush_output();
+}
+
+/******************************************************************************
+ *
+ * replay()
+ *
+ * print the samples of a trace as if they were live. The first one only
+ * primes the disks, as when sampling. At the recorded pace, each sample is
+ * printed after the time that separated it from the first one
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int replay(const char *path, int format, int fast, long count) {
+  trace_reader trace;
+  diskset set;
+  struct timespec start, deadline;
+  uint64_t first, offset;
+  long tick;
+
+  trace_reader_init(&trace);
+  if (trace_reader_open(&trace, path) != 0) {
+    fprintf(stderr, "diskspeed: cannot read the trace %s\n", path);
+    return 1;
+  }
+
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  counter_store_init(&set.counters);
+
+  print_header(format);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (trace_replay(&trace, &set) == 0) {
+    first = trace.stamp;
+    for (tick = 0; (count == 0 || tick < count) &&
+                   trace_replay(&trace, &set) == 0;
+         tick++) {
+      offset = trace.stamp - first;
+      if (!fast) {
+        deadline = start;
+        deadline.tv_sec += offset / 1000000000u;
+        deadline.tv_nsec += offset % 1000000000u;
+        if (deadline.tv_nsec >= 1000000000) {
+          deadline.tv_sec++;
+          deadline.tv_nsec -= 1000000000;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                               NULL) != 0)
+          ;
+      }
+
+      if (print_set(format,
+                    (trace.start_realtime + trace.stamp - trace.start) /
+                        1000000,
+                    &set) != 0)
+        break;
+    }
+  }
+
+  close_diskset(&set);
+  trace_reader_close(&trace);
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void add_ms(struct timespec *ts, long ms) {
+  ts->tv_sec += ms / 1000;
+  ts->tv_nsec += ms % 1000 * 1000000;
+  if (ts->tv_nsec >= 1000000000) {
+    ts->tv_sec++;
+    ts->tv_nsec -= 1000000000;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+  static const struct option options[] = {
+      {"format", required_argument, NULL, 'f'},
+      {"interval", required_argument, NULL, 'i'},
+      {"count", required_argument, NULL, 'c'},
+      {"sysfs", required_argument, NULL, OPTION_SYSFS},
+      {"procfs", required_argument, NULL, OPTION_PROCFS},
+      {"record", required_argument, NULL, OPTION_RECORD},
+      {"record-size", required_argument, NULL, OPTION_RECORD_SIZE},
+      {"replay", required_argument, NULL, OPTION_REPLAY},
+      {"fast", no_argument, NULL, OPTION_FAST},
+      {"bench", optional_argument, NULL, OPTION_BENCH},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+  diskset set;
+  mount_table mounts;
+  const char *procfs = "/proc";
+  trace_writer trace;
+  struct timespec deadline, now;
+  char *spec = NULL;
+  const char *record = NULL, *replay_path = NULL, *bench = NULL;
+  size_t speclen = 0;
+  long interval = DEFAULT_INTERVAL, count = 0, tick;
+  long record_size = DEFAULT_RECORD_SIZE;
+  int format = FORMAT_TABLE, fast = 0;
+  int opt, i;
+
+  setlocale(LC_ALL, "");
+
+  while ((opt = getopt_long(argc, argv, "f:i:c:h", options, NULL)) != -1) {
+    switch (opt) {
+    case 'f':
+      if (strcmp(optarg, "table") == 0)
+        format = FORMAT_TABLE;
+      else if (strcmp(optarg, "csv") == 0)
+        format = FORMAT_CSV;
+      else if (strcmp(optarg, "json") == 0)
+        format = FORMAT_JSON;
+      else {
+        usage(stderr);
+        return 1;
+      }
+      break;
+
+    case 'i':
+      interval = strtol(optarg, NULL, 10);
+      break;
+
+    case 'c':
+      count = strtol(optarg, NULL, 10);
+      break;
+
+    case OPTION_SYSFS:
+      set_disk_roots(optarg, NULL);
+      break;
+
+    case OPTION_PROCFS:
+      set_disk_roots(NULL, optarg);
+      procfs = optarg;
+      break;
+
+    case OPTION_RECORD:
+      record = optarg;
+      break;
+
+    case OPTION_RECORD_SIZE:
+      record_size = strtol(optarg, NULL, 10);
+      break;
+
+    case OPTION_REPLAY:
+      replay_path = optarg;
+      break;
+
+    case OPTION_FAST:
+      fast = 1;
+      break;
+
+    case OPTION_BENCH:
+      bench = optarg != NULL ? optarg : BENCH_COUNTS;
+      break;
+
+    case 'h':
+      usage(stdout);
+      return 0;
+
+    default:
+      usage(stderr);
+      return 1;
+    }
+  }
+
+  if (interval <= 0 || count < 0 || record_size < 0) {
+    usage(stderr);
+    return 1;
+  }
+
+  if (bench != NULL)
+    return run_benchmark(bench, count);
+
+  if (replay_path != NULL)
+    return replay(replay_path, format, fast, count);
+
+  /* The devices are joined into one specification */
+  for (i = optind; i < argc; i++)
+    speclen += strlen(argv[i]) + 1;
+  if (speclen > 0) {
+    if ((spec = malloc(speclen)) == NULL)
+      return 1;
+    spec[0] = '\0';
+    for (i = optind; i < argc; i++) {
+      strcat(spec, argv[i]);
+      strcat(spec, i + 1 < argc ? " " : "");
+    }
+  }
+
+  /* The paths are only resolved once */
+  mounts_init(&mounts);
+  if (mounts_open(&mounts, procfs) >= 0)
+    set_disk_mounts(&mounts);
+
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  if (!init_diskset(&set, spec != NULL ? spec : DEFAULT_SPEC))
+    fprintf(stderr, "diskspeed: no disk found\n");
+  free(spec);
+
+  set_disk_mounts(NULL);
+  mounts_close(&mounts);
+
+  /* The first sample is recorded too, so that the replay is primed like the
+     live set */
+  trace_writer_init(&trace);
+  if (record != NULL) {
+    if (trace_writer_open(&trace, record,
+                          (uint64_t)record_size * 1024 * 1024) != 0) {
+      fprintf(stderr, "diskspeed: cannot create the trace %s\n", record);
+      close_diskset(&set);
+      return 1;
+    }
+    trace_write(&trace, &set);
+  }
+
+  print_header(format);
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  for (tick = 0; count == 0 || tick < count; tick++) {
+    add_ms(&deadline, interval);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) !=
+           0)
+      ;
+
+    update_diskset(&set);
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (record != NULL)
+      trace_write(&trace, &set);
+
+    if (print_set(format, now.tv_sec * 1000ull + now.tv_nsec / 1000000,
+                  &set) != 0)
+      break;
+  }
+
+  trace_writer_close(&trace);
+  close_diskset(&set);
+
+  return 0;
+}
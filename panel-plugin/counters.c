@@ -0,0 +1,297 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "counters.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* The alignment of the columns, in bytes. Enough for AVX2 */
+#define COUNTERS_ALIGN 32
+#define COUNTERS_ROWS_PER_VECTOR (COUNTERS_ALIGN / 8)
+
+/* The number of columns of each kind: cur, prev, delta and rate */
+#define COUNTERS_COLUMNS (4 * STAT_NFIELDS)
+
+typedef void (*update_column_fn)(const uint64_t *, uint64_t *, uint64_t *,
+                                 double *, int, double);
+
+/******************************************************************************
+ *
+ * update_column_scalar()
+ *
+ * compute the differences and rates of one field for n rows. A counter that
+ * went backwards was reset, and its difference is 0. The borrow of the
+ * subtraction tells whether cur < prev without a branch, which is what lets
+ * the compiler and the SIMD versions below process whole vectors
+ *
+ *****************************************************************************/
+
+static void update_column_scalar(const uint64_t *cur, uint64_t *prev,
+                                 uint64_t *delta, double *rate, int n,
+                                 double inv_dt) {
+  uint64_t c, p, d, borrow;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    c = cur[i];
+    p = prev[i];
+    d = c - p;
+    borrow = ((~c & p) | (~(c ^ p) & d)) >> 63;
+    d &= borrow - 1;
+    delta[i] = d;
+    rate[i] = (double)d * inv_dt;
+    prev[i] = c;
+  }
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* 2^52 and 2^84 + 2^52, used to convert 64-bit integers to doubles in two
+   32-bit halves, since there is no such conversion before AVX-512 */
+#define TWO_52 4503599627370496.0
+#define TWO_84 19342813113834066795298816.0
+#define TWO_84_52 19342813118337666422669312.0
+
+/* -------------------------------------------------------------------------- */
+__attribute__((target("sse2"))) static inline __m128d
+u64_to_pd_sse2(__m128i x) {
+  __m128i lo = _mm_and_si128(x, _mm_set1_epi64x(0xffffffff));
+  __m128i hi = _mm_srli_epi64(x, 32);
+
+  lo = _mm_or_si128(lo, _mm_castpd_si128(_mm_set1_pd(TWO_52)));
+  hi = _mm_or_si128(hi, _mm_castpd_si128(_mm_set1_pd(TWO_84)));
+  return _mm_add_pd(
+      _mm_sub_pd(_mm_castsi128_pd(hi), _mm_set1_pd(TWO_84_52)),
+      _mm_castsi128_pd(lo));
+}
+
+/* -------------------------------------------------------------------------- */
+__attribute__((target("sse2"))) static void
+update_column_sse2(const uint64_t *cur, uint64_t *prev, uint64_t *delta,
+                   double *rate, int n, double inv_dt) {
+  __m128d scale = _mm_set1_pd(inv_dt);
+  __m128i ones = _mm_set1_epi64x(-1);
+  __m128i c, p, d, borrow;
+  int i;
+
+  for (i = 0; i < n; i += 2) {
+    c = _mm_load_si128((const __m128i *)&cur[i]);
+    p = _mm_load_si128((const __m128i *)&prev[i]);
+    d = _mm_sub_epi64(c, p);
+    borrow = _mm_or_si128(_mm_andnot_si128(c, p),
+                          _mm_andnot_si128(_mm_xor_si128(c, p), d));
+    /* All ones if there was no borrow */
+    borrow = _mm_add_epi64(_mm_srli_epi64(borrow, 63), ones);
+    d = _mm_and_si128(d, borrow);
+    _mm_store_si128((__m128i *)&delta[i], d);
+    _mm_store_pd(&rate[i], _mm_mul_pd(u64_to_pd_sse2(d), scale));
+    _mm_store_si128((__m128i *)&prev[i], c);
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+__attribute__((target("avx2"))) static inline __m256d
+u64_to_pd_avx2(__m256i x) {
+  __m256i lo = _mm256_and_si256(x, _mm256_set1_epi64x(0xffffffff));
+  __m256i hi = _mm256_srli_epi64(x, 32);
+
+  lo = _mm256_or_si256(lo, _mm256_castpd_si256(_mm256_set1_pd(TWO_52)));
+  hi = _mm256_or_si256(hi, _mm256_castpd_si256(_mm256_set1_pd(TWO_84)));
+  return _mm256_add_pd(
+      _mm256_sub_pd(_mm256_castsi256_pd(hi), _mm256_set1_pd(TWO_84_52)),
+      _mm256_castsi256_pd(lo));
+}
+
+/* -------------------------------------------------------------------------- */
+__attribute__((target("avx2"))) static void
+update_column_avx2(const uint64_t *cur, uint64_t *prev, uint64_t *delta,
+                   double *rate, int n, double inv_dt) {
+  __m256d scale = _mm256_set1_pd(inv_dt);
+  __m256i ones = _mm256_set1_epi64x(-1);
+  __m256i c, p, d, borrow;
+  int i;
+
+  for (i = 0; i < n; i += 4) {
+    c = _mm256_load_si256((const __m256i *)&cur[i]);
+    p = _mm256_load_si256((const __m256i *)&prev[i]);
+    d = _mm256_sub_epi64(c, p);
+    borrow = _mm256_or_si256(_mm256_andnot_si256(c, p),
+                             _mm256_andnot_si256(_mm256_xor_si256(c, p), d));
+    /* All ones if there was no borrow */
+    borrow = _mm256_add_epi64(_mm256_srli_epi64(borrow, 63), ones);
+    d = _mm256_and_si256(d, borrow);
+    _mm256_store_si256((__m256i *)&delta[i], d);
+    _mm256_store_pd(&rate[i], _mm256_mul_pd(u64_to_pd_avx2(d), scale));
+    _mm256_store_si256((__m256i *)&prev[i], c);
+  }
+}
+
+#endif /* HAVE_X86_SIMD */
+
+static const update_column_fn IMPLS[COUNTERS_NIMPLS] = {
+    update_column_scalar,
+#ifdef HAVE_X86_SIMD
+    update_column_sse2, update_column_avx2
+#else
+    NULL, NULL
+#endif
+};
+
+/* The fastest implementation that the CPU supports, picked on the first
+   update. The sampler thread and the panel may both get there first */
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static update_column_fn update_column;
+
+/* -------------------------------------------------------------------------- */
+int counter_store_has_impl(int impl) {
+  switch (impl) {
+  case COUNTERS_SCALAR:
+    return 1;
+#ifdef HAVE_X86_SIMD
+  case COUNTERS_SSE2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2") != 0;
+  case COUNTERS_AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+  default:
+    return 0;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void select_update_column(void) {
+  int impl = COUNTERS_NIMPLS - 1;
+
+  while (!counter_store_has_impl(impl))
+    impl--;
+  update_column = IMPLS[impl];
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_init(counter_store *store) {
+  memset(store, 0, sizeof(counter_store));
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_free(counter_store *store) {
+  free(store->block);
+  counter_store_init(store);
+}
+
+/* -------------------------------------------------------------------------- */
+int counter_store_resize(counter_store *store, int size) {
+  counter_store old = *store;
+  size_t column;
+  char *block;
+  int capacity, f;
+
+  if (size <= store->capacity) {
+    for (f = 0; size < store->size && f < STAT_NFIELDS; f++) {
+      memset(&store->cur[f][size], 0, (store->size - size) * 8);
+      memset(&store->prev[f][size], 0, (store->size - size) * 8);
+    }
+    store->size = size;
+    return 0;
+  }
+
+  capacity = (size + COUNTERS_ROWS_PER_VECTOR - 1) &
+             ~(COUNTERS_ROWS_PER_VECTOR - 1);
+  if (capacity < 2 * store->capacity)
+    capacity = 2 * store->capacity;
+
+  column = (size_t)capacity * 8;
+  if (posix_memalign((void **)&block, COUNTERS_ALIGN,
+                     COUNTERS_COLUMNS * column) != 0)
+    return 1;
+  memset(block, 0, COUNTERS_COLUMNS * column);
+
+  store->block = block;
+  store->capacity = capacity;
+  for (f = 0; f < STAT_NFIELDS; f++) {
+    store->cur[f] = (uint64_t *)(block + (4 * f + 0) * column);
+    store->prev[f] = (uint64_t *)(block + (4 * f + 1) * column);
+    store->delta[f] = (uint64_t *)(block + (4 * f + 2) * column);
+    store->rate[f] = (double *)(block + (4 * f + 3) * column);
+
+    if (old.size > 0) {
+      memcpy(store->cur[f], old.cur[f], old.size * 8);
+      memcpy(store->prev[f], old.prev[f], old.size * 8);
+    }
+  }
+  free(old.block);
+  store->size = size;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_set(counter_store *store, int row, const diskstat *st) {
+  int f;
+
+  for (f = 0; f < STAT_NFIELDS; f++)
+    store->cur[f][row] = st->field[f];
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_prime(counter_store *store, int row) {
+  int f;
+
+  for (f = 0; f < STAT_NFIELDS; f++)
+    store->prev[f][row] = store->cur[f][row];
+}
+
+/* -------------------------------------------------------------------------- */
+static void update_columns(counter_store *store, double inv_dt,
+                           update_column_fn update) {
+  int n, f;
+
+  /* The padding rows are zero, so whole vectors can be processed */
+  n = (store->size + COUNTERS_ROWS_PER_VECTOR - 1) &
+      ~(COUNTERS_ROWS_PER_VECTOR - 1);
+  for (f = 0; f < STAT_NFIELDS; f++)
+    update(store->cur[f], store->prev[f], store->delta[f], store->rate[f], n,
+           inv_dt);
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_update(counter_store *store, double inv_dt) {
+  pthread_once(&select_once, select_update_column);
+  update_columns(store, inv_dt, update_column);
+}
+
+/* -------------------------------------------------------------------------- */
+void counter_store_update_impl(counter_store *store, double inv_dt,
+                               int impl) {
+  update_columns(store, inv_dt, IMPLS[impl]);
+}
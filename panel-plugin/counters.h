@@ -0,0 +1,117 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdint.h>
+
+#include "diskstats.h"
+
+/* The counters of many devices, stored as one column per field so that the
+   differences and rates of all the devices are computed in a single pass over
+   contiguous memory. Row i holds device i */
+typedef struct {
+  int size;
+  /* The number of rows allocated. A multiple of COUNTERS_ALIGN / 8, so that
+     whole vectors can be processed without a remainder loop */
+  int capacity;
+  uint64_t *cur[STAT_NFIELDS];
+  uint64_t *prev[STAT_NFIELDS];
+  /* Difference between cur and prev, or 0 if the counter went backwards */
+  uint64_t *delta[STAT_NFIELDS];
+  /* delta per second */
+  double *rate[STAT_NFIELDS];
+  void *block;
+} counter_store;
+
+/* The implementations of the update. Not all of them are available on every
+   CPU */
+enum {
+  COUNTERS_SCALAR,
+  COUNTERS_SSE2,
+  COUNTERS_AVX2,
+  COUNTERS_NIMPLS
+};
+
+/**
+ * Initializes an empty store.
+ * @param   store       The object
+ */
+void counter_store_init(counter_store *store);
+
+/**
+ * Releases the memory held by the store. It is safe to call
+ * counter_store_init() again afterwards.
+ * @param   store       The object
+ */
+void counter_store_free(counter_store *store);
+
+/**
+ * Changes the number of rows of the store. Existing rows are preserved, new
+ * rows are zeroed.
+ * @param   store       The object
+ * @param   size        The new number of rows
+ * @return  0 if successful, 1 if memory could not be allocated
+ */
+int counter_store_resize(counter_store *store, int size);
+
+/**
+ * Stores the fields of a sample in a row of cur.
+ * @param   store       The object
+ * @param   row         The row
+ * @param   st          The sample
+ */
+void counter_store_set(counter_store *store, int row, const diskstat *st);
+
+/**
+ * Makes the current values of a row the previous ones, so that the next
+ * update reports no change for it. Used when a device is new or was reset.
+ * @param   store       The object
+ * @param   row         The row
+ */
+void counter_store_prime(counter_store *store, int row);
+
+/**
+ * Computes delta and rate for every row and field, then moves cur to prev.
+ * The SIMD implementation is chosen at runtime from what the CPU supports.
+ * @param   store       The object
+ * @param   inv_dt      The inverse of the length of the interval in seconds
+ */
+void counter_store_update(counter_store *store, double inv_dt);
+
+/**
+ * Tells whether an implementation of the update can run on this CPU.
+ * @param   impl        One of COUNTERS_SCALAR, COUNTERS_SSE2 or COUNTERS_AVX2
+ * @return  1 if it can, 0 otherwise
+ */
+int counter_store_has_impl(int impl);
+
+/**
+ * Does what counter_store_update() does with a given implementation, so that
+ * the implementations can be compared with one another.
+ * @param   store       The object
+ * @param   inv_dt      The inverse of the length of the interval in seconds
+ * @param   impl        An implementation for which counter_store_has_impl()
+ *                      is true
+ */
+void counter_store_update_impl(counter_store *store, double inv_dt, int impl);
+
+#endif /* COUNTERS_H */
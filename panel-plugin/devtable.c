@@ -0,0 +1,175 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "devtable.h"
+#include "diskstats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The smallest hash table that is allocated */
+#define DEVTABLE_MIN_CAPACITY 64
+
+/* -------------------------------------------------------------------------- */
+static inline unsigned int hash_key(uint32_t key, unsigned int capacity) {
+  /* Mix the bits so that the consecutive minor numbers of partitions do not
+     end up in long runs of neighbouring slots */
+  key ^= key >> 16;
+  key *= 0x45d9f3bu;
+  key ^= key >> 16;
+  return key & (capacity - 1);
+}
+
+/* -------------------------------------------------------------------------- */
+void devtable_init(devtable *table) { memset(table, 0, sizeof(devtable)); }
+
+/* -------------------------------------------------------------------------- */
+void devtable_free(devtable *table) {
+  free(table->entries);
+  free(table->lines);
+  free(table->selected);
+  devtable_init(table);
+}
+
+/******************************************************************************
+ *
+ * reserve()
+ *
+ * make room for n lines, and size the hash table so that it is at most half
+ * full. The contents are not preserved
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int reserve(devtable *table, int n) {
+  unsigned int capacity = DEVTABLE_MIN_CAPACITY;
+  devtable_line *lines;
+  devtable_entry *entries;
+  int *selected;
+
+  if (n > table->lines_capacity) {
+    lines = realloc(table->lines, n * sizeof(devtable_line));
+    selected = realloc(table->selected, n * sizeof(int));
+    if (lines != NULL)
+      table->lines = lines;
+    if (selected != NULL)
+      table->selected = selected;
+    if (lines == NULL || selected == NULL)
+      return 1;
+    table->lines_capacity = n;
+  }
+
+  while (capacity < 2 * (unsigned int)n)
+    capacity *= 2;
+  if (capacity != table->capacity) {
+    if ((entries = realloc(table->entries,
+                           capacity * sizeof(devtable_entry))) == NULL)
+      return 1;
+    table->entries = entries;
+    table->capacity = capacity;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void insert(devtable *table, uint32_t key, int line) {
+  unsigned int i = hash_key(key, table->capacity);
+
+  while (table->entries[i].line >= 0 && table->entries[i].key != key)
+    i = (i + 1) & (table->capacity - 1);
+
+  table->entries[i].key = key;
+  table->entries[i].line = line;
+}
+
+/* -------------------------------------------------------------------------- */
+int devtable_build(devtable *table, const char *buf, size_t len) {
+  const char *p = buf, *end = buf + len, *name;
+  unsigned int major, minor;
+  size_t namelen;
+  diskstat st;
+  unsigned int i;
+  int n = 0;
+
+  while (p < end) {
+    p = next_line(p, end);
+    n++;
+  }
+  if (reserve(table, n > 0 ? n : 1) != 0)
+    return 1;
+
+  for (i = 0; i < table->capacity; i++)
+    table->entries[i].line = -1;
+
+  table->nlines = 0;
+  table->nselected = 0;
+  p = buf;
+  while (p < end) {
+    major = minor = 0;
+    name = p;
+    if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen, &st) !=
+        0)
+      namelen = 0;
+
+    table->lines[table->nlines].key = DEVTABLE_KEY(major, minor);
+    table->lines[table->nlines].name = name - buf;
+    table->lines[table->nlines].namelen = namelen;
+    table->lines[table->nlines].slot = -1;
+    if (namelen > 0)
+      insert(table, DEVTABLE_KEY(major, minor), table->nlines);
+    table->nlines++;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int devtable_lookup(const devtable *table, uint32_t key) {
+  unsigned int i;
+
+  if (table->capacity == 0)
+    return -1;
+
+  i = hash_key(key, table->capacity);
+  while (table->entries[i].line >= 0) {
+    if (table->entries[i].key == key)
+      return table->entries[i].line;
+    i = (i + 1) & (table->capacity - 1);
+  }
+  return -1;
+}
+
+/* -------------------------------------------------------------------------- */
+void devtable_select(devtable *table) {
+  int line;
+
+  table->nselected = 0;
+  for (line = 0; line < table->nlines; line++) {
+    if (table->lines[line].slot >= 0)
+      table->selected[table->nselected++] = line;
+  }
+}
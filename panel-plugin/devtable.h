@@ -0,0 +1,103 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef DEVTABLE_H
+#define DEVTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The key of a device. The kernel uses 12 bits for the major number and 20
+   for the minor number */
+#define DEVTABLE_KEY(major, minor)                                            \
+  ((((uint32_t)(major)&0xfff) << 20) | ((uint32_t)(minor)&0xfffff))
+
+/* A slot of the hash table. line is -1 if the slot is empty */
+typedef struct {
+  uint32_t key;
+  int line;
+} devtable_entry;
+
+/* A line of /proc/diskstats. The name is an offset into the buffer that the
+   table was built from, so it is only valid until the buffer is read again */
+typedef struct {
+  uint32_t key;
+  uint32_t name;
+  uint32_t namelen;
+  /* The index of the disk that monitors this device, or -1 */
+  int slot;
+} devtable_line;
+
+/* The devices listed in /proc/diskstats, indexed by their line and by their
+   major:minor numbers. The table is only rebuilt when the set of devices
+   changes. Between rebuilds, only the lines of the selected devices need to
+   be parsed */
+typedef struct {
+  /* Open addressing with linear probing. capacity is a power of 2 */
+  devtable_entry *entries;
+  unsigned int capacity;
+
+  devtable_line *lines;
+  int nlines;
+  int lines_capacity;
+
+  /* The lines that have a slot, in increasing order */
+  int *selected;
+  int nselected;
+} devtable;
+
+/**
+ * Initializes an empty table.
+ * @param   table       The object
+ */
+void devtable_init(devtable *table);
+
+/**
+ * Releases the memory held by the table. It is safe to call devtable_init()
+ * or devtable_build() again afterwards.
+ * @param   table       The object
+ */
+void devtable_free(devtable *table);
+
+/**
+ * Rebuilds the table from the contents of /proc/diskstats. Every line starts
+ * without a slot.
+ * @param   table       The object
+ * @param   buf         the contents of /proc/diskstats
+ * @param   len         the length of the contents
+ * @return  0 if successful, 1 if memory could not be allocated
+ */
+int devtable_build(devtable *table, const char *buf, size_t len);
+
+/**
+ * Looks up a device by its major:minor numbers.
+ * @param   table       The object
+ * @param   key         The key of the device, see DEVTABLE_KEY()
+ * @return  the line of the device, or -1 if it is not listed
+ */
+int devtable_lookup(const devtable *table, uint32_t key);
+
+/**
+ * Rebuilds the list of selected lines after slots have been assigned.
+ * @param   table       The object
+ */
+void devtable_select(devtable *table);
+
+#endif /* DEVTABLE_H */
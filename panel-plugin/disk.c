@@ -25,14 +25,60 @@
 #include <config.h>
 #endif
 
-#include <libxfce4util/libxfce4util.h>
-
 #include "disk.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef DEBUG
+#define DBG(...)                                                               \
+  (fprintf(stderr, "DBG[%s:%d] %s(): ", __FILE__, __LINE__, __func__),         \
+   fprintf(stderr, __VA_ARGS__), fputc('\n', stderr))
+#else
+#define DBG(...) ((void)0)
+#endif
+
+/* Relative to the root of procfs */
+#define PATH_DISKSTATS "diskstats"
+
+/* The mount points of sysfs and procfs. Tests and benchmarks point them to a
+   fake tree */
+static char sysfs_root[PATH_MAX] = "/sys";
+static char procfs_root[PATH_MAX] = "/proc";
+
+/* The mounts through which paths are resolved, or NULL */
+static const mount_table *disk_mounts;
+
+/* The number of sources that deliver device events, and how many events
+   arrived. They are shared by the sets of all the threads */
+static atomic_int hotplug_watched;
+static atomic_uint hotplug_events;
+
+/* The initial size of the buffer for /proc/diskstats. It grows as needed */
+#define DISKSTATS_BUFSIZE 16384
+
+/* The longest line of /proc/diskstats */
+#define DISKSTATS_LINE_MAX (STAT_BUFSIZE + DISK_NAME_LENGTH + 32)
+
+/* The characters that separate the words of a disk set specification */
+#define DISKSET_SEPARATORS " \t,"
+
+/* -------------------------------------------------------------------------- */
+uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
 /*****************************************************************************
  *
  * checkinterface()
@@ -43,12 +89,8 @@
  ****************************************************************************/
 
 int check_disk(diskdata *data) {
-  FILE *fp = NULL;
-  char buf[5];
-
 #ifdef DEBUG
-  fprintf(stderr, "Checking the disk '%s' now ...\n",
-          data->ifdata.if_name);
+  fprintf(stderr, "Checking the disk '%s' now ...\n", data->dev_name);
 #endif
 
   if(access(data->file_stats, F_OK) == 0)
@@ -56,73 +98,321 @@ int check_disk(diskdata *data) {
   return FALSE;
 }
 
+/******************************************************************************
+ *
+ * open_stat()
+ *
+ * open the stat file of the disk. The descriptor is kept in the diskdata
+ * object so that every sample only costs a single pread()
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int open_stat(diskdata *data) {
+  data->fd = open(data->file_stats, O_RDONLY | O_CLOEXEC);
+  if (data->fd < 0)
+    return 1;
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * read_stat()
+ *
+ * read the contents of the stat file into buf with a single pread(). If the
+ * read fails, the device has probably gone away. In that case, the stale
+ * descriptor is dropped and the file is reopened once, in case the device is
+ * already back. A reopened device starts over without a previous sample.
+ *
+ * returns the number of bytes read, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static ssize_t read_stat(diskdata *data, char *buf, size_t size) {
+  ssize_t len = -1;
+
+  if (data->fd >= 0)
+    len = pread(data->fd, buf, size - 1, 0);
+
+  if (len <= 0) {
+    if (data->fd >= 0) {
+      close(data->fd);
+      data->fd = -1;
+    }
+    if (open_stat(data) != 0)
+      return -1;
+    /* This may be another device under the same name */
+    data->primed = FALSE;
+    len = pread(data->fd, buf, size - 1, 0);
+    if (len <= 0) {
+      close(data->fd);
+      data->fd = -1;
+      return -1;
+    }
+  }
+  buf[len] = '\0';
+
+  return len;
+}
+
+/******************************************************************************
+ *
+ * store_bytes()
+ *
+ * update the byte counters from the raw statistics of the last sample
+ *
+ *****************************************************************************/
+
+static void store_bytes(diskdata *data) {
+  data->stats.rd_bytes = data->stats.raw.field[STAT_RD_SECTORS] * 512;
+  data->stats.wr_bytes = data->stats.raw.field[STAT_WR_SECTORS] * 512;
+}
+
 /******************************************************************************
  *
  * get_stat()
  *
- * read the network statistics from /proc/net/dev (PATH_NET_DEV)
- * if the file is not open open it. fseek() to the beginning and parse
- * each line until we've found the right interface
+ * read the disk statistics from /sys/block/<dev>/stat. The file is opened
+ * once and re-read from the start on every call. The time of the sample is
+ * taken right after the read
  *
  * returns 0 if successful, 1 in case of error
  *
  *****************************************************************************/
 
 int get_stat(diskdata *data) {
-  unsigned long dump;
-  unsigned long rd = 0, wr = 0;
+  char buf[STAT_BUFSIZE];
+  const char *p = buf;
+  ssize_t len;
+
+  if ((len = read_stat(data, buf, sizeof(buf))) < 0)
+    return 1;
+  data->stamp = now_ns();
+
+  if (parse_stat_fields(&p, buf + len, &data->stats.raw) != 0)
+    return 1;
+
+  store_bytes(data);
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_ssd(const char *device) {
+  char path[PATH_MAX];
   FILE* fp = NULL;
- 
-  if(fp = fopen(data->file_stats, "r")) {
-    fscanf(fp, "%ld %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld", &dump, &dump, &rd,
-           &dump, &dump, &dump, &wr, &dump, &dump, &dump, &dump);
+  int rotational = 1;
+
+  if (snprintf(path, PATH_MAX, "%s/block/%s/queue/rotational", sysfs_root,
+               device) >= PATH_MAX)
+    return FALSE;
+  if((fp = fopen(path, "r"))) {
+    if (fscanf(fp, "%d", &rotational) != 1)
+      rotational = 1;
     fclose(fp);
+  }
+  return !rotational;
+}
 
-    data->stats.rd_bytes = rd * 512;
-    data->stats.wr_bytes = wr * 512;
-   
-    return 0;
+/******************************************************************************
+ *
+ * set_device()
+ *
+ * set the name and the paths of the device and find out whether it is an SSD
+ *
+ * returns 0 if successful, 1 if the path of the stat file is too long
+ *
+ *****************************************************************************/
+
+static int set_device(diskdata *data, const char *device) {
+  snprintf(data->dev_name, DISK_NAME_LENGTH, "%s", device);
+  if (snprintf(data->file_stats, PATH_MAX, "%s/block/%s/stat", sysfs_root,
+               device) >= PATH_MAX)
+    return 1;
+  data->ssd = is_ssd(device);
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * save_backup()
+ *
+ * remember the last sample, against which the next one will be compared
+ *
+ *****************************************************************************/
+
+static void save_backup(diskdata *data) {
+  data->backup_in = data->stats.rd_bytes;
+  data->backup_out = data->stats.wr_bytes;
+  data->backup = data->stats.raw;
+}
+
+/******************************************************************************
+ *
+ * delta()
+ *
+ * the difference of a field between the previous and the current sample. If
+ * the counter went backwards, the device was probably reset, and 0 is
+ * returned
+ *
+ *****************************************************************************/
+
+static inline uint64_t delta(const diskdata *data, int field) {
+  uint64_t prev = data->backup.field[field];
+  uint64_t cur = data->stats.raw.field[field];
+
+  return cur >= prev ? cur - prev : 0;
+}
+
+/******************************************************************************
+ *
+ * compute_metrics()
+ *
+ * compute the metrics of the interval between the previous and the current
+ * sample from the differences d of every field. The *_TICKS fields are in
+ * milliseconds
+ *
+ *****************************************************************************/
+
+static void compute_metrics(diskdata *data, const uint64_t *d,
+                            double delta_t) {
+  double *m = data->metrics;
+  double rd_ios = d[STAT_RD_IOS];
+  double wr_ios = d[STAT_WR_IOS];
+  double sectors = (double)d[STAT_RD_SECTORS] + d[STAT_WR_SECTORS];
+
+  m[METRIC_RD_BYTES] = data->cur_in;
+  m[METRIC_WR_BYTES] = data->cur_out;
+  m[METRIC_RD_IOPS] = rd_ios / delta_t;
+  m[METRIC_WR_IOPS] = wr_ios / delta_t;
+  m[METRIC_RD_MERGES] = d[STAT_RD_MERGES] / delta_t;
+  m[METRIC_WR_MERGES] = d[STAT_WR_MERGES] / delta_t;
+  m[METRIC_RQ_SIZE] =
+      rd_ios + wr_ios > 0 ? sectors * 512 / (rd_ios + wr_ios) : 0.0;
+  m[METRIC_R_AWAIT] = rd_ios > 0 ? d[STAT_RD_TICKS] / rd_ios : 0.0;
+  m[METRIC_W_AWAIT] = wr_ios > 0 ? d[STAT_WR_TICKS] / wr_ios : 0.0;
+  m[METRIC_UTIL] = d[STAT_IO_TICKS] / (delta_t * 10.0);
+  if (m[METRIC_UTIL] > 100.0)
+    m[METRIC_UTIL] = 100.0;
+  m[METRIC_QUEUE] = d[STAT_TIME_IN_QUEUE] / (delta_t * 1000.0);
+  m[METRIC_IN_FLIGHT] = data->stats.raw.field[STAT_IN_FLIGHT];
+}
+
+/* -------------------------------------------------------------------------- */
+double get_metric(const diskdata *data, int metric) {
+  if (metric < 0 || metric >= METRIC_COUNT)
+    return 0.0;
+  return data->metrics[metric];
+}
+
+/* -------------------------------------------------------------------------- */
+void close_diskspeed(diskdata *data) {
+  if (data->fd >= 0) {
+    close(data->fd);
+    data->fd = -1;
   }
-  
-  return 1;
+}
+
+/******************************************************************************
+ *
+ * is_reset()
+ *
+ * tell whether the counters of a device went backwards between two samples.
+ * They never do while the device exists, so it was reset or replaced by
+ * another device under the same name. IN_FLIGHT is a gauge and is not checked
+ *
+ *****************************************************************************/
+
+static int is_reset(const diskstat *prev, const diskstat *cur) {
+  int f;
+
+  for (f = 0; f < STAT_NFIELDS; f++) {
+    if (f != STAT_IN_FLIGHT && cur->field[f] < prev->field[f])
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* -------------------------------------------------------------------------- */
+static void clear_rates(diskdata *data) {
+  data->cur_in = 0.0;
+  data->cur_out = 0.0;
+  data->peak_in = 0.0;
+  data->peak_out = 0.0;
+  memset(data->metrics, 0, sizeof(data->metrics));
+  data->metrics[METRIC_IN_FLIGHT] = data->stats.raw.field[STAT_IN_FLIGHT];
+}
+
+/******************************************************************************
+ *
+ * compute_diskspeed()
+ *
+ * compute the speed and the metrics of the disk from the sample that was just
+ * taken, and remember the sample for the next time. The differences are
+ * exact 64-bit integers, and only the final rates are floating point. If
+ * there is no usable previous sample, because this is the first one or the
+ * device was reset or re-attached, the sample only becomes the reference for
+ * the next one
+ *
+ *****************************************************************************/
+
+static void compute_diskspeed(diskdata *data) {
+  uint64_t d[STAT_NFIELDS];
+  double delta_t;
+  int f;
+
+  if (!data->primed || is_reset(&data->backup, &data->stats.raw)) {
+    clear_rates(data);
+    save_backup(data);
+    data->prev_stamp = data->stamp;
+    data->primed = TRUE;
+    return;
+  }
+
+  /* Two samples in the same nanosecond carry no information */
+  if (data->stamp <= data->prev_stamp)
+    return;
+  delta_t = (data->stamp - data->prev_stamp) / 1e9;
+
+  data->cur_in = (data->stats.rd_bytes - data->backup_in) / delta_t;
+  data->cur_out = (data->stats.wr_bytes - data->backup_out) / delta_t;
+  data->peak_in = data->cur_in;
+  data->peak_out = data->cur_out;
+
+  for (f = 0; f < STAT_NFIELDS; f++)
+    d[f] = delta(data, f);
+  compute_metrics(data, d, delta_t);
+
+  /* save 'new old' values */
+  save_backup(data);
+  data->prev_stamp = data->stamp;
 }
 
 /* -------------------------------------------------------------------------- */
 int init_diskspeed(diskdata *data, const char *device) {
-  const char* dir = "/sys/block";
-  char path[PATH_MAX];
-  FILE* fp = NULL;
-  int rotational = 1;
-  
+  close_diskspeed(data);
   memset(data, 0, sizeof(diskdata));
+  data->fd = -1;
+  data->node = -1;
+  data->nfs = -1;
+  data->counted = TRUE;
 
   if (device == NULL || strlen(device) == 0) {
     return TRUE;
   }
 
-  g_strlcpy(data->dev_name, device, DISK_NAME_LENGTH);
-  g_snprintf(data->file_stats, PATH_MAX,
-           "%s/%s/%s", dir, device, "stat");
-  
-  if (check_disk(data) != TRUE) {
+  if (set_device(data, device) != 0 || check_disk(data) != TRUE) {
     data->avail = FALSE;
     return FALSE;
   }
 
   /* init in a sane state */
-  get_stat(data);
-  data->backup_in = data->stats.rd_bytes;
-  data->backup_out = data->stats.wr_bytes;
+  if (get_stat(data) == 0)
+    compute_diskspeed(data);
 
   data->avail = TRUE;
 
-  g_snprintf(path, PATH_MAX, "%s/%s/queue/rotational", dir, device);
-  if((fp = fopen(path, "r"))) {
-    fscanf(fp, "%d", &rotational);
-    fclose(fp);
-  }
-  data->ssd = !rotational;
-  
   DBG("The diskspeed plugin was initialized for '%s'.", device);
 
   return TRUE;
@@ -131,35 +421,20 @@ int init_diskspeed(diskdata *data, const char *device) {
 /* -------------------------------------------------------------------------- */
 void get_current_diskspeed(diskdata *data, unsigned long *in, unsigned long *out,
                          unsigned long *tot) {
-  struct timeval curr_time;
-  double delta_t;
-
   if (!data->avail) {
+    data->primed = FALSE;
     if (in != NULL && out != NULL && tot != NULL) {
       *in = *out = *tot = 0;
     }
+    return;
   }
 
-  gettimeofday(&curr_time, NULL);
-
-  delta_t = (double)((curr_time.tv_sec - data->prev_time.tv_sec) * 1000000L +
-                     (curr_time.tv_usec - data->prev_time.tv_usec)) /
-            1000000.0;
-
   /* update */
-  get_stat(data);
-  if (data->backup_in > data->stats.rd_bytes) {
-    data->cur_in = (int)(data->stats.rd_bytes / delta_t + 0.5);
-  } else {
-    data->cur_in =
-        (int)((data->stats.rd_bytes - data->backup_in) / delta_t + 0.5);
-  }
-
-  if (data->backup_out > data->stats.wr_bytes) {
-    data->cur_out = (int)(data->stats.wr_bytes / delta_t + 0.5);
+  if (get_stat(data) != 0) {
+    data->primed = FALSE;
+    clear_rates(data);
   } else {
-    data->cur_out =
-        (int)((data->stats.wr_bytes - data->backup_out) / delta_t + 0.5);
+    compute_diskspeed(data);
   }
 
   if (in != NULL && out != NULL && tot != NULL) {
@@ -167,13 +442,841 @@ void get_current_diskspeed(diskdata *data, unsigned long *in, unsigned long *out
     *out = data->cur_out;
     *tot = *in + *out;
   }
+}
 
-  /* save 'new old' values */
-  data->backup_in = data->stats.rd_bytes;
-  data->backup_out = data->stats.wr_bytes;
+/******************************************************************************
+ *
+ * read_diskstats()
+ *
+ * read the whole of /proc/diskstats into the buffer of the set with a single
+ * pread(). The kernel only returns whole lines, so the buffer is grown until
+ * there is room for at least one more line than was returned
+ *
+ * returns the number of bytes read, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static ssize_t read_diskstats(diskset *set) {
+  ssize_t len;
+  char *buf;
+
+  for (;;) {
+    len = pread(set->fd, set->buf, set->bufsize, 0);
+    if (len < 0)
+      return -1;
+    if ((size_t)len + DISKSTATS_LINE_MAX < set->bufsize)
+      return len;
+
+    if ((buf = realloc(set->buf, set->bufsize * 2)) == NULL)
+      return -1;
+    set->buf = buf;
+    set->bufsize *= 2;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_pattern(const char *word) {
+  return strpbrk(word, "*?[") != NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_stack(const char *word) { return word[0] == '+'; }
+
+/* -------------------------------------------------------------------------- */
+static diskdata *find_disk(diskset *set, const char *name, size_t len) {
+  int i;
+
+  for (i = 0; i < set->ndisks; i++) {
+    if (strncmp(set->disks[i].dev_name, name, len) == 0 &&
+        set->disks[i].dev_name[len] == '\0')
+      return &set->disks[i];
+  }
+  return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+static diskdata *append_disk(diskset *set, const char *name) {
+  diskdata *disks;
+  diskdata *data;
+
+  disks = realloc(set->disks, (set->ndisks + 1) * sizeof(diskdata));
+  if (disks == NULL)
+    return NULL;
+  set->disks = disks;
+
+  data = &set->disks[set->ndisks++];
+  memset(data, 0, sizeof(diskdata));
+  data->fd = -1;
+  data->line = -1;
+  data->node = -1;
+  data->nfs = -1;
+  data->counted = TRUE;
+  if (set_device(data, name) != 0) {
+    set->ndisks--;
+    return NULL;
+  }
+
+  return data;
+}
+
+/* -------------------------------------------------------------------------- */
+static diskdata *add_disk(diskset *set, const char *name) {
+  diskdata *data;
+
+  if ((data = find_disk(set, name, strlen(name))) != NULL)
+    return data;
+  return append_disk(set, name);
+}
+
+/******************************************************************************
+ *
+ * add_nfs()
+ *
+ * add the NFS mount that holds a path as a disk named after its mount point.
+ * Paths on the same mount share the disk
+ *
+ * returns the disk, or NULL if the path is not on NFS or in case of error
+ *
+ *****************************************************************************/
+
+static diskdata *add_nfs(diskset *set, const char *path) {
+  char point[PATH_MAX];
+  diskdata *data;
+  int slot;
+
+  if (nfs_find(disk_mounts, path, point, sizeof(point)) != 0)
+    return NULL;
+  if ((data = find_disk(set, point, strlen(point))) != NULL)
+    return data;
+
+  if ((slot = nfs_add(&set->nfs, procfs_root, point)) < 0 ||
+      (data = append_disk(set, point)) == NULL)
+    return NULL;
+  data->nfs = slot;
+  data->ssd = FALSE;
+
+  return data;
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_line_of(const diskset *set, int line, const char *name) {
+  const devtable_line *l = &set->table.lines[line];
+
+  return l->namelen > 0 && strncmp(set->buf + l->name, name, l->namelen) == 0 &&
+         name[l->namelen] == '\0';
+}
+
+/* -------------------------------------------------------------------------- */
+static void bind_disk(diskset *set, int slot, int line) {
+  set->table.lines[line].slot = slot;
+  set->disks[slot].line = line;
+  set->disks[slot].key = set->table.lines[line].key;
+}
+
+/******************************************************************************
+ *
+ * expand_stacks()
+ *
+ * add the devices at the bottom of the devices whose name is prefixed with +
+ *
+ *****************************************************************************/
+
+static void expand_stacks(diskset *set) {
+  const topology *topo = &set->topo;
+  const topology_node *node;
+  int i, l, n;
+
+  for (i = 0; i < set->nwords; i++) {
+    if (!is_stack(set->words[i]) ||
+        (n = topology_find(topo, set->words[i] + 1)) < 0)
+      continue;
+    node = &topo->nodes[n];
+    for (l = 0; l < node->nleaves; l++) {
+      if (node->leaves[l] != n)
+        add_disk(set, topo->nodes[node->leaves[l]].name);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * is_covered_below()
+ *
+ * whether all the lower devices of a node are disks of the set, or are
+ * covered by disks of the set themselves. memo holds the answer for the nodes
+ * that were already visited, as 1 + the answer
+ *
+ *****************************************************************************/
+
+static int is_covered_below(const topology *topo, int n, char *memo) {
+  const topology_node *node = &topo->nodes[n];
+  const topology_node *lower;
+  int i, covered;
+
+  if (memo[n] != 0)
+    return memo[n] - 1;
+  /* A cycle, which sysfs should never have, is not covered */
+  memo[n] = 1;
+
+  covered = node->nlower > 0;
+  for (i = 0; covered && i < node->nlower; i++) {
+    lower = &topo->nodes[node->lower[i]];
+    covered = lower->slot >= 0 || is_covered_below(topo, node->lower[i], memo);
+  }
+  memo[n] = 1 + covered;
 
-  /* do the same with time */
-  data->prev_time.tv_sec = curr_time.tv_sec;
-  data->prev_time.tv_usec = curr_time.tv_usec;
+  return covered;
 }
 
+/******************************************************************************
+ *
+ * relate_disks()
+ *
+ * find the disks of the set in the topology, and leave out of the totals the
+ * disks whose traffic is already counted in the devices they are built on
+ *
+ *****************************************************************************/
+
+static void relate_disks(diskset *set) {
+  topology *topo = &set->topo;
+  diskdata *data;
+  char *memo;
+  int i, n;
+
+  for (n = 0; n < topo->nnodes; n++)
+    topo->nodes[n].slot = -1;
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    data->counted = TRUE;
+    if ((data->node = topology_find(topo, data->dev_name)) >= 0)
+      topo->nodes[data->node].slot = i;
+  }
+
+  if ((memo = calloc(topo->nnodes + 1, 1)) == NULL)
+    return;
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    if (data->node >= 0 && is_covered_below(topo, data->node, memo))
+      data->counted = FALSE;
+  }
+  free(memo);
+}
+
+/******************************************************************************
+ *
+ * rebuild_diskset()
+ *
+ * rebuild the device table from the contents of /proc/diskstats that are in
+ * the buffer of the set, and map its lines to the disks. Disks that are still
+ * there keep their slot. Devices that match a pattern and are not monitored
+ * yet get a new slot
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int rebuild_diskset(diskset *set, size_t len) {
+  devtable *table = &set->table;
+  char name[DISK_NAME_LENGTH];
+  diskdata *data;
+  int i, line;
+
+  if (devtable_build(table, set->buf, len) != 0)
+    return 1;
+
+  /* The devices changed, and so may have their stacking. Without sysfs, no
+     device is stacked */
+  topology_build(&set->topo, sysfs_root);
+  expand_stacks(set);
+
+  /* The disks that are still listed under the same major:minor */
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    line = data->line >= 0 ? devtable_lookup(table, data->key) : -1;
+    if (line >= 0 && is_line_of(set, line, data->dev_name))
+      bind_disk(set, i, line);
+    else
+      data->line = -1;
+  }
+
+  /* The disks that are new, or came back under another major:minor */
+  for (i = 0; i < set->ndisks; i++) {
+    if (set->disks[i].line >= 0 || set->disks[i].nfs >= 0)
+      continue;
+    set->disks[i].primed = FALSE;
+    for (line = 0; line < table->nlines; line++) {
+      if (table->lines[line].slot < 0 &&
+          is_line_of(set, line, set->disks[i].dev_name)) {
+        bind_disk(set, i, line);
+        break;
+      }
+    }
+  }
+
+  /* The devices that match a pattern */
+  for (i = 0; i < set->nwords; i++) {
+    if (!is_pattern(set->words[i]))
+      continue;
+    for (line = 0; line < table->nlines; line++) {
+      if (table->lines[line].slot >= 0 || table->lines[line].namelen == 0 ||
+          table->lines[line].namelen >= DISK_NAME_LENGTH)
+        continue;
+
+      memcpy(name, set->buf + table->lines[line].name,
+             table->lines[line].namelen);
+      name[table->lines[line].namelen] = '\0';
+      if (fnmatch(set->words[i], name, 0) == 0 &&
+          append_disk(set, name) != NULL)
+        bind_disk(set, set->ndisks - 1, line);
+    }
+  }
+
+  devtable_select(table);
+  relate_disks(set);
+
+  if (counter_store_resize(&set->counters, set->ndisks) != 0) {
+    /* Forget the table, so that no line is stored in a missing row */
+    table->nlines = 0;
+    table->nselected = 0;
+    return 1;
+  }
+  set->generation++;
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * parse_selected()
+ *
+ * parse the lines of the disks of the set, skipping all the others. The
+ * major:minor numbers of each line and the number of lines must be the same
+ * as when the device table was built. Disks whose counters went backwards
+ * lose their previous sample
+ *
+ * returns 0 if successful, 1 if the list of devices changed
+ *
+ *****************************************************************************/
+
+static int parse_selected(diskset *set, size_t len) {
+  const devtable *table = &set->table;
+  const char *p = set->buf, *end = set->buf + len, *name;
+  unsigned int major, minor;
+  diskdata *data;
+  size_t namelen;
+  diskstat st;
+  int line = 0, j = 0;
+
+  while (p < end) {
+    if (j < table->nselected && line == table->selected[j]) {
+      data = &set->disks[table->lines[line].slot];
+      if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen,
+                               &st) != 0 ||
+          DEVTABLE_KEY(major, minor) != data->key)
+        return 1;
+
+      if (data->primed && is_reset(&data->stats.raw, &st))
+        data->primed = FALSE;
+      data->stats.raw = st;
+      store_bytes(data);
+      counter_store_set(&set->counters, table->lines[line].slot, &st);
+      data->avail = TRUE;
+      j++;
+    } else {
+      p = next_line(p, end);
+    }
+    line++;
+  }
+
+  return line != table->nlines || j != table->nselected;
+}
+
+/******************************************************************************
+ *
+ * sample_nfs()
+ *
+ * read the counters of the NFS mounts of the set, which are stored like those
+ * of the lines of /proc/diskstats
+ *
+ *****************************************************************************/
+
+static void sample_nfs(diskset *set) {
+  const nfs_mount *mount;
+  diskdata *data;
+  int i;
+
+  if (set->nfs.nmounts == 0 || nfs_read(&set->nfs) != 0)
+    return;
+
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    if (data->nfs < 0 || !set->nfs.mounts[data->nfs].found)
+      continue;
+
+    mount = &set->nfs.mounts[data->nfs];
+    if (data->primed && is_reset(&data->stats.raw, &mount->stat))
+      data->primed = FALSE;
+    data->stats.raw = mount->stat;
+    store_bytes(data);
+    counter_store_set(&set->counters, i, &mount->stat);
+    data->avail = TRUE;
+  }
+}
+
+/******************************************************************************
+ *
+ * sample_diskset()
+ *
+ * read /proc/diskstats once and store the statistics of every disk of the
+ * set. Disks that are not listed are marked as unavailable. The device table
+ * is only rebuilt if the list of devices changed since the last time, or if
+ * a device event may have changed their stacking
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int sample_diskset(diskset *set, int changed) {
+  ssize_t len;
+  int i;
+
+  for (i = 0; i < set->ndisks; i++)
+    set->disks[i].avail = FALSE;
+
+  if ((len = read_diskstats(set)) < 0)
+    return 1;
+  set->stamp = now_ns();
+
+  if (changed || set->table.nlines == 0 || parse_selected(set, len) != 0) {
+    for (i = 0; i < set->ndisks; i++)
+      set->disks[i].avail = FALSE;
+    if (rebuild_diskset(set, len) != 0)
+      return 1;
+    parse_selected(set, len);
+  }
+  sample_nfs(set);
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * prime_diskset()
+ *
+ * make the last sample of the disks that were not sampled before, were
+ * missing, or were reset, the reference for the next one. Their first
+ * interval is unknown, so they report no activity for it rather than their
+ * whole counters
+ *
+ *****************************************************************************/
+
+static void prime_diskset(diskset *set) {
+  diskdata *data;
+  int i;
+
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    if (!data->avail) {
+      data->primed = FALSE;
+    } else if (!data->primed) {
+      counter_store_prime(&set->counters, i);
+      clear_rates(data);
+      data->primed = TRUE;
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * compute_disk_slot()
+ *
+ * compute the speed and the metrics of a disk of the set from its row of the
+ * counter store
+ *
+ *****************************************************************************/
+
+static void compute_disk_slot(diskset *set, int slot, double delta_t) {
+  const counter_store *counters = &set->counters;
+  diskdata *data = &set->disks[slot];
+  uint64_t d[STAT_NFIELDS];
+  int f;
+
+  for (f = 0; f < STAT_NFIELDS; f++)
+    d[f] = counters->delta[f][slot];
+
+  data->cur_in = counters->rate[STAT_RD_SECTORS][slot] * 512;
+  data->cur_out = counters->rate[STAT_WR_SECTORS][slot] * 512;
+  data->peak_in = data->cur_in;
+  data->peak_out = data->cur_out;
+  compute_metrics(data, d, delta_t);
+  data->prev_stamp = set->prev_stamp;
+  data->stamp = set->stamp;
+}
+
+/******************************************************************************
+ *
+ * compute_diskset()
+ *
+ * compute the speed and the metrics of every disk of the set from the
+ * counters of the last sample, which are in the counter store
+ *
+ *****************************************************************************/
+
+static void compute_diskset(diskset *set) {
+  double delta_t;
+  int i;
+
+  prime_diskset(set);
+
+  if (set->stamp <= set->prev_stamp)
+    return;
+  delta_t = (set->stamp - set->prev_stamp) / 1e9;
+
+  /* One pass over all the counters of all the disks */
+  counter_store_update(&set->counters, 1.0 / delta_t);
+
+  for (i = 0; i < set->ndisks; i++) {
+    if (set->disks[i].avail)
+      compute_disk_slot(set, i, delta_t);
+  }
+  set->prev_stamp = set->stamp;
+}
+
+/* -------------------------------------------------------------------------- */
+int init_diskset(diskset *set, const char *spec) {
+  char path[PATH_MAX];
+  char *word, *saveptr;
+  int avail = FALSE;
+  int i;
+
+  close_diskset(set);
+  memset(set, 0, sizeof(diskset));
+  set->fd = -1;
+  nfs_init(&set->nfs);
+  set->generation = 1;
+  set->events = atomic_load(&hotplug_events);
+
+  if (spec == NULL)
+    return TRUE;
+
+  set->spec = resolve_disk_spec(spec);
+  set->words = malloc((strlen(spec) / 2 + 1) * sizeof(char *));
+  if (set->spec == NULL || set->words == NULL)
+    return FALSE;
+
+  for (word = strtok_r(set->spec, DISKSET_SEPARATORS, &saveptr); word;
+       word = strtok_r(NULL, DISKSET_SEPARATORS, &saveptr))
+    set->words[set->nwords++] = word;
+
+  if (set->nwords == 0)
+    return TRUE;
+
+  /* A single device is cheaper to read from its own stat file */
+  if (set->nwords == 1 && !is_pattern(set->words[0]) &&
+      !is_stack(set->words[0]) && set->words[0][0] != '/') {
+    if ((set->disks = malloc(sizeof(diskdata))) == NULL)
+      return FALSE;
+    set->disks[0].fd = -1;
+    set->ndisks = 1;
+    return init_diskspeed(&set->disks[0], set->words[0]);
+  }
+
+  if (snprintf(path, PATH_MAX, "%s/%s", procfs_root, PATH_DISKSTATS) >=
+      PATH_MAX)
+    return FALSE;
+  set->fd = open(path, O_RDONLY | O_CLOEXEC);
+  set->bufsize = DISKSTATS_BUFSIZE;
+  set->buf = malloc(set->bufsize);
+  if (set->fd < 0 || set->buf == NULL)
+    return FALSE;
+
+  /* The patterns and stacks are resolved when the device table is built.
+     A path that is left is either on NFS or under no device at all */
+  for (i = 0; i < set->nwords; i++) {
+    if (set->words[i][is_stack(set->words[i])] == '/' &&
+        add_nfs(set, set->words[i] + is_stack(set->words[i])) != NULL)
+      continue;
+    if (is_stack(set->words[i]) && set->words[i][1] != '\0')
+      add_disk(set, set->words[i] + 1);
+    else if (!is_pattern(set->words[i]) && !is_stack(set->words[i]))
+      add_disk(set, set->words[i]);
+  }
+
+  /* init in a sane state */
+  if (sample_diskset(set, FALSE) != 0)
+    return FALSE;
+  prime_diskset(set);
+  set->prev_stamp = set->stamp;
+  for (i = 0; i < set->ndisks; i++)
+    avail |= set->disks[i].avail;
+
+  DBG("The diskspeed plugin was initialized for %d disks matching '%s'.",
+      set->ndisks, spec);
+
+  return avail;
+}
+
+/* -------------------------------------------------------------------------- */
+char *resolve_disk_spec(const char *spec) {
+  char name[DISK_NAME_LENGTH];
+  char *copy, *word, *saveptr, *resolved;
+  size_t len = 0;
+  int stack;
+
+  /* Each word grows by at most the length of a device name */
+  if ((copy = strdup(spec)) == NULL ||
+      (resolved = malloc(strlen(spec) + 1 +
+                         (strlen(spec) / 2 + 1) * DISK_NAME_LENGTH)) ==
+          NULL) {
+    free(copy);
+    return NULL;
+  }
+  *resolved = '\0';
+
+  for (word = strtok_r(copy, DISKSET_SEPARATORS, &saveptr); word;
+       word = strtok_r(NULL, DISKSET_SEPARATORS, &saveptr)) {
+    stack = is_stack(word);
+    if (word[stack] == '/' &&
+        mounts_resolve(disk_mounts, sysfs_root, word + stack, name,
+                       sizeof(name)) == 0)
+      len += sprintf(resolved + len, "%s%s%s", len > 0 ? " " : "",
+                     stack ? "+" : "", name);
+    else
+      len += sprintf(resolved + len, "%s%s", len > 0 ? " " : "", word);
+  }
+  free(copy);
+
+  return resolved;
+}
+
+/* -------------------------------------------------------------------------- */
+void close_diskset(diskset *set) {
+  int i;
+
+  for (i = 0; i < set->ndisks; i++)
+    close_diskspeed(&set->disks[i]);
+  free(set->disks);
+  set->disks = NULL;
+  set->ndisks = 0;
+
+  free(set->words);
+  free(set->spec);
+  set->words = NULL;
+  set->spec = NULL;
+  set->nwords = 0;
+
+  if (set->fd >= 0) {
+    close(set->fd);
+    set->fd = -1;
+  }
+  free(set->buf);
+  set->buf = NULL;
+  set->bufsize = 0;
+
+  devtable_free(&set->table);
+  topology_free(&set->topo);
+  counter_store_free(&set->counters);
+  nfs_close(&set->nfs);
+}
+
+/******************************************************************************
+ *
+ * update_single()
+ *
+ * update the lone disk of a set that is read from /sys/block. Without device
+ * events, whether the disk exists is checked on every update. With them, a
+ * disk that went missing is only looked for again after an event, and a
+ * present one is known to be gone when its stat file can no longer be read
+ *
+ *****************************************************************************/
+
+static void update_single(diskset *set, int changed) {
+  diskdata *data = &set->disks[0];
+
+  if (!atomic_load_explicit(&hotplug_watched, memory_order_relaxed)) {
+    data->avail = check_disk(data);
+  } else if (!data->avail) {
+    if (!changed)
+      return;
+    /* This may be another device under the same name */
+    data->avail = TRUE;
+    data->ssd = is_ssd(data->dev_name);
+  }
+
+  get_current_diskspeed(data, NULL, NULL, NULL);
+  /* The stat file could neither be read nor reopened */
+  if (data->fd < 0)
+    data->avail = FALSE;
+}
+
+/* -------------------------------------------------------------------------- */
+void update_diskset(diskset *set) {
+  unsigned int events;
+  int changed;
+
+  events = atomic_load_explicit(&hotplug_events, memory_order_relaxed);
+  changed = events != set->events;
+  set->events = events;
+
+  if (set->fd < 0) {
+    if (set->ndisks == 1)
+      update_single(set, changed);
+    return;
+  }
+
+  if (sample_diskset(set, changed) != 0)
+    return;
+  compute_diskset(set);
+}
+
+/* -------------------------------------------------------------------------- */
+int feed_diskset(diskset *set, uint64_t stamp, const diskstat *st,
+                 const int *avail) {
+  diskdata *data;
+  int i;
+
+  if (set->counters.size != set->ndisks &&
+      counter_store_resize(&set->counters, set->ndisks) != 0)
+    return 1;
+
+  for (i = 0; i < set->ndisks; i++) {
+    data = &set->disks[i];
+    data->avail = avail[i];
+    if (!avail[i])
+      continue;
+
+    if (data->primed && is_reset(&data->stats.raw, &st[i]))
+      data->primed = FALSE;
+    data->stats.raw = st[i];
+    store_bytes(data);
+    counter_store_set(&set->counters, i, &st[i]);
+  }
+  set->stamp = stamp;
+
+  compute_diskset(set);
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int assign_diskset(diskset *set, int ndisks,
+                   const char (*names)[DISK_NAME_LENGTH], const int *ssd,
+                   const int *counted) {
+  diskdata *disks;
+  int i;
+
+  if (ndisks > set->ndisks) {
+    if ((disks = realloc(set->disks, ndisks * sizeof(diskdata))) == NULL)
+      return 1;
+    set->disks = disks;
+  }
+
+  for (i = 0; i < ndisks; i++) {
+    if (i < set->ndisks && strcmp(set->disks[i].dev_name, names[i]) == 0)
+      continue;
+    memset(&set->disks[i], 0, sizeof(diskdata));
+    set->disks[i].fd = -1;
+    set->disks[i].line = -1;
+    set->disks[i].nfs = -1;
+    snprintf(set->disks[i].dev_name, DISK_NAME_LENGTH, "%s", names[i]);
+    set->disks[i].ssd = ssd[i];
+  }
+  set->ndisks = ndisks;
+  set->generation++;
+
+  if (counted == NULL) {
+    topology_build(&set->topo, sysfs_root);
+    relate_disks(set);
+    return 0;
+  }
+
+  /* The devices may be those of another machine, whose stacking is not that
+     of this one */
+  topology_free(&set->topo);
+  for (i = 0; i < ndisks; i++) {
+    set->disks[i].node = -1;
+    set->disks[i].counted = counted[i];
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void get_diskset_speed(const diskset *set, unsigned long *in,
+                       unsigned long *out, unsigned long *tot) {
+  int i;
+
+  *in = *out = 0;
+  for (i = 0; i < set->ndisks; i++) {
+    if (set->disks[i].avail && set->disks[i].counted) {
+      *in += set->disks[i].cur_in;
+      *out += set->disks[i].cur_out;
+    }
+  }
+  *tot = *in + *out;
+}
+
+/* -------------------------------------------------------------------------- */
+int get_stack_speed(const diskset *set, int slot, double *in, double *out) {
+  const topology_node *node;
+  const diskdata *leaf;
+  int l, n, found = 0;
+
+  *in = *out = 0;
+  if (set->disks[slot].node < 0)
+    return 0;
+
+  node = &set->topo.nodes[set->disks[slot].node];
+  if (node->nleaves == 1 && node->leaves[0] == set->disks[slot].node)
+    return 0;
+  for (l = 0; l < node->nleaves; l++) {
+    if ((n = set->topo.nodes[node->leaves[l]].slot) < 0)
+      continue;
+    leaf = &set->disks[n];
+    if (leaf->avail) {
+      *in += leaf->cur_in;
+      *out += leaf->cur_out;
+      found++;
+    }
+  }
+
+  return found;
+}
+
+/* -------------------------------------------------------------------------- */
+int get_nfs_rtt(const diskset *set, int slot, double *rd, double *wr) {
+  const diskdata *data = &set->disks[slot];
+  const nfs_mount *mount;
+
+  if (data->nfs < 0 || data->nfs >= set->nfs.nmounts || !data->avail)
+    return 1;
+
+  mount = &set->nfs.mounts[data->nfs];
+  *rd = mount->rtt[NFS_READ];
+  *wr = mount->rtt[NFS_WRITE];
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void set_disk_hotplug(int watched) {
+  atomic_fetch_add(&hotplug_watched, watched ? 1 : -1);
+}
+
+/* -------------------------------------------------------------------------- */
+void notify_disk_event(void) { atomic_fetch_add(&hotplug_events, 1); }
+
+/* -------------------------------------------------------------------------- */
+void set_disk_mounts(const mount_table *mt) { disk_mounts = mt; }
+
+/* -------------------------------------------------------------------------- */
+void set_disk_roots(const char *sysfs, const char *procfs) {
+  if (sysfs != NULL)
+    snprintf(sysfs_root, PATH_MAX, "%s", sysfs);
+  if (procfs != NULL)
+    snprintf(procfs_root, PATH_MAX, "%s", procfs);
+}
+
+/* -------------------------------------------------------------------------- */
+const char *get_sysfs_root(void) { return sysfs_root; }
+
+/* -------------------------------------------------------------------------- */
+const char *get_procfs_root(void) { return procfs_root; }
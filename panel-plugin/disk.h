@@ -31,29 +31,118 @@
 #endif
 
 #include <linux/limits.h>
-#include <sys/time.h>
+#include <stdint.h>
+
+#include "counters.h"
+#include "devtable.h"
+#include "diskstats.h"
+#include "mounts.h"
+#include "nfs.h"
+#include "topology.h"
 
 #define DISK_NAME_LENGTH 33
 
+/* Large enough for the 17 fields of /sys/block/<dev>/stat on current kernels */
+#define STAT_BUFSIZE 512
+
 /* This structure stays the INFO variables */
 typedef struct DataStats {
-    double rd_bytes;
-    double wr_bytes;
+    uint64_t rd_bytes;
+    uint64_t wr_bytes;
+    /* All the fields of the last sample */
+    diskstat raw;
 } DataStats;
 
+/* The metrics computed for each interval, in addition to the rates returned
+   by get_current_diskspeed(). The names follow iostat -x */
+enum {
+  METRIC_RD_BYTES,  /* bytes read/s */
+  METRIC_WR_BYTES,  /* bytes written/s */
+  METRIC_RD_IOPS,   /* r/s */
+  METRIC_WR_IOPS,   /* w/s */
+  METRIC_RD_MERGES, /* rrqm/s */
+  METRIC_WR_MERGES, /* wrqm/s */
+  METRIC_RQ_SIZE,   /* average request size in bytes */
+  METRIC_R_AWAIT,   /* average read latency in ms */
+  METRIC_W_AWAIT,   /* average write latency in ms */
+  METRIC_UTIL,      /* %util */
+  METRIC_QUEUE,     /* aqu-sz */
+  METRIC_IN_FLIGHT, /* requests in flight at the end of the interval */
+  METRIC_COUNT
+};
+
 typedef struct {
-  double backup_in;
-  double backup_out;
+  uint64_t backup_in;
+  uint64_t backup_out;
   double cur_in;
   double cur_out;
+  /* The highest speed within the last interval. The same as cur_in and
+     cur_out unless the disk is sampled faster than it is displayed */
+  double peak_in;
+  double peak_out;
   int avail;
   int ssd;
-  struct timeval prev_time;
+  /* CLOCK_MONOTONIC time of the last and the previous sample, in ns */
+  uint64_t stamp;
+  uint64_t prev_stamp;
+  /* Descriptor of file_stats, kept open between samples. -1 if closed */
+  int fd;
   DataStats stats;
+  /* The raw statistics of the previous sample */
+  diskstat backup;
+  double metrics[METRIC_COUNT];
+  /* The major:minor key of the device and its line in /proc/diskstats, when
+     it is part of a diskset. line is -1 if the device is not listed */
+  uint32_t key;
+  int line;
+  /* FALSE until there is a sample that the next one can be compared with.
+     Cleared when the device was reset or re-attached */
+  int primed;
+  /* The node of the device in the topology of its set, or -1, and whether
+     it counts towards the speed of the set. A device whose lower devices
+     are all in the set does not, as its traffic is already theirs */
+  int node;
+  int counted;
+  /* The index of the mount in the NFS source of the set if the disk is an
+     NFS mount rather than a block device, -1 otherwise */
+  int nfs;
   char dev_name[DISK_NAME_LENGTH];
   char file_stats[PATH_MAX];
 } diskdata;
 
+/* A set of disks that are sampled together. If the set is a single device
+   name, the device is read from /sys/block like a lone diskdata. Otherwise,
+   every device is updated from one read of /proc/diskstats */
+typedef struct {
+  diskdata *disks;
+  int ndisks;
+  /* The device names and glob patterns that select the disks, with the
+     paths resolved */
+  char *spec;
+  char **words;
+  int nwords;
+  /* Descriptor of /proc/diskstats, -1 when reading from /sys/block */
+  int fd;
+  char *buf;
+  size_t bufsize;
+  /* The lines of /proc/diskstats and the disks that they map to. It is
+     rebuilt when the list of devices changes */
+  devtable table;
+  /* The counters of the disks, row i holding disks[i] */
+  counter_store counters;
+  /* The stacking of the block devices. It is rebuilt along with the table */
+  topology topo;
+  /* CLOCK_MONOTONIC time of the last and the previous read, in ns */
+  uint64_t stamp;
+  uint64_t prev_stamp;
+  /* Changes whenever the list of disks may have changed */
+  unsigned int generation;
+  /* The number of device events at the last update */
+  unsigned int events;
+  /* The NFS mounts of the set, read from /proc/self/mountstats */
+  nfs_source nfs;
+} diskset;
+
 /**
  * Initializes the diskspeed plugin. Used to set up inital values.
  * This function must be called after each change of the network interface.
@@ -64,6 +153,14 @@ typedef struct {
  */
 int init_diskspeed(diskdata *data, const char *device);
 
+/**
+ * Releases the resources held by the plugin. The descriptor of the stat file
+ * is kept open between samples, so this must be called before the data is
+ * thrown away. It is safe to call init_diskspeed() again afterwards.
+ * @param   data        The object. Its <code>fd</code> must be valid or -1.
+ */
+void close_diskspeed(diskdata *data);
+
 /**
  * Gets the current diskspeed. You must call init_diskspeed() once before you use
  * this function!
@@ -74,6 +171,133 @@ int init_diskspeed(diskdata *data, const char *device);
 void get_current_diskspeed(diskdata *data, unsigned long *in,
                            unsigned long *out, unsigned long *tot);
 
+/**
+ * Returns one of the metrics computed by the last call to
+ * get_current_diskspeed().
+ * @param   data        The object
+ * @param   metric      One of the METRIC_* constants
+ * @return  the value of the metric
+ */
+double get_metric(const diskdata *data, int metric);
+
+/**
+ * Initializes a set of disks. The specification is a list of device names
+ * and glob patterns separated by blanks or commas, e.g.
+ * <code>"nvme*n1 sd[a-d]"</code>. Patterns are matched against the devices
+ * present in /proc/diskstats, again whenever the list of devices changes.
+ * A name prefixed with + also selects the devices at the bottom of the
+ * device, e.g. <code>"+md0"</code> selects md0 and its members, see
+ * get_stack_speed(). An absolute path stands for the block device under
+ * it, see resolve_disk_spec(), e.g. <code>"+/var/lib/postgresql"</code>.
+ * A path on NFS stands for its mount, which is read from
+ * /proc/self/mountstats as if it were a disk without merges or %util.
+ * Names are kept even if the device does not exist yet. Like
+ * init_diskspeed(), this must be called again after the specification
+ * changes, and after the mounts changed if it has paths.
+ * @param   set         The object. It must be zeroed with its fd set to -1,
+ *                      or have been initialized before
+ * @param   spec        The device specification
+ * @return  <code>true</code> if at least one disk is available,
+ * <code>false</code> otherwise
+ */
+int init_diskset(diskset *set, const char *spec);
+
+/**
+ * Replaces the absolute paths of a device specification with the names of
+ * the block devices under them, from the device of their filesystem or the
+ * source of its mount. A path under which there is no block device is kept.
+ * @param   spec        The device specification
+ * @return  the new specification, to be released with free(), or NULL in
+ *          case of error
+ */
+char *resolve_disk_spec(const char *spec);
+
+/**
+ * Releases the resources held by the set. It is safe to call init_diskset()
+ * again afterwards.
+ * @param   set         The object
+ */
+void close_diskset(diskset *set);
+
+/**
+ * Samples every disk of the set and computes its current speed and metrics,
+ * as get_current_diskspeed() does for a single disk. The avail field of each
+ * disk tells whether it could be read.
+ * @param   set         The object
+ */
+void update_diskset(diskset *set);
+
+/**
+ * Replaces the disks of a set with disks of the given names, for a set that
+ * is filled by another sampler rather than by update_diskset(). Disks that
+ * keep their name and position keep their data.
+ * @param   set         The object. It must not be open
+ * @param   ndisks      The number of disks
+ * @param   names       The names of the disks
+ * @param   ssd         Whether each disk is an SSD
+ * @param   counted     Whether each disk counts towards the speed of the
+ *                      set, e.g. as recorded in a trace, or NULL to find out
+ *                      from the stacking of the devices in sysfs. The set
+ *                      then knows nothing of the stacking otherwise, see
+ *                      get_stack_speed()
+ * @return  0 if successful, 1 if memory could not be allocated
+ */
+int assign_diskset(diskset *set, int ndisks,
+                   const char (*names)[DISK_NAME_LENGTH], const int *ssd,
+                   const int *counted);
+
+/**
+ * Computes the speed and metrics of the disks of a set from a sample that was
+ * not read by the set, e.g. one replayed from a trace, as update_diskset()
+ * does for the samples that it reads. The disks are those given to
+ * assign_diskset().
+ * @param   set         The object. It must not be open
+ * @param   stamp       The CLOCK_MONOTONIC time of the sample in ns
+ * @param   st          The statistics of each disk
+ * @param   avail       Whether each disk was present
+ * @return  0 if successful, 1 if memory could not be allocated
+ */
+int feed_diskset(diskset *set, uint64_t stamp, const diskstat *st,
+                 const int *avail);
+
+/**
+ * Gets the combined speed of the available disks of the set, as computed by
+ * the last call to update_diskset(). Devices that are stacked on other
+ * devices of the set are left out, so that no traffic is counted twice.
+ * @param in        Input load in byte/s.
+ * @param out       Output load in byte/s.
+ * @param tot       Total load in byte/s.
+ */
+void get_diskset_speed(const diskset *set, unsigned long *in,
+                       unsigned long *out, unsigned long *tot);
+
+/**
+ * Gets the combined speed of the devices at the bottom of a disk of the set,
+ * e.g. the members of an MD array under a dm-crypt device, as far as they are
+ * part of the set. Partitions count as the bottom. Comparing it to the speed
+ * of the disk itself gives the amplification of the layers in between.
+ * @param   set         The object
+ * @param   slot        The index of the disk
+ * @param   in          Input load of the devices at the bottom in byte/s
+ * @param   out         Output load of the devices at the bottom in byte/s
+ * @return  the number of devices at the bottom that were available, 0 if the
+ * disk is not stacked on other devices
+ */
+int get_stack_speed(const diskset *set, int slot, double *in, double *out);
+
+/**
+ * Gets the average round trip time of the READ and WRITE operations of an NFS
+ * mount of the set over the last interval, as computed by the last call to
+ * update_diskset(). It is the time spent on the network and the server, while
+ * r_await and w_await also count the time spent queued in the client.
+ * @param   set         The object
+ * @param   slot        The index of the disk
+ * @param   rd          Receives the round trip time of READ in ms
+ * @param   wr          Receives the round trip time of WRITE in ms
+ * @return  0 if successful, 1 if the disk is not an available NFS mount
+ */
+int get_nfs_rtt(const diskset *set, int slot, double *rd, double *wr);
+
 /* 
  * Checks if the interface is exists and is up
  *
@@ -83,4 +307,57 @@ void get_current_diskspeed(diskdata *data, unsigned long *in,
  */
 int check_disk(diskdata*);
 
+/**
+ * Tells whether device events are delivered through notify_disk_event(). If
+ * they are, a single disk that is missing is no longer looked for on every
+ * update_diskset(), but only after an event. The setting applies to all sets,
+ * and each call with TRUE must be undone by one with FALSE.
+ * @param   watched     TRUE when a source of events starts delivering them,
+ *                      FALSE when it stops
+ */
+void set_disk_hotplug(int watched);
+
+/**
+ * Tells all sets that block devices appeared, disappeared or changed. Their
+ * next update_diskset() looks for their missing disks and rebuilds their
+ * device tables. It may be called from any thread.
+ */
+void notify_disk_event(void);
+
+/**
+ * Sets the table of the mounts through which resolve_disk_spec() finds the
+ * device of a filesystem that has none of its own, e.g. btrfs. The table
+ * must outlive its use, and is not modified.
+ * @param   mt          The table, or NULL to use none
+ */
+void set_disk_mounts(const mount_table *mt);
+
+/**
+ * Sets the directories in which sysfs and procfs are looked up instead of
+ * /sys and /proc, e.g. to read a fake tree. Only disks and sets initialized
+ * afterwards are affected.
+ * @param   sysfs       The root of sysfs, or NULL to keep it
+ * @param   procfs      The root of procfs, or NULL to keep it
+ */
+void set_disk_roots(const char *sysfs, const char *procfs);
+
+/**
+ * Returns the directory in which sysfs is looked up.
+ * @return  /sys, unless set_disk_roots() changed it
+ */
+const char *get_sysfs_root(void);
+
+/**
+ * Returns the directory in which procfs is looked up.
+ * @return  /proc, unless set_disk_roots() changed it
+ */
+const char *get_procfs_root(void);
+
+/**
+ * Returns the time of CLOCK_MONOTONIC, with which the samples of the core
+ * are stamped.
+ * @return  the time in ns
+ */
+uint64_t now_ns(void);
+
 #endif /* NET_H */
@@ -25,53 +25,215 @@
 #endif
 
 #include "disk.h"
+#include "graph.h"
+#include "history.h"
+#include "cgroup.h"
+#include "hotplug.h"
+#include "mounts.h"
+#include "pressure.h"
+#include "procio.h"
+#include "rollup.h"
+#include "sampler.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <glib.h>
+#include <glib-unix.h>
 #include <gtk/gtk.h>
 
 #include <libxfce4panel/libxfce4panel.h>
 #include <libxfce4ui/libxfce4ui.h>
 #include <libxfce4util/libxfce4util.h>
 
+#include <string.h>
+
 #define BORDER 8
 
 #define INIT_MAX 4096
 #define MINIMAL_MAX 1024
 #define SHRINK_MAX 0.75
 
-#define HISTSIZE_CALCULATE 4
-#define HISTSIZE_STORE 20
+/* The number of samples averaged for display, and over which the automatic
+   maximum is taken */
+#define SMOOTH_WINDOW 4
+#define SCALE_WINDOW 20
 
 static gchar *DEFAULT_COLOR[] = {"#FF4F00", "#FFE500"};
 
 #define UPDATE_TIMEOUT 250
+
+/* The longest update interval while the disks are idle, in ms. The interval
+   doubles on every idle update until it reaches it */
+#define IDLE_TIMEOUT 4000
+#define MAX_IDLE_TIMEOUT 60000
+
+/* The share of PRESSURE_WINDOW that tasks must be stalled on I/O for the
+   icon to show the warning, in % */
+#define PRESSURE_THRESHOLD 10
+
+/* How often the fill level of the filesystems is read, in us */
+#define FILL_INTERVAL 10000000
+
+/* How often the buffer of the trace is written out, in us. A crash loses at
+   most the samples of this window */
+#define TRACE_FLUSH_INTERVAL 5000000
+
+/* The number of cgroups ranked in the tooltip */
+#define CGROUP_TOP 5
+
+/* The size of a trace before it is rotated, in MiB */
+#define TRACE_SIZE 64
+
+/* The suffix of the history file, which replaces the .rc of the config file */
+#define ROLLUP_SUFFIX ".history"
 #define MAX_LENGTH 32
+#define MAX_DEVICE_LENGTH 256
 
 #define IN 0
 #define OUT 1
 #define TOT 2
 #define SUM 2
 
+/* The metrics that can be shown in the bars */
+typedef struct {
+  const gchar *label;
+  /* The history holds the metric multiplied by scale so that fractional
+     values survive in its gulong slots */
+  gulong scale;
+  /* The automatic maximum starts at initial_max and never shrinks below
+     minimal_max. Both are in the unit of the metric */
+  gdouble initial_max;
+  gdouble minimal_max;
+  /* A natural upper bound of the metric, or 0 if there is none */
+  gdouble fixed_max;
+  /* Whether the user-defined maximum in KiB/s applies */
+  gboolean user_max;
+} t_source;
+
+static const t_source SOURCES[METRIC_COUNT] = {
+    [METRIC_RD_BYTES] = {N_("Bytes read"), 1, INIT_MAX, MINIMAL_MAX, 0, TRUE},
+    [METRIC_WR_BYTES] = {N_("Bytes written"), 1, INIT_MAX, MINIMAL_MAX, 0,
+                         TRUE},
+    [METRIC_RD_IOPS] = {N_("Read requests"), 100, 10, 10, 0, FALSE},
+    [METRIC_WR_IOPS] = {N_("Write requests"), 100, 10, 10, 0, FALSE},
+    [METRIC_RD_MERGES] = {N_("Merged read requests"), 100, 10, 10, 0, FALSE},
+    [METRIC_WR_MERGES] = {N_("Merged write requests"), 100, 10, 10, 0, FALSE},
+    [METRIC_RQ_SIZE] = {N_("Average request size"), 1, 4096, 4096, 0, FALSE},
+    [METRIC_R_AWAIT] = {N_("Read latency"), 1000, 1, 1, 0, FALSE},
+    [METRIC_W_AWAIT] = {N_("Write latency"), 1000, 1, 1, 0, FALSE},
+    [METRIC_UTIL] = {N_("Utilization"), 100, 100, 100, 100, FALSE},
+    [METRIC_QUEUE] = {N_("Average queue size"), 100, 1, 1, 0, FALSE},
+    [METRIC_IN_FLIGHT] = {N_("Requests in flight"), 100, 1, 1, 0, FALSE},
+};
+
 typedef struct {
   gboolean auto_max;
   gulong max[SUM];
+  gint source[SUM];
   gint update_interval;
+  /* The longest interval while idle in ms, 0 to never slow down */
+  gint idle_interval;
+  /* The I/O stall that triggers the warning in %, 0 to never warn */
+  gint pressure_threshold;
+  /* The number of processes ranked in the tooltip, 0 to not read them, and
+     the time that reading them may take per update in us */
+  gint process_count;
+  gint process_budget;
+  /* The cgroups that are ranked in the tooltip, relative to CGROUP_ROOT.
+     Empty if unused */
+  gchar *cgroup;
+  /* The period of the sampler thread in ms, 0 to sample on update_interval */
+  gint sampler_interval;
+  gint smooth_window;
+  gint scale_window;
   GdkRGBA color[SUM];
   gchar *device;
+  /* Where the samples are recorded, and the trace that is shown instead of
+     the disks. Empty if unused. Only set in the config file */
+  gchar *trace_file;
+  gint trace_size;
+  gchar *replay_file;
+  gboolean replay_fast;
+  /* Whether the history graph is shown next to the bars */
+  gboolean show_graph;
 } t_monitor_options;
 
+/* A path of the device specification, and the fill level of its
+   filesystem */
+typedef struct {
+  gchar *path;
+  gboolean avail;
+  mount_usage usage;
+} t_fill;
+
+/* The bars of one disk */
 typedef struct {
-  GtkWidget *label;
   GtkWidget *status[SUM];
 
-  gulong history[SUM][HISTSIZE_STORE];
+  history history[SUM];
   gulong net_max[SUM];
 
+  /* What the bars show: the filled length and the length of the bar in
+     pixels, -1 until it is set, and whether their color is set */
+  gint pixels[SUM];
+  gint length[SUM];
+  gboolean colored[SUM];
+  GdkRGBA color[SUM];
+} t_bars;
+
+/* The title image that is shown */
+enum { ICON_NODISK, ICON_SSD, ICON_HDD };
+
+typedef struct {
+  GtkWidget *label;
+
+  /* One pair of bars per disk, and at least one */
+  t_bars *bars;
+  gint nbars;
+
   t_monitor_options options;
 
-  /* For the disk */
-  diskdata data;
+  /* For the disks */
+  diskset set;
+
+  /* The long term history of the total speed */
+  rollup rollup;
+
+  /* Samples the disks faster than they are displayed, if enabled */
+  sampler sampler;
+
+  /* The I/O pressure of the whole system */
+  pressure pressure;
+
+  /* The specification with its paths resolved, to tell when the mounts
+     moved them to other devices */
+  gchar *resolved;
+
+  /* The filesystems of the paths of the specification, and when their fill
+     level was last read */
+  t_fill *fills;
+  gint nfills;
+  gint64 fill_time;
+
+  /* The I/O of the processes, if they are ranked */
+  procio procio;
+
+  /* The I/O of the cgroups, if they are ranked, and the layout of the disks
+     that it counts */
+  cgroup_tree cgroup;
+  unsigned int cgroup_generation;
+
+  /* The recent history of the sources over all the disks */
+  graph graph;
+
+  /* The recorded samples and when they were last written out, and the trace
+     that is replayed. replay_first is the time of its first sample, when the
+     replay started at replay_start */
+  trace_writer trace;
+  gint64 trace_time;
+  trace_reader replay;
+  guint64 replay_first;
+  gint64 replay_start;
 
   /* Container for everything */
   GtkBox *opt_vbox;
@@ -80,13 +242,33 @@ typedef struct {
   GtkWidget* nodisk;
   GtkWidget* sdd;
   GtkWidget* hdd;
+  gint icon;
   
   /* Update interval */
   GtkWidget *update_spinner;
+  GtkWidget *idle_spinner;
+
+  /* Smoothing and scale windows */
+  GtkWidget *window_spinner[SUM];
+
+  /* Sampler period */
+  GtkWidget *sampler_spinner;
+
+  /* Pressure threshold */
+  GtkWidget *pressure_spinner;
+
+  /* Processes */
+  GtkWidget *process_spinner[SUM];
+
+  /* History graph */
+  GtkWidget *graph_check;
 
   /* Disk */
   GtkWidget *disk_entry;
 
+  /* Cgroups */
+  GtkWidget *cgroup_entry;
+
   /* Maximum */
   GtkWidget *max_use_label;
   GtkWidget *max_entry[SUM];
@@ -98,6 +280,9 @@ typedef struct {
   /* Color */
   GtkWidget *opt_button[SUM];
   GtkWidget *opt_da[SUM];
+
+  /* Source */
+  GtkWidget *source_combo[SUM];
 } t_monitor;
 
 typedef struct {
@@ -108,7 +293,25 @@ typedef struct {
   GtkWidget *ebox_bars;
   GtkWidget *box_bars;
   GtkWidget *tooltip_text;
+  /* The markup of tooltip_text */
+  gchar *tooltip_markup;
   guint timeout_id;
+  /* The interval of the current timeout in ms */
+  gint interval;
+  /* The number of updates in the current minute and in the last one */
+  gint64 minute;
+  guint wakeups;
+  guint last_wakeups;
+  /* The watch of the pressure trigger, and until when the tasks are
+     considered stalled after it fired */
+  guint pressure_id;
+  gint64 stall_until;
+  /* The source of device events and its watch */
+  hotplug hotplug;
+  guint hotplug_id;
+  /* The mounts through which paths are resolved, and their watch */
+  mount_table mounts;
+  guint mounts_id;
   t_monitor *monitor;
 
   /* options dialog */
@@ -116,150 +319,944 @@ typedef struct {
 } t_global_monitor;
 
 static void set_progressbar_csscolor(GtkWidget *, GdkRGBA *);
-/* -------------------------------------------------------------------------- */
-static gboolean update_monitors(t_global_monitor *global) {
-  char buffer[SUM + 1][BUFSIZ];
-  char buffer_panel[SUM][BUFSIZ];
-  gchar caption[BUFSIZ];
-  gchar received[BUFSIZ];
-  gchar sent[BUFSIZ];
-  gulong net[SUM + 1];
-  gulong display[SUM + 1], max;
-  guint64 histcalculate;
-  double temp;
-  gint i, j;
-
-  if (!check_disk(&(global->monitor->data))) {
-    g_snprintf(caption, sizeof(caption),
-               _("<tt>%s\n"
-                 "----------------"
-                 "Unavailable disk</tt>"),
-               (global->monitor->data.dev_name));
-    gtk_label_set_markup(GTK_LABEL(global->tooltip_text), caption);
-    gtk_widget_hide(global->monitor->hdd);
-    gtk_widget_hide(global->monitor->sdd);
-    gtk_widget_show(global->monitor->nodisk);
+static void create_bars(t_global_monitor *, gint, gboolean);
+static void free_bars(t_monitor *);
+static void setup_monitor(t_global_monitor *, gboolean);
+static gboolean monitor_set_size(XfcePanelPlugin *, int, t_global_monitor *);
 
-    return TRUE;
-  }
+/* -------------------------------------------------------------------------- */
+static void reset_max(t_monitor *monitor, t_bars *bars, gint i) {
+  const t_source *source = &SOURCES[monitor->options.source[i]];
 
-  gtk_widget_hide(global->monitor->nodisk);
-  if(global->monitor->data.ssd)
-    gtk_widget_show(global->monitor->sdd);
+  if (source->fixed_max > 0)
+    bars->net_max[i] = source->fixed_max * source->scale;
+  else if (source->user_max && !monitor->options.auto_max)
+    bars->net_max[i] = monitor->options.max[i];
   else
-    gtk_widget_show(global->monitor->hdd);
-  
-  get_current_diskspeed(&(global->monitor->data), &(net[IN]), &(net[OUT]),
-                        &(net[TOT]));
+    bars->net_max[i] = source->initial_max * source->scale;
+}
 
-  for (i = 0; i < SUM; i++) {
-    /* correct value to be from 1 ... 100 */
-    global->monitor->history[i][0] = net[i];
+/* -------------------------------------------------------------------------- */
+static void update_bars(t_monitor *monitor, t_bars *bars, diskdata *data) {
+  const t_source *source;
+  gulong display[SUM], max, value;
+  double temp;
+  gint i, length, pixels;
 
-    if (global->monitor->history[i][0] < 0) {
-      global->monitor->history[i][0] = 0;
-    }
+  for (i = 0; i < SUM; i++) {
+    source = &SOURCES[monitor->options.source[i]];
 
-    histcalculate = 0;
-    for (j = 0; j < HISTSIZE_CALCULATE; j++) {
-      histcalculate += global->monitor->history[i][j];
-    }
-    display[i] = histcalculate / HISTSIZE_CALCULATE;
+    /* correct value to be from 1 ... 100 */
+    if (data != NULL && data->avail)
+      value = get_metric(data, monitor->options.source[i]) * source->scale + 0.5;
+    else
+      value = 0;
+    history_push(&bars->history[i], value);
 
-    /* shift for next run */
-    for (j = HISTSIZE_STORE - 1; j > 0; j--) {
-      global->monitor->history[i][j] = global->monitor->history[i][j - 1];
-    }
+    display[i] = history_average(&bars->history[i]);
 
     /* update maximum */
-    if (global->monitor->options.auto_max) {
-      max = max_array(global->monitor->history[i], HISTSIZE_STORE);
-      if (display[i] > global->monitor->net_max[i]) {
-        global->monitor->net_max[i] = display[i];
-      } else if (max < global->monitor->net_max[i] * SHRINK_MAX &&
-                 global->monitor->net_max[i] * SHRINK_MAX >= MINIMAL_MAX) {
-        global->monitor->net_max[i] *= SHRINK_MAX;
+    if (source->fixed_max == 0 &&
+        (monitor->options.auto_max || !source->user_max)) {
+      max = history_max(&bars->history[i]);
+      if (display[i] > bars->net_max[i]) {
+        bars->net_max[i] = display[i];
+      } else if (max < bars->net_max[i] * SHRINK_MAX &&
+                 bars->net_max[i] * SHRINK_MAX >=
+                     source->minimal_max * source->scale) {
+        bars->net_max[i] *= SHRINK_MAX;
       }
     }
 
 #ifdef DEBUG
     switch (i) {
     case IN:
-      DBG("input: Max = %lu", global->monitor->net_max[i]);
+      DBG("input: Max = %lu", bars->net_max[i]);
       break;
 
     case OUT:
-      DBG("output: Max = %lu", global->monitor->net_max[i]);
-      break;
-
-    case TOT:
-      DBG("total: Max = %lu", global->monitor->net_max[i]);
+      DBG("output: Max = %lu", bars->net_max[i]);
       break;
     }
 #endif /* DEBUG */
 
-    temp = (double)display[i] / global->monitor->net_max[i];
+    temp = (double)display[i] / bars->net_max[i];
     if (temp > 1) {
       temp = 1.0;
     } else if (temp < 0) {
       temp = 0.0;
     }
 
-    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(global->monitor->status[i]),
-                                  temp);
+    /* Only redraw the bar if the filled part changed by a pixel. Before it is
+       allocated, the bar is taken as 100 pixels long */
+    length = MAX(gtk_widget_get_allocated_width(bars->status[i]),
+                 gtk_widget_get_allocated_height(bars->status[i]));
+    if (length <= 1)
+      length = 100;
+    pixels = temp * length + 0.5;
+    if (pixels != bars->pixels[i] || length != bars->length[i]) {
+      bars->pixels[i] = pixels;
+      bars->length[i] = length;
+      gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(bars->status[i]),
+                                    (double)pixels / length);
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void update_graph(t_monitor *monitor) {
+  const t_source *source;
+  guint64 values[SUM];
+  gint b, i;
+
+  /* The same scaled values as the bars, summed over the disks. A disk that
+     is stacked on others of the set is not counted twice */
+  for (i = 0; i < SUM; i++) {
+    source = &SOURCES[monitor->options.source[i]];
+    values[i] = 0;
+    for (b = 0; b < monitor->set.ndisks; b++)
+      if (monitor->set.disks[b].avail && monitor->set.disks[b].counted)
+        values[i] += get_metric(&monitor->set.disks[b],
+                                monitor->options.source[i]) *
+                         source->scale +
+                     0.5;
+  }
+  graph_push(&monitor->graph, values);
+}
+
+/* -------------------------------------------------------------------------- */
+static void set_icon(t_monitor *monitor, gint icon) {
+  if (icon == monitor->icon)
+    return;
+
+  gtk_widget_set_visible(monitor->nodisk, icon == ICON_NODISK);
+  gtk_widget_set_visible(monitor->sdd, icon == ICON_SSD);
+  gtk_widget_set_visible(monitor->hdd, icon == ICON_HDD);
+  monitor->icon = icon;
+}
+
+/******************************************************************************
+ *
+ * format_last_hour()
+ *
+ * format the average and the peak speed of the last hour, as recorded in the
+ * minute tier of the history file
+ *
+ * returns the rows to append to the tooltip, or NULL if there is no history
+ *
+ *****************************************************************************/
+
+static gchar *format_last_hour(t_monitor *monitor) {
+  char avg[SUM][BUFSIZ], peak[SUM][BUFSIZ];
+  rollup_value hour[ROLLUP_SERIES];
+  gint i;
+
+  if (rollup_summary(&monitor->rollup, ROLLUP_MINUTES,
+                     g_get_real_time() / 1000 - 60 * 60 * 1000, hour) != 0)
+    return NULL;
+
+  for (i = 0; i < SUM; i++) {
+    format_byte_humanreadable(avg[i], BUFSIZ - 1, hour[i].sum, 2, FALSE);
+    format_byte_humanreadable(peak[i], BUFSIZ - 1, hour[i].max, 2, FALSE);
+  }
+
+  return g_strdup_printf(_("\n-----------------------------\n"
+                           "%-8s %10s %10s\n"
+                           "%-8s %10s %10s"),
+                         _("1h avg"), avg[IN], avg[OUT], _("1h peak"),
+                         peak[IN], peak[OUT]);
+}
+
+/* -------------------------------------------------------------------------- */
+static gchar *format_pressure(t_monitor *monitor) {
+  const pressure *psi = &monitor->pressure;
+
+  if (!psi->avail)
+    return NULL;
+  return g_strdup_printf(_("\n-----------------------------\n"
+                           "%-8s %7s %7s %9s\n"
+                           "%-8s %6.2f%% %6.2f%% %8.1fs\n"
+                           "%-8s %6.2f%% %6.2f%% %8.1fs"),
+                         _("Stall"), _("10s"), _("60s"), _("total"),
+                         _("some"), psi->some.avg10, psi->some.avg60,
+                         psi->some.total / 1e6, _("full"), psi->full.avg10,
+                         psi->full.avg60, psi->full.total / 1e6);
+}
+
+/* -------------------------------------------------------------------------- */
+static gchar *format_processes(t_monitor *monitor) {
+  const procio *pio = &monitor->procio;
+  char buffer[SUM][BUFSIZ];
+  GString *caption;
+  gchar *name;
+  gint i;
+
+  if (monitor->options.process_count == 0 || pio->entries == NULL)
+    return NULL;
+
+  caption = g_string_new("\n-----------------------------\n");
+  g_string_append_printf(caption, _("%-8s %10s %10s"), _("Process"),
+                         _("Read"), _("Write"));
+  for (i = 0; i < pio->ntop; i++) {
+    format_byte_humanreadable(buffer[IN], BUFSIZ - 1, pio->top[i].rate_rd, 2,
+                              FALSE);
+    format_byte_humanreadable(buffer[OUT], BUFSIZ - 1, pio->top[i].rate_wr, 2,
+                              FALSE);
+    name = g_markup_escape_text(pio->top[i].comm, -1);
+    g_string_append_printf(caption, "\n%-8.8s %10s %10s", name, buffer[IN],
+                           buffer[OUT]);
+    g_free(name);
+  }
+  /* What reading the processes costs */
+  g_string_append_printf(caption, _("\n%-8s %7.2f ms %6lu pids"), _("Scan"),
+                         pio->cost / 1e6, (gulong)pio->count);
+
+  return g_string_free(caption, FALSE);
+}
+
+/* -------------------------------------------------------------------------- */
+static gchar *format_fills(t_monitor *monitor) {
+  char buffer[BUFSIZ];
+  GString *caption;
+  gchar *path;
+  gint i;
+
+  if (monitor->nfills == 0)
+    return NULL;
+
+  caption = g_string_new("\n-----------------------------\n");
+  g_string_append_printf(caption, _("%-8s %10s %10s"), _("Mount"), _("Used"),
+                         _("Free"));
+  /* The path is on a line of its own, as it is usually long */
+  for (i = 0; i < monitor->nfills; i++) {
+    path = g_markup_escape_text(monitor->fills[i].path, -1);
+    if (monitor->fills[i].avail) {
+      format_byte_humanreadable(buffer, BUFSIZ - 1,
+                                monitor->fills[i].usage.avail, 2, FALSE);
+      g_string_append_printf(caption, "\n%s\n%-8s %9.1f%% %10s", path, "",
+                             monitor->fills[i].usage.used, buffer);
+    } else {
+      g_string_append_printf(caption, "\n%s\n%-8s %21s", path, "",
+                             _("unavailable"));
+    }
+    g_free(path);
+  }
+
+  return g_string_free(caption, FALSE);
+}
+
+/* -------------------------------------------------------------------------- */
+static gchar *format_cgroups(t_monitor *monitor) {
+  const cgroup_tree *cg = &monitor->cgroup;
+  char buffer[SUM][BUFSIZ];
+  GString *caption;
+  gchar *name;
+  gint i;
+
+  if (*cg->root == '\0')
+    return NULL;
+
+  caption = g_string_new("\n-----------------------------\n");
+  g_string_append_printf(caption, _("%-8s %10s %10s"), _("Cgroup"),
+                         _("Read"), _("Write"));
+  /* The name is on a line of its own, as it is usually long */
+  for (i = 0; i < cg->ntop; i++) {
+    format_byte_humanreadable(buffer[IN], BUFSIZ - 1,
+                              cg->top[i].rate[CGROUP_RBYTES], 2, FALSE);
+    format_byte_humanreadable(buffer[OUT], BUFSIZ - 1,
+                              cg->top[i].rate[CGROUP_WBYTES], 2, FALSE);
+    name = g_markup_escape_text(cg->top[i].path, -1);
+    g_string_append_printf(caption, "\n%s\n%-8s %10s %10s", name, "",
+                           buffer[IN], buffer[OUT]);
+    g_free(name);
+  }
+  /* What reading the cgroups costs */
+  g_string_append_printf(caption, _("\n%-8s %7.2f ms %6d cgroups"), _("Scan"),
+                         cg->cost / 1e6, cg->nnodes);
+
+  return g_string_free(caption, FALSE);
+}
+
+/* -------------------------------------------------------------------------- */
+static gchar *format_wakeups(t_global_monitor *global) {
+  const sampler *smp = &global->monitor->sampler;
+  guint wakeups;
+
+  /* Until a whole minute has passed, the count so far */
+  wakeups = global->last_wakeups > 0 ? global->last_wakeups : global->wakeups;
+  if (!smp->running)
+    return g_strdup_printf(_("\n%-8s %10u"), _("Wake/min"), wakeups);
+
+  /* The samples that did not fit into the ring of the sampler */
+  return g_strdup_printf(_("\n%-8s %10u\n%-8s %10lu"), _("Wake/min"), wakeups,
+                         _("Dropped"),
+                         atomic_load_explicit(&smp->dropped,
+                                              memory_order_relaxed));
+}
 
-    format_byte_humanreadable(buffer[i], BUFSIZ - 1, display[i], 2, FALSE);
-    format_byte_humanreadable(buffer_panel[i], BUFSIZ - 1, display[i], 2, FALSE);
-   }
+/* -------------------------------------------------------------------------- */
+static void set_tooltip_markup(t_global_monitor *global, const gchar *markup) {
+  if (g_strcmp0(markup, global->tooltip_markup) == 0)
+    return;
+
+  g_free(global->tooltip_markup);
+  global->tooltip_markup = g_strdup(markup);
+  gtk_label_set_markup(GTK_LABEL(global->tooltip_text), markup);
+}
+
+/* -------------------------------------------------------------------------- */
+static void set_disk_tooltip(t_global_monitor *global, diskdata *data) {
+  char buffer[SUM + 1][BUFSIZ];
+  char rq_size[BUFSIZ];
+  GString *caption;
+  gchar *name, *last_hour, *stall, *fills, *processes, *cgroups, *wakeups;
+  double rd, wr;
+
+  name = g_markup_escape_text(data->dev_name, -1);
+  caption = g_string_new(NULL);
+
+  if (!data->avail) {
+    g_string_append_printf(caption,
+                           _("<tt>%s\n"
+                             "----------------"
+                             "Unavailable disk</tt>"),
+                           name);
+    set_tooltip_markup(global, caption->str);
+    g_string_free(caption, TRUE);
+    g_free(name);
+    return;
+  }
 
+  format_byte_humanreadable(buffer[IN], BUFSIZ - 1, data->cur_in, 2, FALSE);
+  format_byte_humanreadable(buffer[OUT], BUFSIZ - 1, data->cur_out, 2, FALSE);
   format_byte_humanreadable(buffer[TOT], BUFSIZ - 1,
-                            (display[IN] + display[OUT]), 2,
-                            FALSE);
-
-  {
-    g_snprintf(caption, sizeof(caption),
-               _("<tt>/dev/%s\n"
-                 "-----------------\n"
-                 "Read   %10s\n"
-                 "Write  %10s\n"
-                 "-----------------\n"
-                 "Total  %10s</tt>"),
-               global->monitor->data.dev_name, buffer[IN],
-               buffer[OUT], buffer[TOT]);
-    gtk_label_set_markup(GTK_LABEL(global->tooltip_text), caption);
+                            data->cur_in + data->cur_out, 2, FALSE);
+  format_byte_humanreadable(rq_size, BUFSIZ - 1,
+                            get_metric(data, METRIC_RQ_SIZE), 2, FALSE);
+
+  /* An NFS mount is named after its mount point */
+  g_string_append_printf(
+      caption,
+      _("<tt>%s%s\n"
+        "-----------------\n"
+        "Read   %10s\n"
+        "Write  %10s\n"
+        "-----------------\n"
+        "Total  %10s\n"
+        "-----------------\n"
+        "r/s    %10.1f\n"
+        "w/s    %10.1f\n"
+        "rrqm/s %10.1f\n"
+        "wrqm/s %10.1f\n"
+        "rq-sz  %10s\n"
+        "r_await%7.2f ms\n"
+        "w_await%7.2f ms\n"
+        "aqu-sz %10.2f\n"
+        "%%util  %10.1f\n"
+        "in-fl  %10.0f"),
+      data->dev_name[0] == '/' ? "" : "/dev/", name, buffer[IN], buffer[OUT],
+      buffer[TOT], get_metric(data, METRIC_RD_IOPS),
+      get_metric(data, METRIC_WR_IOPS), get_metric(data, METRIC_RD_MERGES),
+      get_metric(data, METRIC_WR_MERGES), rq_size,
+      get_metric(data, METRIC_R_AWAIT), get_metric(data, METRIC_W_AWAIT),
+      get_metric(data, METRIC_QUEUE), get_metric(data, METRIC_UTIL),
+      get_metric(data, METRIC_IN_FLIGHT));
+  g_free(name);
+
+  if (global->monitor->sampler.running) {
+    format_byte_humanreadable(buffer[IN], BUFSIZ - 1, data->peak_in, 2, FALSE);
+    format_byte_humanreadable(buffer[OUT], BUFSIZ - 1, data->peak_out, 2,
+                              FALSE);
+    g_string_append_printf(caption,
+                           _("\n-----------------\n"
+                             "Peak r %10s\n"
+                             "Peak w %10s"),
+                           buffer[IN], buffer[OUT]);
+  }
+  if (get_nfs_rtt(&global->monitor->set, data - global->monitor->set.disks,
+                  &rd, &wr) == 0)
+    g_string_append_printf(caption,
+                           _("\n-----------------\n"
+                             "r_rtt  %7.2f ms\n"
+                             "w_rtt  %7.2f ms"),
+                           rd, wr);
+  if ((last_hour = format_last_hour(global->monitor)) != NULL) {
+    g_string_append(caption, last_hour);
+    g_free(last_hour);
+  }
+  if ((stall = format_pressure(global->monitor)) != NULL) {
+    g_string_append(caption, stall);
+    g_free(stall);
+  }
+  if ((fills = format_fills(global->monitor)) != NULL) {
+    g_string_append(caption, fills);
+    g_free(fills);
+  }
+  if ((processes = format_processes(global->monitor)) != NULL) {
+    g_string_append(caption, processes);
+    g_free(processes);
+  }
+  if ((cgroups = format_cgroups(global->monitor)) != NULL) {
+    g_string_append(caption, cgroups);
+    g_free(cgroups);
+  }
+  wakeups = format_wakeups(global);
+  g_string_append(caption, wakeups);
+  g_free(wakeups);
+  g_string_append(caption, "</tt>");
+
+  set_tooltip_markup(global, caption->str);
+  g_string_free(caption, TRUE);
+}
+
+/* -------------------------------------------------------------------------- */
+static void set_diskset_tooltip(t_global_monitor *global) {
+  diskset *set = &(global->monitor->set);
+  char buffer[SUM + 1][BUFSIZ];
+  gulong net[SUM + 1];
+  double stack[SUM];
+  double rtt[SUM];
+  GString *caption;
+  gchar *name, *last_hour, *stall, *fills, *processes, *cgroups, *wakeups;
+  gint b;
+
+  caption = g_string_new("<tt>");
+  g_string_append_printf(caption, _("%-8s %10s %10s\n"), _("Device"),
+                         _("Read"), _("Write"));
+  g_string_append(caption, "-----------------------------\n");
+
+  for (b = 0; b < set->ndisks; b++) {
+    name = g_markup_escape_text(set->disks[b].dev_name, -1);
+    if (set->disks[b].avail) {
+      format_byte_humanreadable(buffer[IN], BUFSIZ - 1, set->disks[b].cur_in,
+                                2, FALSE);
+      format_byte_humanreadable(buffer[OUT], BUFSIZ - 1,
+                                set->disks[b].cur_out, 2, FALSE);
+      g_string_append_printf(caption, "%-8s %10s %10s\n", name, buffer[IN],
+                             buffer[OUT]);
+
+      /* The physical devices under a stacked device, and how much more they
+         write than the device itself */
+      if (get_stack_speed(set, b, &stack[IN], &stack[OUT]) > 0) {
+        format_byte_humanreadable(buffer[IN], BUFSIZ - 1, stack[IN], 2, FALSE);
+        format_byte_humanreadable(buffer[OUT], BUFSIZ - 1, stack[OUT], 2,
+                                  FALSE);
+        g_string_append_printf(caption, "%-8s %10s %10s\n", _(" leaves"),
+                               buffer[IN], buffer[OUT]);
+        if (set->disks[b].cur_out > 0)
+          g_string_append_printf(caption, "%-8s %20.2fx\n", _(" wr amp"),
+                                 stack[OUT] / set->disks[b].cur_out);
+      }
+
+      /* The round trip time of an NFS mount, without the client queue */
+      if (get_nfs_rtt(set, b, &rtt[IN], &rtt[OUT]) == 0)
+        g_string_append_printf(caption, "%-8s %7.2f ms %7.2f ms\n", _(" rtt"),
+                               rtt[IN], rtt[OUT]);
+    } else {
+      g_string_append_printf(caption, "%-8s %21s\n", name, _("unavailable"));
+    }
+    g_free(name);
+  }
+
+  get_diskset_speed(set, &(net[IN]), &(net[OUT]), &(net[TOT]));
+  format_byte_humanreadable(buffer[IN], BUFSIZ - 1, net[IN], 2, FALSE);
+  format_byte_humanreadable(buffer[OUT], BUFSIZ - 1, net[OUT], 2, FALSE);
+  format_byte_humanreadable(buffer[TOT], BUFSIZ - 1, net[TOT], 2, FALSE);
+  g_string_append(caption, "-----------------------------\n");
+  g_string_append_printf(caption, _("%-8s %10s %10s\n%-8s %21s"),
+                         _("Total"), buffer[IN], buffer[OUT], "", buffer[TOT]);
+  if ((last_hour = format_last_hour(global->monitor)) != NULL) {
+    g_string_append(caption, last_hour);
+    g_free(last_hour);
+  }
+  if ((stall = format_pressure(global->monitor)) != NULL) {
+    g_string_append(caption, stall);
+    g_free(stall);
+  }
+  if ((fills = format_fills(global->monitor)) != NULL) {
+    g_string_append(caption, fills);
+    g_free(fills);
+  }
+  if ((processes = format_processes(global->monitor)) != NULL) {
+    g_string_append(caption, processes);
+    g_free(processes);
+  }
+  if ((cgroups = format_cgroups(global->monitor)) != NULL) {
+    g_string_append(caption, cgroups);
+    g_free(cgroups);
+  }
+  wakeups = format_wakeups(global);
+  g_string_append(caption, wakeups);
+  g_free(wakeups);
+  g_string_append(caption, "</tt>");
+
+  set_tooltip_markup(global, caption->str);
+  g_string_free(caption, TRUE);
+}
+
+/******************************************************************************
+ *
+ * update_tooltip()
+ *
+ * build the markup of the tooltip. It is only needed when the tooltip is
+ * queried, and on every update while it is shown
+ *
+ *****************************************************************************/
+
+static void update_tooltip(t_global_monitor *global) {
+  if (global->monitor->set.ndisks == 1)
+    set_disk_tooltip(global, &global->monitor->set.disks[0]);
+  else
+    set_diskset_tooltip(global);
+}
+
+/******************************************************************************
+ *
+ * replay_trace()
+ *
+ * feed the next samples of the replayed trace to the set. When fast, one
+ * sample is taken per update. Otherwise, the samples are taken up to the time
+ * that elapsed since the replay started, so that the trace plays at the pace
+ * at which it was recorded
+ *
+ *****************************************************************************/
+
+static void replay_trace(t_monitor *monitor) {
+  trace_reader *trace = &monitor->replay;
+  guint64 elapsed;
+
+  if (monitor->options.replay_fast) {
+    trace_replay(trace, &monitor->set);
+    return;
+  }
+
+  if (monitor->replay_first == 0) {
+    if (trace_replay(trace, &monitor->set) == 0) {
+      monitor->replay_first = trace->stamp;
+      monitor->replay_start = g_get_monotonic_time();
+    }
+    return;
+  }
+
+  elapsed = (g_get_monotonic_time() - monitor->replay_start) * 1000;
+  while (trace->stamp - monitor->replay_first < elapsed &&
+         trace_replay(trace, &monitor->set) == 0)
+    ;
+}
+
+/* -------------------------------------------------------------------------- */
+static void select_cgroup_disks(t_monitor *monitor) {
+  const diskset *set = &monitor->set;
+  const gchar **names;
+  gint b, n = 0;
+
+  names = g_new(const gchar *, MAX(set->ndisks, 1));
+  for (b = 0; b < set->ndisks; b++) {
+    if (set->disks[b].counted)
+      names[n++] = set->disks[b].dev_name;
+  }
+  if (cgroup_select(&monitor->cgroup, get_sysfs_root(), names, n) == 0)
+    monitor->cgroup_generation = set->generation;
+  g_free(names);
+}
+
+/* -------------------------------------------------------------------------- */
+static gboolean update_monitors(t_global_monitor *global) {
+  t_monitor *monitor = global->monitor;
+  diskdata *data = NULL;
+  gulong net[SUM + 1];
+  double values[ROLLUP_SERIES];
+  gboolean stalled;
+  gint b;
+
+  /* The sampler thread reads the disks. Only its results are collected */
+  if (monitor->replay.buf != NULL)
+    replay_trace(monitor);
+  else if (monitor->sampler.running)
+    sampler_drain(&monitor->sampler, &monitor->set);
+  else
+    update_diskset(&monitor->set);
+
+  if (monitor->trace.fd >= 0)
+    trace_write(&monitor->trace, &monitor->set);
+
+  /* A replayed trace is not part of the history */
+  if (monitor->set.ndisks > 0 && monitor->replay.buf == NULL) {
+    get_diskset_speed(&monitor->set, &(net[IN]), &(net[OUT]), &(net[TOT]));
+    values[IN] = net[IN];
+    values[OUT] = net[OUT];
+    rollup_add(&monitor->rollup, g_get_real_time() / 1000, values);
+  }
+
+  /* The fill level changes slowly, and statvfs() may block on a busy
+     filesystem */
+  if (monitor->nfills > 0 &&
+      g_get_monotonic_time() - monitor->fill_time >= FILL_INTERVAL) {
+    for (b = 0; b < monitor->nfills; b++)
+      monitor->fills[b].avail =
+          mounts_usage(monitor->fills[b].path, &monitor->fills[b].usage) == 0;
+    monitor->fill_time = g_get_monotonic_time();
+  }
+
+  /* The buffer batches the writes within the window */
+  if (monitor->trace.fd >= 0 && monitor->trace.len > 0 &&
+      g_get_monotonic_time() - monitor->trace_time >= TRACE_FLUSH_INTERVAL) {
+    trace_writer_flush(&monitor->trace);
+    monitor->trace_time = g_get_monotonic_time();
+  }
+
+  /* Each update reads some of the processes, within its budget */
+  if (monitor->procio.entries != NULL)
+    procio_update(&monitor->procio, monitor->options.process_count);
+
+  /* The cgroups count the disks of the set, without those that are counted
+     through the devices they are stacked on */
+  if (*monitor->cgroup.root && monitor->replay.buf == NULL) {
+    if (monitor->cgroup_generation != monitor->set.generation)
+      select_cgroup_disks(monitor);
+    cgroup_update(&monitor->cgroup, CGROUP_TOP);
   }
 
+  /* Without a trigger, the 10 s average is compared to the threshold */
+  pressure_read(&monitor->pressure);
+  if (global->pressure_id > 0)
+    stalled = g_get_monotonic_time() < global->stall_until;
+  else
+    stalled =
+        monitor->options.pressure_threshold > 0 && monitor->pressure.avail &&
+        monitor->pressure.some.avg10 >= monitor->options.pressure_threshold;
+
+  /* A pattern matched a new device */
+  if (MAX(monitor->set.ndisks, 1) != monitor->nbars) {
+    create_bars(global, MAX(monitor->set.ndisks, 1), FALSE);
+    monitor_set_size(global->plugin,
+                     xfce_panel_plugin_get_size(global->plugin), global);
+  }
+
+  /* The icon follows the first disk that is available */
+  for (b = 0; b < monitor->set.ndisks; b++) {
+    if (monitor->set.disks[b].avail) {
+      data = &monitor->set.disks[b];
+      break;
+    }
+  }
+
+  /* The warning reuses the icon of a missing disk */
+  if (data == NULL || stalled)
+    set_icon(monitor, ICON_NODISK);
+  else
+    set_icon(monitor, data->ssd ? ICON_SSD : ICON_HDD);
+
+  for (b = 0; b < monitor->nbars; b++)
+    update_bars(monitor, &monitor->bars[b],
+                b < monitor->set.ndisks ? &monitor->set.disks[b] : NULL);
+
+  if (monitor->options.show_graph)
+    update_graph(monitor);
+
+  /* The label is only mapped while the tooltip is shown */
+  if (gtk_widget_get_mapped(global->tooltip_text))
+    update_tooltip(global);
+
   return TRUE;
 }
 
-static void run_update(t_global_monitor *global) {
+/* -------------------------------------------------------------------------- */
+static gboolean is_idle(const diskset *set) {
+  gint b;
+
+  for (b = 0; b < set->ndisks; b++) {
+    if (set->disks[b].avail &&
+        (get_metric(&set->disks[b], METRIC_RD_IOPS) > 0 ||
+         get_metric(&set->disks[b], METRIC_WR_IOPS) > 0 ||
+         get_metric(&set->disks[b], METRIC_IN_FLIGHT) > 0))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/******************************************************************************
+ *
+ * next_interval()
+ *
+ * the update interval after the current update. It goes back to the update
+ * interval as soon as a disk is busy, and doubles while they are all idle, up
+ * to the idle interval. From 1 s on, it is a whole number of seconds so that
+ * the timeout can be coalesced with the other timers of the session. While
+ * the sampler runs, it never exceeds the time in which the sampler fills its
+ * ring, since the samples that do not fit are lost
+ *
+ * returns the interval in ms
+ *
+ *****************************************************************************/
+
+static gint next_interval(t_global_monitor *global) {
+  const t_monitor_options *options = &global->monitor->options;
+  const sampler *smp = &global->monitor->sampler;
+  gint interval, limit = G_MAXINT;
+
+  if (smp->running) {
+    limit = MAX(SAMPLER_RING_SIZE / MAX(global->monitor->set.ndisks, 1), 1) *
+            (gint)(smp->interval / 1000000u);
+    if (limit >= 1000)
+      limit -= limit % 1000;
+  }
+
+  if (options->idle_interval <= options->update_interval ||
+      g_get_monotonic_time() < global->stall_until ||
+      !is_idle(&global->monitor->set))
+    return MIN(options->update_interval, limit);
+
+  interval = MIN(global->interval * 2, options->idle_interval);
+  if (interval >= 1000)
+    interval -= interval % 1000;
+  return MIN(MAX(interval, global->interval), limit);
+}
+
+/* -------------------------------------------------------------------------- */
+static void count_wakeup(t_global_monitor *global) {
+  gint64 now = g_get_monotonic_time();
+
+  if (now - global->minute >= 60 * G_USEC_PER_SEC) {
+    global->last_wakeups =
+        now - global->minute < 2 * 60 * G_USEC_PER_SEC ? global->wakeups : 0;
+    global->wakeups = 0;
+    global->minute = now;
+  }
+  global->wakeups++;
+}
+
+static gboolean update_timeout(t_global_monitor *);
+
+/* -------------------------------------------------------------------------- */
+static void schedule_update(t_global_monitor *global, gint interval) {
   if (global->timeout_id > 0) {
     g_source_remove(global->timeout_id);
     global->timeout_id = 0;
   }
 
-  if (global->monitor->options.update_interval > 0) {
-    global->timeout_id = g_timeout_add(global->monitor->options.update_interval,
-                                       (GSourceFunc)update_monitors, global);
+  global->interval = interval;
+  if (interval <= 0)
+    return;
+
+  if (interval >= 1000 && interval % 1000 == 0)
+    global->timeout_id = g_timeout_add_seconds(
+        interval / 1000, (GSourceFunc)update_timeout, global);
+  else
+    global->timeout_id =
+        g_timeout_add(interval, (GSourceFunc)update_timeout, global);
+}
+
+/* -------------------------------------------------------------------------- */
+static gboolean update_timeout(t_global_monitor *global) {
+  gint interval;
+
+  count_wakeup(global);
+  update_monitors(global);
+
+  interval = next_interval(global);
+  if (interval == global->interval)
+    return TRUE;
+
+  /* The source is destroyed when FALSE is returned */
+  global->timeout_id = 0;
+  schedule_update(global, interval);
+  return FALSE;
+}
+
+static void run_update(t_global_monitor *global) {
+  schedule_update(global, global->monitor->options.update_interval);
+}
+
+/******************************************************************************
+ *
+ * pressure_cb()
+ *
+ * called as soon as the pressure trigger fires, rather than on the next
+ * update, which may be seconds away if the disks were idle. The kernel fires
+ * it at most once per window, so the warning is kept for a window
+ *
+ *****************************************************************************/
+
+static gboolean pressure_cb(gint fd, GIOCondition condition,
+                            t_global_monitor *global) {
+  /* The trigger is gone. The averages are polled instead */
+  if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+    global->pressure_id = 0;
+    return G_SOURCE_REMOVE;
   }
+
+  global->stall_until = g_get_monotonic_time() + PRESSURE_WINDOW;
+  update_monitors(global);
+  run_update(global);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/******************************************************************************
+ *
+ * hotplug_cb()
+ *
+ * called when block devices appear, disappear or change. The disks are only
+ * looked for again on such events, and are updated right away rather than on
+ * the next update
+ *
+ *****************************************************************************/
+
+static gboolean hotplug_cb(gint fd, GIOCondition condition,
+                           t_global_monitor *global) {
+  gint events = -1;
+
+  if (!(condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)))
+    events = hotplug_read(&global->hotplug);
+
+  /* The source is gone. The missing disks are polled for instead */
+  if (events < 0) {
+    hotplug_close(&global->hotplug);
+    set_disk_hotplug(FALSE);
+    notify_disk_event();
+    global->hotplug_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  if (events > 0) {
+    notify_disk_event();
+    update_monitors(global);
+    run_update(global);
+  }
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* -------------------------------------------------------------------------- */
+static void setup_hotplug(t_global_monitor *global) {
+  gint fd;
+
+  hotplug_init(&global->hotplug);
+  global->hotplug_id = 0;
+
+  if ((fd = hotplug_open(&global->hotplug, HOTPLUG_DEVDIR)) < 0)
+    return;
+  set_disk_hotplug(TRUE);
+  global->hotplug_id =
+      g_unix_fd_add(fd, G_IO_IN | G_IO_ERR | G_IO_HUP,
+                    (GUnixFDSourceFunc)hotplug_cb, global);
+}
+
+/******************************************************************************
+ *
+ * mounts_cb()
+ *
+ * called when a filesystem was mounted or unmounted. The disks are only set
+ * up again if a path of the specification is now on other devices
+ *
+ *****************************************************************************/
+
+static gboolean mounts_cb(gint fd, GIOCondition condition,
+                          t_global_monitor *global) {
+  gchar *resolved;
+
+  if (condition & G_IO_NVAL) {
+    global->mounts_id = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  mounts_read(&global->mounts);
+  global->monitor->fill_time = 0;
+
+  resolved = resolve_disk_spec(global->monitor->options.device);
+  if (resolved != NULL && global->monitor->resolved != NULL &&
+      strcmp(resolved, global->monitor->resolved) != 0)
+    setup_monitor(global, TRUE);
+  free(resolved);
+
+  return G_SOURCE_CONTINUE;
+}
+
+/* -------------------------------------------------------------------------- */
+static void setup_mounts(t_global_monitor *global) {
+  gint fd;
+
+  mounts_init(&global->mounts);
+  global->mounts_id = 0;
+
+  if ((fd = mounts_open(&global->mounts, get_procfs_root())) < 0)
+    return;
+  set_disk_mounts(&global->mounts);
+  /* The kernel flags a change with POLLERR as well as POLLPRI */
+  global->mounts_id =
+      g_unix_fd_add(fd, G_IO_PRI | G_IO_ERR, (GUnixFDSourceFunc)mounts_cb,
+                    global);
+}
+
+/* -------------------------------------------------------------------------- */
+static void free_fills(t_monitor *monitor) {
+  gint i;
+
+  for (i = 0; i < monitor->nfills; i++)
+    g_free(monitor->fills[i].path);
+  g_free(monitor->fills);
+  monitor->fills = NULL;
+  monitor->nfills = 0;
+  monitor->fill_time = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static void setup_fills(t_monitor *monitor) {
+  gchar **words;
+  gint i;
+
+  free_fills(monitor);
+  words = g_strsplit_set(monitor->options.device, " \t,", -1);
+  monitor->fills = g_new0(t_fill, g_strv_length(words) + 1);
+  for (i = 0; words[i] != NULL; i++) {
+    if (words[i][0] == '/')
+      monitor->fills[monitor->nfills++].path = g_strdup(words[i]);
+    else if (words[i][0] == '+' && words[i][1] == '/')
+      monitor->fills[monitor->nfills++].path = g_strdup(words[i] + 1);
+  }
+  g_strfreev(words);
+}
+
+/* -------------------------------------------------------------------------- */
+static void setup_pressure(t_global_monitor *global) {
+  gint fd;
+
+  /* The watch must not outlive the fd that pressure_trigger() closes */
+  if (global->pressure_id > 0) {
+    g_source_remove(global->pressure_id);
+    global->pressure_id = 0;
+  }
+  global->stall_until = 0;
+
+  fd = pressure_trigger(&(global->monitor->pressure),
+                        global->monitor->options.pressure_threshold);
+  if (fd >= 0)
+    global->pressure_id =
+        g_unix_fd_add(fd, G_IO_PRI | G_IO_ERR, (GUnixFDSourceFunc)pressure_cb,
+                      global);
 }
 
 static gboolean monitor_set_size(XfcePanelPlugin *plugin, int size,
                                  t_global_monitor *global) {
-  gint i;
+  gint b, i;
   XfcePanelPluginMode mode = xfce_panel_plugin_get_mode(plugin);
 
   DBG("monitor_set_size");
 
   if (mode == XFCE_PANEL_PLUGIN_MODE_VERTICAL) {
-    for (i = 0; i < SUM; i++)
-      gtk_widget_set_size_request(GTK_WIDGET(global->monitor->status[i]), -1,
-                                  BORDER);
+    for (b = 0; b < global->monitor->nbars; b++)
+      for (i = 0; i < SUM; i++)
+        gtk_widget_set_size_request(
+            GTK_WIDGET(global->monitor->bars[b].status[i]), -1, BORDER);
+    gtk_widget_set_size_request(global->monitor->graph.area, -1, size);
     gtk_widget_set_size_request(GTK_WIDGET(plugin), size, -1);
   } else {
-    for (i = 0; i < SUM; i++)
-      gtk_widget_set_size_request(GTK_WIDGET(global->monitor->status[i]),
-                                  BORDER, -1);
+    for (b = 0; b < global->monitor->nbars; b++)
+      for (i = 0; i < SUM; i++)
+        gtk_widget_set_size_request(
+            GTK_WIDGET(global->monitor->bars[b].status[i]), BORDER, -1);
+    gtk_widget_set_size_request(global->monitor->graph.area, 2 * size, -1);
     gtk_widget_set_size_request(GTK_WIDGET(plugin), -1, size);
   }
 
@@ -270,11 +1267,12 @@ static gboolean monitor_set_size(XfcePanelPlugin *plugin, int size,
 
 static void monitor_set_mode(XfcePanelPlugin *plugin, XfcePanelPluginMode mode,
                              t_global_monitor *global) {
-  gint i;
+  gint b, i;
 
   DBG("monitor_set_mode");
   if (global->timeout_id) {
     g_source_remove(global->timeout_id);
+    global->timeout_id = 0;
   }
 
   if (mode == XFCE_PANEL_PLUGIN_MODE_VERTICAL) {
@@ -289,11 +1287,14 @@ static void monitor_set_mode(XfcePanelPlugin *plugin, XfcePanelPluginMode mode,
                                    GTK_ORIENTATION_HORIZONTAL);
   }
   gtk_label_set_angle(GTK_LABEL(global->monitor->label), 0);
-  for (i = 0; i < SUM; i++) {
-    gtk_orientable_set_orientation(GTK_ORIENTABLE(global->monitor->status[i]),
-                                   GTK_ORIENTATION_HORIZONTAL);
-    gtk_progress_bar_set_inverted(GTK_PROGRESS_BAR(global->monitor->status[i]),
-                                  FALSE);
+  for (b = 0; b < global->monitor->nbars; b++) {
+    for (i = 0; i < SUM; i++) {
+      gtk_orientable_set_orientation(
+          GTK_ORIENTABLE(global->monitor->bars[b].status[i]),
+          GTK_ORIENTATION_HORIZONTAL);
+      gtk_progress_bar_set_inverted(
+          GTK_PROGRESS_BAR(global->monitor->bars[b].status[i]), FALSE);
+    }
   }
 
   monitor_set_size(plugin, xfce_panel_plugin_get_size(plugin), global);
@@ -303,6 +1304,7 @@ static void monitor_set_mode(XfcePanelPlugin *plugin, XfcePanelPluginMode mode,
 
 static gboolean tooltip_cb(GtkWidget *widget, gint x, gint y, gboolean keyboard,
                            GtkTooltip *tooltip, t_global_monitor *global) {
+  update_tooltip(global);
   gtk_tooltip_set_custom(tooltip, global->tooltip_text);
   return TRUE;
 }
@@ -312,21 +1314,157 @@ static void monitor_free(XfcePanelPlugin *plugin, t_global_monitor *global) {
     g_source_remove(global->timeout_id);
   }
 
+  if (global->pressure_id) {
+    g_source_remove(global->pressure_id);
+  }
+
+  if (global->hotplug_id) {
+    g_source_remove(global->hotplug_id);
+    hotplug_close(&global->hotplug);
+    set_disk_hotplug(FALSE);
+  }
+
+  if (global->mounts_id) {
+    g_source_remove(global->mounts_id);
+  }
+
   gtk_widget_destroy(global->tooltip_text);
+  g_free(global->tooltip_markup);
+
+  sampler_stop(&(global->monitor->sampler));
+  trace_writer_close(&(global->monitor->trace));
+  trace_reader_close(&(global->monitor->replay));
+  pressure_close(&(global->monitor->pressure));
+  procio_close(&(global->monitor->procio));
+  cgroup_close(&(global->monitor->cgroup));
+  close_diskset(&(global->monitor->set));
+  rollup_close(&(global->monitor->rollup));
+  graph_free(&(global->monitor->graph));
+  free_bars(global->monitor);
+
+  set_disk_mounts(NULL);
+  mounts_close(&global->mounts);
+  free(global->monitor->resolved);
+  free_fills(global->monitor);
 
   g_free(global);
 }
 
-static t_global_monitor *monitor_new(XfcePanelPlugin *plugin) {
-  t_global_monitor *global;
-  gint i;
+/* -------------------------------------------------------------------------- */
+static void free_bars(t_monitor *monitor) {
+  gint b, i;
+
+  for (b = 0; b < monitor->nbars; b++)
+    for (i = 0; i < SUM; i++)
+      history_free(&monitor->bars[b].history[i]);
+  g_free(monitor->bars);
+  monitor->bars = NULL;
+  monitor->nbars = 0;
+}
+
+static void create_bars(t_global_monitor *global, gint nbars,
+                        gboolean reset) {
+  t_monitor *monitor = global->monitor;
 #if GTK_CHECK_VERSION(3, 16, 0)
   GtkCssProvider *css_provider;
 #endif
+  t_bars *bars;
+  gint b, i, kept;
+
+  /* The bars of the disks that remain keep their widgets and history, so
+     that a new device only adds bars */
+  kept = MIN(nbars, monitor->nbars);
+  for (b = kept; b < monitor->nbars; b++) {
+    for (i = 0; i < SUM; i++) {
+      gtk_widget_destroy(monitor->bars[b].status[i]);
+      history_free(&monitor->bars[b].history[i]);
+    }
+  }
+  if (nbars != monitor->nbars) {
+    monitor->bars = g_renew(t_bars, monitor->bars, nbars);
+    if (nbars > kept)
+      memset(&monitor->bars[kept], 0, (nbars - kept) * sizeof(t_bars));
+    monitor->nbars = nbars;
+  }
+
+  for (b = kept; b < nbars; b++) {
+    for (i = 0; i < SUM; i++) {
+      monitor->bars[b].status[i] = GTK_WIDGET(gtk_progress_bar_new());
+
+#if GTK_CHECK_VERSION(3, 16, 0)
+      css_provider = gtk_css_provider_new();
+      gtk_style_context_add_provider(
+          GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
+              GTK_WIDGET(monitor->bars[b].status[i]))),
+          GTK_STYLE_PROVIDER(css_provider),
+          GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
+
+      g_object_set_data_full(G_OBJECT(monitor->bars[b].status[i]),
+                             "css_provider", css_provider, g_object_unref);
+#endif
+
+      gtk_box_pack_start(GTK_BOX(global->box_bars),
+                         GTK_WIDGET(monitor->bars[b].status[i]), TRUE, TRUE,
+                         0);
+      gtk_widget_show(monitor->bars[b].status[i]);
+    }
+  }
+
+  /* Only the added bars are initialized, unless the options changed */
+  for (b = reset ? 0 : kept; b < nbars; b++) {
+    bars = &monitor->bars[b];
+    for (i = 0; i < SUM; i++) {
+      /* The windows may have changed */
+      history_free(&bars->history[i]);
+      history_init(&bars->history[i], monitor->options.smooth_window,
+                   monitor->options.scale_window);
+
+      /* Automatic or fixed maximum */
+      reset_max(monitor, bars, i);
+      bars->pixels[i] = -1;
+      bars->length[i] = -1;
+    }
+  }
+
+  for (b = 0; b < nbars; b++) {
+    bars = &monitor->bars[b];
+    for (i = 0; i < SUM; i++) {
+      /* Set bar colors, unless they did not change */
+      if (bars->colored[i] &&
+          gdk_rgba_equal(&bars->color[i], &monitor->options.color[i]))
+        continue;
+      bars->colored[i] = TRUE;
+      bars->color[i] = monitor->options.color[i];
+#if GTK_CHECK_VERSION(3, 16, 0)
+      set_progressbar_csscolor(bars->status[i], &monitor->options.color[i]);
+#else
+      gtk_widget_override_background_color(GTK_WIDGET(bars->status[i]),
+                                           GTK_STATE_PRELIGHT,
+                                           &monitor->options.color[i]);
+      gtk_widget_override_background_color(GTK_WIDGET(bars->status[i]),
+                                           GTK_STATE_SELECTED,
+                                           &monitor->options.color[i]);
+      gtk_widget_override_color(GTK_WIDGET(bars->status[i]),
+                                GTK_STATE_SELECTED,
+                                &monitor->options.color[i]);
+#endif
+    }
+  }
+}
+
+static t_global_monitor *monitor_new(XfcePanelPlugin *plugin) {
+  t_global_monitor *global;
+  gint i;
   GtkWidget* hdd, *sdd;
 
   global = g_new(t_global_monitor, 1);
   global->timeout_id = 0;
+  global->interval = 0;
+  global->minute = g_get_monotonic_time();
+  global->wakeups = 0;
+  global->last_wakeups = 0;
+  global->pressure_id = 0;
+  global->stall_until = 0;
   global->ebox = gtk_event_box_new();
   gtk_event_box_set_visible_window(GTK_EVENT_BOX(global->ebox), FALSE);
   gtk_event_box_set_above_child(GTK_EVENT_BOX(global->ebox), TRUE);
@@ -337,25 +1475,44 @@ static t_global_monitor *monitor_new(XfcePanelPlugin *plugin) {
 
   global->tooltip_text = gtk_label_new(NULL);
   g_object_ref(global->tooltip_text);
+  global->tooltip_markup = NULL;
 
   global->plugin = plugin;
   xfce_panel_plugin_add_action_widget(plugin, global->ebox);
 
-  global->monitor = g_new(t_monitor, 1);
+  global->monitor = g_new0(t_monitor, 1);
   global->monitor->options.device = g_strdup("");
+  global->monitor->options.trace_file = g_strdup("");
+  global->monitor->options.trace_size = TRACE_SIZE;
+  global->monitor->options.replay_file = g_strdup("");
+  global->monitor->options.replay_fast = FALSE;
+  global->monitor->options.show_graph = FALSE;
   global->monitor->options.auto_max = TRUE;
   global->monitor->options.update_interval = UPDATE_TIMEOUT;
+  global->monitor->options.idle_interval = IDLE_TIMEOUT;
+  global->monitor->options.sampler_interval = 0;
+  global->monitor->options.pressure_threshold = PRESSURE_THRESHOLD;
+  global->monitor->options.process_count = 0;
+  global->monitor->options.process_budget = PROCIO_BUDGET;
+  global->monitor->options.cgroup = g_strdup("");
+  global->monitor->options.smooth_window = SMOOTH_WINDOW;
+  global->monitor->options.scale_window = SCALE_WINDOW;
+  global->monitor->options.source[IN] = METRIC_RD_BYTES;
+  global->monitor->options.source[OUT] = METRIC_WR_BYTES;
+  global->monitor->set.fd = -1;
+  sampler_init(&global->monitor->sampler);
+  pressure_init(&global->monitor->pressure);
+  procio_init(&global->monitor->procio);
+  cgroup_init(&global->monitor->cgroup);
+  trace_writer_init(&global->monitor->trace);
+  global->monitor->trace_time = 0;
+  trace_reader_init(&global->monitor->replay);
+  setup_hotplug(global);
+  setup_mounts(global);
 
   for (i = 0; i < SUM; i++) {
     gdk_rgba_parse(&global->monitor->options.color[i], DEFAULT_COLOR[i]);
 
-    global->monitor->history[i][0] = 0;
-    global->monitor->history[i][1] = 0;
-    global->monitor->history[i][2] = 0;
-    global->monitor->history[i][3] = 0;
-
-    global->monitor->net_max[i] = INIT_MAX;
-
     global->monitor->options.max[i] = INIT_MAX;
   }
 
@@ -390,27 +1547,16 @@ static t_global_monitor *monitor_new(XfcePanelPlugin *plugin) {
   gtk_widget_show(global->ebox_bars);
   global->box_bars = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 0);
   gtk_widget_show(global->box_bars);
-  for (i = 0; i < SUM; i++) {
-    global->monitor->status[i] = GTK_WIDGET(gtk_progress_bar_new());
-
-    css_provider = gtk_css_provider_new();
-    gtk_style_context_add_provider(
-        GTK_STYLE_CONTEXT(gtk_widget_get_style_context(
-            GTK_WIDGET(global->monitor->status[i]))),
-        GTK_STYLE_PROVIDER(css_provider),
-        GTK_STYLE_PROVIDER_PRIORITY_APPLICATION);
-
-    g_object_set_data(G_OBJECT(global->monitor->status[i]), "css_provider",
-                      css_provider);
-
-    gtk_box_pack_start(GTK_BOX(global->box_bars),
-                       GTK_WIDGET(global->monitor->status[i]), TRUE, TRUE, 0);
-    gtk_widget_show(global->monitor->status[i]);
-  }
+  create_bars(global, 1, TRUE);
   gtk_container_add(GTK_CONTAINER(global->ebox_bars),
                     GTK_WIDGET(global->box_bars));
   gtk_container_add(GTK_CONTAINER(global->box), GTK_WIDGET(global->ebox_bars));
 
+  /* Create the history graph, hidden unless it is enabled */
+  graph_init(&global->monitor->graph);
+  gtk_box_pack_start(GTK_BOX(global->box), global->monitor->graph.area, TRUE,
+                     TRUE, 0);
+
   gtk_container_add(GTK_CONTAINER(global->ebox), GTK_WIDGET(global->box));
 
   return global;
@@ -438,62 +1584,143 @@ static void set_progressbar_csscolor(GtkWidget *pbar, GdkRGBA *color) {
 }
 
 static void setup_monitor(t_global_monitor *global, gboolean supress_warnings) {
-  gint i;
+  guint64 trace_size;
+  gchar *path;
 
-  if (global->timeout_id)
+  if (global->timeout_id) {
     g_source_remove(global->timeout_id);
+    global->timeout_id = 0;
+  }
 
   gtk_widget_show(global->monitor->label);
 
-  gtk_widget_show(global->ebox_bars);
-  for (i = 0; i < SUM; i++) {
-    /* Automatic or fixed maximum */
-    if (global->monitor->options.auto_max)
-      global->monitor->net_max[i] = INIT_MAX;
-    else
-      global->monitor->net_max[i] = global->monitor->options.max[i];
+  sampler_stop(&(global->monitor->sampler));
+  trace_reader_close(&(global->monitor->replay));
 
-      /* Set bar colors */
-#if GTK_CHECK_VERSION(3, 16, 0)
-    set_progressbar_csscolor(global->monitor->status[i],
-                             &global->monitor->options.color[i]);
-#else
-    gtk_widget_override_background_color(GTK_WIDGET(global->monitor->status[i]),
-                                         GTK_STATE_PRELIGHT,
-                                         &global->monitor->options.color[i]);
-    gtk_widget_override_background_color(GTK_WIDGET(global->monitor->status[i]),
-                                         GTK_STATE_SELECTED,
-                                         &global->monitor->options.color[i]);
-    gtk_widget_override_color(GTK_WIDGET(global->monitor->status[i]),
-                              GTK_STATE_SELECTED,
-                              &global->monitor->options.color[i]);
-#endif
+  /* The disks of a replayed trace replace those of the system */
+  if (*global->monitor->options.replay_file &&
+      trace_reader_open(&(global->monitor->replay),
+                        global->monitor->options.replay_file) == 0) {
+    trace_writer_close(&(global->monitor->trace));
+    close_diskset(&(global->monitor->set));
+    global->monitor->replay_first = 0;
+  } else {
+    if (!init_diskset(&(global->monitor->set),
+                      global->monitor->options.device) &&
+        !supress_warnings) {
+      xfce_dialog_show_error(
+          NULL, NULL, _("%s: Error in initializing:\n%s"),
+          _("xfce4-applet-diskspeed"),
+          _("Disk not found"));
+    }
+
+    /* The thread samples a set of its own, and this one only receives its
+       results. If the thread cannot be started, the disks are sampled on the
+       update interval as usual */
+    if (global->monitor->options.sampler_interval > 0 &&
+        sampler_start(&(global->monitor->sampler),
+                      global->monitor->options.device,
+                      global->monitor->options.sampler_interval) == 0)
+      close_diskset(&(global->monitor->set));
+
+    /* Only the counters that the main loop reads can be recorded. The
+       recording goes on across the changes of the other settings, so that
+       they do not cut it short */
+    trace_size = (guint64)global->monitor->options.trace_size * 1024 * 1024;
+    if (!*global->monitor->options.trace_file ||
+        global->monitor->sampler.running) {
+      trace_writer_close(&(global->monitor->trace));
+    } else if (global->monitor->trace.fd >= 0 &&
+               strcmp(global->monitor->trace.path,
+                      global->monitor->options.trace_file) == 0 &&
+               global->monitor->trace.max_size == trace_size) {
+      trace_writer_restart(&(global->monitor->trace));
+    } else {
+      trace_writer_close(&(global->monitor->trace));
+      trace_writer_open(&(global->monitor->trace),
+                        global->monitor->options.trace_file, trace_size);
+    }
+    if (global->monitor->trace.fd >= 0)
+      trace_write(&(global->monitor->trace), &(global->monitor->set));
   }
 
-  if (!init_diskspeed(&(global->monitor->data),
-                      global->monitor->options.device) &&
-      !supress_warnings) {
-    xfce_dialog_show_error(
-        NULL, NULL, _("%s: Error in initializing:\n%s"),
-        _("xfce4-applet-diskspeed"),
-        _("Disk not found"));
+  setup_pressure(global);
+
+  /* The paths of the specification */
+  free(global->monitor->resolved);
+  global->monitor->resolved = resolve_disk_spec(global->monitor->options.device);
+  setup_fills(global->monitor);
+
+  /* The table of processes is started over with the new budget */
+  procio_close(&(global->monitor->procio));
+  if (global->monitor->options.process_count > 0)
+    procio_open(&(global->monitor->procio), get_procfs_root(),
+                global->monitor->options.process_budget, PROCIO_MAX_FDS);
+
+  /* The tree is walked again, and counts the disks of the new set */
+  cgroup_close(&(global->monitor->cgroup));
+  global->monitor->cgroup_generation = 0;
+  if (*global->monitor->options.cgroup) {
+    path = g_build_filename(CGROUP_ROOT, global->monitor->options.cgroup,
+                            NULL);
+    cgroup_open(&(global->monitor->cgroup), path, CGROUP_BUDGET);
+    g_free(path);
   }
 
+  /* One pair of bars per disk */
+  create_bars(global, MAX(global->monitor->set.ndisks, 1), TRUE);
+
+  gtk_widget_show(global->ebox_bars);
+
+  graph_set_colors(&(global->monitor->graph), global->monitor->options.color);
+  gtk_widget_set_visible(global->monitor->graph.area,
+                         global->monitor->options.show_graph);
+
   monitor_set_mode(global->plugin, xfce_panel_plugin_get_mode(global->plugin),
                    global);
 
   run_update(global);
 }
 
+/******************************************************************************
+ *
+ * open_rollup()
+ *
+ * map the history file that goes with the config file, e.g.
+ * diskspeed-1.history next to diskspeed-1.rc
+ *
+ *****************************************************************************/
+
+static void open_rollup(t_global_monitor *global, const char *rc_file) {
+  gchar *base, *path;
+
+  rollup_close(&(global->monitor->rollup));
+
+  if (g_str_has_suffix(rc_file, ".rc"))
+    base = g_strndup(rc_file, strlen(rc_file) - strlen(".rc"));
+  else
+    base = g_strdup(rc_file);
+  path = g_strconcat(base, ROLLUP_SUFFIX, NULL);
+
+  if (rollup_open(&(global->monitor->rollup), path) != 0)
+    DBG("Could not map the history file '%s'", path);
+
+  g_free(path);
+  g_free(base);
+}
+
 static void monitor_read_config(XfcePanelPlugin *plugin,
                                 t_global_monitor *global) {
   const char *value;
   char *file;
   XfceRc *rc;
+  gint i;
 
   if (!(file = xfce_panel_plugin_save_location(plugin, TRUE)))
     return;
 
+  open_rollup(global, file);
+
   rc = xfce_rc_simple_open(file, FALSE);
   g_free(file);
 
@@ -512,6 +1739,23 @@ static void monitor_read_config(XfcePanelPlugin *plugin,
       g_free(global->monitor->options.device);
     global->monitor->options.device = g_strdup(value);
   }
+  if ((value = xfce_rc_read_entry(rc, "Cgroup", NULL)) != NULL) {
+    g_free(global->monitor->options.cgroup);
+    global->monitor->options.cgroup = g_strdup(value);
+  }
+  if ((value = xfce_rc_read_entry(rc, "Trace_File", NULL)) != NULL) {
+    g_free(global->monitor->options.trace_file);
+    global->monitor->options.trace_file = g_strdup(value);
+  }
+  global->monitor->options.trace_size =
+      MAX(xfce_rc_read_int_entry(rc, "Trace_Size", TRACE_SIZE), 0);
+  if ((value = xfce_rc_read_entry(rc, "Replay_File", NULL)) != NULL) {
+    g_free(global->monitor->options.replay_file);
+    global->monitor->options.replay_file = g_strdup(value);
+  }
+  global->monitor->options.replay_fast =
+      xfce_rc_read_bool_entry(rc, "Replay_Fast", FALSE);
+
   if ((value = xfce_rc_read_entry(rc, "Max_In", NULL)) != NULL) {
     global->monitor->options.max[IN] = strtol(value, NULL, 0);
   }
@@ -522,9 +1766,49 @@ static void monitor_read_config(XfcePanelPlugin *plugin,
   global->monitor->options.auto_max =
       xfce_rc_read_bool_entry(rc, "Auto_Max", TRUE);
 
+  global->monitor->options.show_graph =
+      xfce_rc_read_bool_entry(rc, "Show_Graph", FALSE);
+
+  global->monitor->options.source[IN] =
+      xfce_rc_read_int_entry(rc, "Source_In", METRIC_RD_BYTES);
+  global->monitor->options.source[OUT] =
+      xfce_rc_read_int_entry(rc, "Source_Out", METRIC_WR_BYTES);
+  for (i = 0; i < SUM; i++) {
+    if (global->monitor->options.source[i] < 0 ||
+        global->monitor->options.source[i] >= METRIC_COUNT)
+      global->monitor->options.source[i] = i == IN ? METRIC_RD_BYTES
+                                                   : METRIC_WR_BYTES;
+  }
+
   global->monitor->options.update_interval =
       xfce_rc_read_int_entry(rc, "Update_Interval", UPDATE_TIMEOUT);
 
+  global->monitor->options.idle_interval = CLAMP(
+      xfce_rc_read_int_entry(rc, "Idle_Interval", IDLE_TIMEOUT), 0,
+      MAX_IDLE_TIMEOUT);
+
+  global->monitor->options.sampler_interval =
+      xfce_rc_read_int_entry(rc, "Sampler_Interval", 0);
+  if (global->monitor->options.sampler_interval < 0)
+    global->monitor->options.sampler_interval = 0;
+
+  global->monitor->options.pressure_threshold = CLAMP(
+      xfce_rc_read_int_entry(rc, "Pressure_Threshold", PRESSURE_THRESHOLD), 0,
+      100);
+
+  global->monitor->options.process_count = CLAMP(
+      xfce_rc_read_int_entry(rc, "Top_Processes", 0), 0, PROCIO_MAX_TOP);
+  global->monitor->options.process_budget = CLAMP(
+      xfce_rc_read_int_entry(rc, "Process_Budget", PROCIO_BUDGET), 100,
+      100000);
+
+  global->monitor->options.smooth_window = CLAMP(
+      xfce_rc_read_int_entry(rc, "Smooth_Window", SMOOTH_WINDOW), 1,
+      HISTORY_MAX_WINDOW);
+  global->monitor->options.scale_window = CLAMP(
+      xfce_rc_read_int_entry(rc, "Scale_Window", SCALE_WINDOW), 1,
+      HISTORY_MAX_WINDOW);
+
   DBG("monitor_read_config");
   setup_monitor(global, TRUE);
 
@@ -556,6 +1840,15 @@ static void monitor_write_config(XfcePanelPlugin *plugin,
                           ? global->monitor->options.device
                           : "");
 
+  xfce_rc_write_entry(rc, "Cgroup", global->monitor->options.cgroup);
+
+  xfce_rc_write_entry(rc, "Trace_File", global->monitor->options.trace_file);
+  xfce_rc_write_int_entry(rc, "Trace_Size",
+                          global->monitor->options.trace_size);
+  xfce_rc_write_entry(rc, "Replay_File", global->monitor->options.replay_file);
+  xfce_rc_write_bool_entry(rc, "Replay_Fast",
+                           global->monitor->options.replay_fast);
+
   g_snprintf(value, 20, "%lu", global->monitor->options.max[IN]);
   xfce_rc_write_entry(rc, "Max_In", value);
 
@@ -564,9 +1857,35 @@ static void monitor_write_config(XfcePanelPlugin *plugin,
 
   xfce_rc_write_bool_entry(rc, "Auto_Max", global->monitor->options.auto_max);
 
+  xfce_rc_write_bool_entry(rc, "Show_Graph",
+                           global->monitor->options.show_graph);
+
+  xfce_rc_write_int_entry(rc, "Source_In", global->monitor->options.source[IN]);
+  xfce_rc_write_int_entry(rc, "Source_Out",
+                          global->monitor->options.source[OUT]);
+
   xfce_rc_write_int_entry(rc, "Update_Interval",
                           global->monitor->options.update_interval);
 
+  xfce_rc_write_int_entry(rc, "Idle_Interval",
+                          global->monitor->options.idle_interval);
+
+  xfce_rc_write_int_entry(rc, "Sampler_Interval",
+                          global->monitor->options.sampler_interval);
+
+  xfce_rc_write_int_entry(rc, "Pressure_Threshold",
+                          global->monitor->options.pressure_threshold);
+
+  xfce_rc_write_int_entry(rc, "Top_Processes",
+                          global->monitor->options.process_count);
+  xfce_rc_write_int_entry(rc, "Process_Budget",
+                          global->monitor->options.process_budget);
+
+  xfce_rc_write_int_entry(rc, "Smooth_Window",
+                          global->monitor->options.smooth_window);
+  xfce_rc_write_int_entry(rc, "Scale_Window",
+                          global->monitor->options.scale_window);
+
   xfce_rc_close(rc);
 }
 
@@ -579,6 +1898,10 @@ static void monitor_apply_options(t_global_monitor *global) {
   global->monitor->options.device =
       g_strdup(gtk_entry_get_text(GTK_ENTRY(global->monitor->disk_entry)));
 
+  g_free(global->monitor->options.cgroup);
+  global->monitor->options.cgroup =
+      g_strdup(gtk_entry_get_text(GTK_ENTRY(global->monitor->cgroup_entry)));
+
   for (i = 0; i < SUM; i++) {
     global->monitor->options.max[i] =
         strtol(gtk_entry_get_text(GTK_ENTRY(global->monitor->max_entry[i])),
@@ -592,6 +1915,28 @@ static void monitor_apply_options(t_global_monitor *global) {
                  1000 +
              0.5);
 
+  global->monitor->options.idle_interval =
+      gtk_spin_button_get_value_as_int(
+          GTK_SPIN_BUTTON(global->monitor->idle_spinner)) *
+      1000;
+
+  global->monitor->options.sampler_interval = gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(global->monitor->sampler_spinner));
+
+  global->monitor->options.pressure_threshold =
+      gtk_spin_button_get_value_as_int(
+          GTK_SPIN_BUTTON(global->monitor->pressure_spinner));
+
+  global->monitor->options.process_count = gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(global->monitor->process_spinner[0]));
+  global->monitor->options.process_budget = gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(global->monitor->process_spinner[1]));
+
+  global->monitor->options.smooth_window = gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(global->monitor->window_spinner[0]));
+  global->monitor->options.scale_window = gtk_spin_button_get_value_as_int(
+      GTK_SPIN_BUTTON(global->monitor->window_spinner[1]));
+
   setup_monitor(global, FALSE);
   DBG("monitor_apply_options_cb");
 }
@@ -630,16 +1975,18 @@ static void max_label_toggled(GtkWidget *check_button,
   for (i = 0; i < SUM; i++) {
     gtk_widget_set_sensitive(GTK_WIDGET(global->monitor->max_hbox[i]),
                              !(global->monitor->options.auto_max));
-
-    /* reset maximum if necessary */
-    if (global->monitor->options.auto_max) {
-      global->monitor->net_max[i] = INIT_MAX;
-    }
   }
   setup_monitor(global, FALSE);
   DBG("max_label_toggled");
 }
 
+static void graph_toggled(GtkWidget *check_button, t_global_monitor *global) {
+  global->monitor->options.show_graph =
+      gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_button));
+  setup_monitor(global, FALSE);
+  DBG("graph_toggled");
+}
+
 static void change_color(GtkWidget *button, t_global_monitor *global,
                          gint type) {
   gtk_color_chooser_get_rgba(GTK_COLOR_CHOOSER(button),
@@ -657,6 +2004,25 @@ static void change_color_out(GtkWidget *button, t_global_monitor *global) {
   change_color(button, global, OUT);
 }
 
+static void change_source(GtkWidget *combo, t_global_monitor *global,
+                          gint type) {
+  gint source = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+
+  if (source < 0 || source >= METRIC_COUNT)
+    return;
+  global->monitor->options.source[type] = source;
+  setup_monitor(global, FALSE);
+  DBG("change_source(%d) with %d", type, source);
+}
+
+static void change_source_in(GtkWidget *combo, t_global_monitor *global) {
+  change_source(combo, global, IN);
+}
+
+static void change_source_out(GtkWidget *combo, t_global_monitor *global) {
+  change_source(combo, global, OUT);
+}
+
 static void monitor_dialog_response(GtkWidget *dlg, int response,
                                     t_global_monitor *global) {
 
@@ -669,13 +2035,20 @@ static void monitor_dialog_response(GtkWidget *dlg, int response,
 static void monitor_create_options(XfcePanelPlugin *plugin,
                                    t_global_monitor *global) {
   GtkWidget *dlg;
-  GtkBox *vbox, *global_vbox, *net_hbox;
+  GtkBox *vbox, *global_vbox, *net_hbox, *hbox;
   GtkWidget *device_label, *unit_label[SUM], *max_label[SUM];
   GtkWidget *sep1, *sep2;
   GtkBox *bits_hbox;
   GtkBox *update_hbox;
   GtkWidget *update_label, *update_unit_label;
+  GtkWidget *idle_label, *idle_unit_label;
+  GtkWidget *sampler_label, *sampler_unit_label;
+  GtkWidget *pressure_label, *pressure_unit_label;
+  GtkWidget *cgroup_label;
   GtkWidget *color_label[SUM];
+  GtkWidget *source_label[SUM];
+  GtkWidget *window_label[SUM], *window_unit_label[SUM];
+  GtkWidget *process_label[SUM], *process_unit_label[SUM];
   gint present_data_active;
   GtkSizeGroup *sg;
   gint i;
@@ -684,6 +2057,22 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
                          N_("Bar color (_outgoing):")};
   gchar *maximum_text_label[] = {N_("Maximum (inco_ming):"),
                                  N_("Maximum (o_utgoing):")};
+  gchar *source_text[] = {N_("Bar _source (incoming):"),
+                          N_("Bar sou_rce (outgoing):")};
+  gchar *window_text[] = {N_("Smoothing _window:"), N_("Scale _history:")};
+  gint window_value[SUM];
+  gchar *process_text[] = {N_("Top _processes:"), N_("Process scan _budget:")};
+  gchar *process_unit[] = {N_("shown"), N_("us")};
+  gchar *process_tip[] = {
+      N_("Rank the processes by their I/O in the tooltip. 0 does not read "
+         "them"),
+      N_("The time that reading the processes may take per update. With "
+         "many processes, each update reads some of them")};
+  gint process_min[] = {0, 100};
+  gint process_max[] = {PROCIO_MAX_TOP, 100000};
+  gint process_step[] = {1, 100};
+  gint process_value[SUM];
+  gint j;
 
   xfce_panel_plugin_block_menu(plugin);
 
@@ -725,7 +2114,14 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
   global->monitor->disk_entry = gtk_entry_new();
   gtk_label_set_mnemonic_widget(GTK_LABEL(device_label),
                                 global->monitor->disk_entry);
-  gtk_entry_set_max_length(GTK_ENTRY(global->monitor->disk_entry), MAX_LENGTH);
+  gtk_entry_set_max_length(GTK_ENTRY(global->monitor->disk_entry),
+                           MAX_DEVICE_LENGTH);
+  gtk_widget_set_tooltip_text(
+      global->monitor->disk_entry,
+      _("One or more device names or patterns separated by spaces, "
+        "e.g. \"nvme*n1 sd[a-d]\". A name prefixed with + adds the devices "
+        "it is stacked on, e.g. \"+md0\". A path stands for the device "
+        "under it, e.g. \"/var/lib/postgresql\""));
   gtk_entry_set_text(GTK_ENTRY(global->monitor->disk_entry),
                      global->monitor->options.device);
   gtk_widget_show(global->monitor->disk_entry);
@@ -737,6 +2133,32 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
 
   gtk_widget_show_all(GTK_WIDGET(net_hbox));
 
+  /* Cgroups */
+  hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+  gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                     FALSE, FALSE, 0);
+
+  cgroup_label = gtk_label_new_with_mnemonic(_("C_groups:"));
+  gtk_widget_set_valign(cgroup_label, GTK_ALIGN_CENTER);
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(cgroup_label), FALSE, FALSE, 0);
+
+  global->monitor->cgroup_entry = gtk_entry_new();
+  gtk_label_set_mnemonic_widget(GTK_LABEL(cgroup_label),
+                                global->monitor->cgroup_entry);
+  gtk_entry_set_max_length(GTK_ENTRY(global->monitor->cgroup_entry),
+                           MAX_DEVICE_LENGTH);
+  gtk_widget_set_tooltip_text(
+      global->monitor->cgroup_entry,
+      _("Show the cgroups under this one of " CGROUP_ROOT " with the most "
+        "I/O on the devices, e.g. \"system.slice\". Empty shows none"));
+  gtk_entry_set_text(GTK_ENTRY(global->monitor->cgroup_entry),
+                     global->monitor->options.cgroup);
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(global->monitor->cgroup_entry),
+                     FALSE, FALSE, 0);
+
+  gtk_size_group_add_widget(sg, cgroup_label);
+  gtk_widget_show_all(GTK_WIDGET(hbox));
+
   /* Update timevalue */
   update_hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
   gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox),
@@ -766,6 +2188,162 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
   gtk_widget_show_all(GTK_WIDGET(update_hbox));
   gtk_size_group_add_widget(sg, update_label);
 
+  /* Idle interval */
+  hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+  gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                     FALSE, FALSE, 0);
+
+  idle_label = gtk_label_new_with_mnemonic(_("Interval when id_le:"));
+  gtk_widget_set_valign(idle_label, GTK_ALIGN_CENTER);
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(idle_label), FALSE, FALSE, 0);
+
+  global->monitor->idle_spinner =
+      gtk_spin_button_new_with_range(0, MAX_IDLE_TIMEOUT / 1000, 1);
+  gtk_label_set_mnemonic_widget(GTK_LABEL(idle_label),
+                                global->monitor->idle_spinner);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(global->monitor->idle_spinner),
+                            global->monitor->options.idle_interval / 1000);
+  gtk_widget_set_tooltip_text(
+      GTK_WIDGET(global->monitor->idle_spinner),
+      _("Update less and less often while the disks are idle, up to this "
+        "interval. 0 always updates on the update interval"));
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(global->monitor->idle_spinner),
+                     FALSE, FALSE, 0);
+
+  idle_unit_label = gtk_label_new(_("s"));
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(idle_unit_label), FALSE, FALSE,
+                     0);
+
+  gtk_size_group_add_widget(sg, idle_label);
+  gtk_widget_show_all(GTK_WIDGET(hbox));
+
+  /* Sampler period */
+  hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+  gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                     FALSE, FALSE, 0);
+
+  sampler_label = gtk_label_new_with_mnemonic(_("Sampling _period:"));
+  gtk_widget_set_valign(sampler_label, GTK_ALIGN_CENTER);
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(sampler_label), FALSE, FALSE,
+                     0);
+
+  global->monitor->sampler_spinner =
+      gtk_spin_button_new_with_range(0, 1000, SAMPLER_MIN_INTERVAL);
+  gtk_label_set_mnemonic_widget(GTK_LABEL(sampler_label),
+                                global->monitor->sampler_spinner);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(global->monitor->sampler_spinner),
+                            global->monitor->options.sampler_interval);
+  gtk_widget_set_tooltip_text(
+      GTK_WIDGET(global->monitor->sampler_spinner),
+      _("Sample the disks in the background at this period, and show the "
+        "average of the samples on every update. 0 samples on every update "
+        "instead"));
+  gtk_box_pack_start(GTK_BOX(hbox),
+                     GTK_WIDGET(global->monitor->sampler_spinner), FALSE,
+                     FALSE, 0);
+
+  sampler_unit_label = gtk_label_new(_("ms"));
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(sampler_unit_label), FALSE,
+                     FALSE, 0);
+
+  gtk_size_group_add_widget(sg, sampler_label);
+  gtk_widget_show_all(GTK_WIDGET(hbox));
+
+  /* Pressure threshold */
+  hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+  gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                     FALSE, FALSE, 0);
+
+  pressure_label = gtk_label_new_with_mnemonic(_("Stall _threshold:"));
+  gtk_widget_set_valign(pressure_label, GTK_ALIGN_CENTER);
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(pressure_label), FALSE, FALSE,
+                     0);
+
+  global->monitor->pressure_spinner = gtk_spin_button_new_with_range(0, 100, 1);
+  gtk_label_set_mnemonic_widget(GTK_LABEL(pressure_label),
+                                global->monitor->pressure_spinner);
+  gtk_spin_button_set_value(GTK_SPIN_BUTTON(global->monitor->pressure_spinner),
+                            global->monitor->options.pressure_threshold);
+  gtk_widget_set_tooltip_text(
+      GTK_WIDGET(global->monitor->pressure_spinner),
+      _("Show a warning when tasks wait for I/O for at least this share of "
+        "the time. 0 never warns"));
+  gtk_box_pack_start(GTK_BOX(hbox),
+                     GTK_WIDGET(global->monitor->pressure_spinner), FALSE,
+                     FALSE, 0);
+
+  pressure_unit_label = gtk_label_new(_("%"));
+  gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(pressure_unit_label), FALSE,
+                     FALSE, 0);
+
+  gtk_size_group_add_widget(sg, pressure_label);
+  gtk_widget_show_all(GTK_WIDGET(hbox));
+
+  /* Smoothing and scale windows */
+  window_value[0] = global->monitor->options.smooth_window;
+  window_value[1] = global->monitor->options.scale_window;
+  for (i = 0; i < SUM; i++) {
+    hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+    gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                       FALSE, FALSE, 0);
+
+    window_label[i] = gtk_label_new_with_mnemonic(_(window_text[i]));
+    gtk_widget_set_valign(window_label[i], GTK_ALIGN_CENTER);
+    gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(window_label[i]), FALSE,
+                       FALSE, 0);
+
+    global->monitor->window_spinner[i] =
+        gtk_spin_button_new_with_range(1, HISTORY_MAX_WINDOW, 1);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(window_label[i]),
+                                  global->monitor->window_spinner[i]);
+    gtk_spin_button_set_value(
+        GTK_SPIN_BUTTON(global->monitor->window_spinner[i]), window_value[i]);
+    gtk_box_pack_start(GTK_BOX(hbox),
+                       GTK_WIDGET(global->monitor->window_spinner[i]), FALSE,
+                       FALSE, 0);
+
+    window_unit_label[i] = gtk_label_new(_("samples"));
+    gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(window_unit_label[i]), FALSE,
+                       FALSE, 0);
+
+    gtk_size_group_add_widget(sg, window_label[i]);
+    gtk_widget_show_all(GTK_WIDGET(hbox));
+  }
+
+  /* Processes */
+  process_value[0] = global->monitor->options.process_count;
+  process_value[1] = global->monitor->options.process_budget;
+  for (i = 0; i < SUM; i++) {
+    hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+    gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                       FALSE, FALSE, 0);
+
+    process_label[i] = gtk_label_new_with_mnemonic(_(process_text[i]));
+    gtk_widget_set_valign(process_label[i], GTK_ALIGN_CENTER);
+    gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(process_label[i]), FALSE,
+                       FALSE, 0);
+
+    global->monitor->process_spinner[i] = gtk_spin_button_new_with_range(
+        process_min[i], process_max[i], process_step[i]);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(process_label[i]),
+                                  global->monitor->process_spinner[i]);
+    gtk_spin_button_set_value(
+        GTK_SPIN_BUTTON(global->monitor->process_spinner[i]),
+        process_value[i]);
+    gtk_widget_set_tooltip_text(
+        GTK_WIDGET(global->monitor->process_spinner[i]), _(process_tip[i]));
+    gtk_box_pack_start(GTK_BOX(hbox),
+                       GTK_WIDGET(global->monitor->process_spinner[i]), FALSE,
+                       FALSE, 0);
+
+    process_unit_label[i] = gtk_label_new(_(process_unit[i]));
+    gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(process_unit_label[i]), FALSE,
+                       FALSE, 0);
+
+    gtk_size_group_add_widget(sg, process_label[i]);
+    gtk_widget_show_all(GTK_WIDGET(hbox));
+  }
+
   sep1 = gtk_separator_new(GTK_ORIENTATION_HORIZONTAL);
   gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(sep1),
                      FALSE, FALSE, 0);
@@ -860,6 +2438,42 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
     gtk_size_group_add_widget(sg, color_label[i]);
   }
 
+  /* Source */
+  for (i = 0; i < SUM; i++) {
+    hbox = GTK_BOX(gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5));
+    gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox), GTK_WIDGET(hbox),
+                       FALSE, FALSE, 0);
+
+    source_label[i] = gtk_label_new_with_mnemonic(_(source_text[i]));
+    gtk_widget_set_valign(source_label[i], GTK_ALIGN_CENTER);
+    gtk_box_pack_start(GTK_BOX(hbox), GTK_WIDGET(source_label[i]), FALSE,
+                       FALSE, 0);
+
+    global->monitor->source_combo[i] = gtk_combo_box_text_new();
+    for (j = 0; j < METRIC_COUNT; j++)
+      gtk_combo_box_text_append_text(
+          GTK_COMBO_BOX_TEXT(global->monitor->source_combo[i]),
+          _(SOURCES[j].label));
+    gtk_combo_box_set_active(GTK_COMBO_BOX(global->monitor->source_combo[i]),
+                             global->monitor->options.source[i]);
+    gtk_label_set_mnemonic_widget(GTK_LABEL(source_label[i]),
+                                  global->monitor->source_combo[i]);
+    gtk_box_pack_start(GTK_BOX(hbox),
+                       GTK_WIDGET(global->monitor->source_combo[i]), FALSE,
+                       FALSE, 0);
+
+    gtk_size_group_add_widget(sg, source_label[i]);
+    gtk_widget_show_all(GTK_WIDGET(hbox));
+  }
+
+  global->monitor->graph_check =
+      gtk_check_button_new_with_mnemonic(_("Show history _graph"));
+  gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(global->monitor->graph_check),
+                               global->monitor->options.show_graph);
+  gtk_widget_show(global->monitor->graph_check);
+  gtk_box_pack_start(GTK_BOX(global->monitor->opt_vbox),
+                     GTK_WIDGET(global->monitor->graph_check), FALSE, FALSE, 0);
+
   gtk_box_pack_start(GTK_BOX(vbox), GTK_WIDGET(global->monitor->opt_vbox),
                      FALSE, FALSE, 0);
 
@@ -876,6 +2490,12 @@ static void monitor_create_options(XfcePanelPlugin *plugin,
                    G_CALLBACK(change_color_out), global);
   g_signal_connect(GTK_WIDGET(global->monitor->disk_entry), "activate",
                    G_CALLBACK(device_changed), global);
+  g_signal_connect(GTK_WIDGET(global->monitor->source_combo[IN]), "changed",
+                   G_CALLBACK(change_source_in), global);
+  g_signal_connect(GTK_WIDGET(global->monitor->source_combo[OUT]), "changed",
+                   G_CALLBACK(change_source_out), global);
+  g_signal_connect(GTK_WIDGET(global->monitor->graph_check), "toggled",
+                   G_CALLBACK(graph_toggled), global);
 
   gtk_widget_show(dlg);
 }
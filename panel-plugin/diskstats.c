@@ -0,0 +1,150 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "diskstats.h"
+
+#include <limits.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+static inline int is_blank(char c) { return c == ' ' || c == '\t'; }
+
+/* -------------------------------------------------------------------------- */
+static inline int is_digit(char c) { return (unsigned char)(c - '0') < 10; }
+
+/* -------------------------------------------------------------------------- */
+static inline const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && is_blank(*p))
+    p++;
+  return p;
+}
+
+/******************************************************************************
+ *
+ * parse_u64()
+ *
+ * parse an unsigned decimal number. The number must be followed by a blank,
+ * a newline or the end of the buffer. The kernel never prints anything that
+ * does not fit in 64 bits, so overflow is not checked
+ *
+ * returns a pointer past the number, or NULL if there is no number at p
+ *
+ *****************************************************************************/
+
+static inline const char *parse_u64(const char *p, const char *end,
+                                    uint64_t *value) {
+  const char *start = p;
+  uint64_t v = 0;
+
+  while (p < end && is_digit(*p)) {
+    v = v * 10 + (uint64_t)(*p - '0');
+    p++;
+  }
+
+  if (p == start || (p < end && !is_blank(*p) && *p != '\n'))
+    return NULL;
+
+  *value = v;
+  return p;
+}
+
+/* -------------------------------------------------------------------------- */
+const char *next_line(const char *p, const char *end) {
+  const char *nl;
+
+  if (p >= end)
+    return end;
+  if ((nl = memchr(p, '\n', end - p)) == NULL)
+    return end;
+  return nl + 1;
+}
+
+/* -------------------------------------------------------------------------- */
+int parse_stat_fields(const char **pp, const char *end, diskstat *st) {
+  const char *p = *pp;
+  const char *q;
+  uint64_t dump;
+  int n = 0;
+  int i;
+
+  for (;;) {
+    p = skip_blanks(p, end);
+    if (p == end || *p == '\n')
+      break;
+
+    q = parse_u64(p, end, n < STAT_NFIELDS ? &st->field[n] : &dump);
+    if (q == NULL) {
+      *pp = next_line(p, end);
+      return 1;
+    }
+    p = q;
+    n++;
+  }
+  *pp = p == end ? p : p + 1;
+
+  if (n < STAT_MIN_FIELDS)
+    return 1;
+
+  st->nfields = n < STAT_NFIELDS ? n : STAT_NFIELDS;
+  for (i = st->nfields; i < STAT_NFIELDS; i++)
+    st->field[i] = 0;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int parse_diskstats_line(const char **pp, const char *end, unsigned int *major,
+                         unsigned int *minor, const char **name,
+                         size_t *namelen, diskstat *st) {
+  const char *p = *pp;
+  const char *q;
+  uint64_t maj, min;
+
+  p = skip_blanks(p, end);
+  if ((q = parse_u64(p, end, &maj)) == NULL || maj > UINT_MAX)
+    goto malformed;
+  p = skip_blanks(q, end);
+  if ((q = parse_u64(p, end, &min)) == NULL || min > UINT_MAX)
+    goto malformed;
+  p = skip_blanks(q, end);
+
+  q = p;
+  while (q < end && !is_blank(*q) && *q != '\n')
+    q++;
+  if (q == p)
+    goto malformed;
+
+  *major = (unsigned int)maj;
+  *minor = (unsigned int)min;
+  *name = p;
+  *namelen = q - p;
+  *pp = q;
+
+  return parse_stat_fields(pp, end, st);
+
+malformed:
+  *pp = next_line(p, end);
+  return 1;
+}
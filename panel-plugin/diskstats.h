@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef DISKSTATS_H
+#define DISKSTATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The fields of /sys/block/<dev>/stat in the order in which the kernel
+   prints them. See Documentation/block/stat.txt in the kernel sources */
+enum {
+  STAT_RD_IOS,
+  STAT_RD_MERGES,
+  STAT_RD_SECTORS,
+  STAT_RD_TICKS,
+  STAT_WR_IOS,
+  STAT_WR_MERGES,
+  STAT_WR_SECTORS,
+  STAT_WR_TICKS,
+  STAT_IN_FLIGHT,
+  STAT_IO_TICKS,
+  STAT_TIME_IN_QUEUE,
+  /* Since Linux 4.18 */
+  STAT_DC_IOS,
+  STAT_DC_MERGES,
+  STAT_DC_SECTORS,
+  STAT_DC_TICKS,
+  /* Since Linux 5.5 */
+  STAT_FL_IOS,
+  STAT_FL_TICKS,
+  STAT_NFIELDS
+};
+
+/* The fewest fields that a kernel with a usable stat file prints */
+#define STAT_MIN_FIELDS 11
+
+typedef struct {
+  uint64_t field[STAT_NFIELDS];
+  /* The number of fields that were actually present. The others are 0 */
+  int nfields;
+} diskstat;
+
+/**
+ * Parses the statistics of a single block device, i.e. the contents of
+ * /sys/block/<dev>/stat or what follows the device name in a line of
+ * /proc/diskstats. Kernels printing 11, 15 or 17 fields are supported. Extra
+ * fields that newer kernels may add are skipped. The parser does not depend
+ * on the locale and does not allocate.
+ * @param   pp          the start of the fields. On return, it points to the
+ *                      start of the next line, even if there was an error
+ * @param   end         one past the last character of the buffer
+ * @param   st          the object into which the fields are stored
+ * @return  0 if successful, 1 if the line has fewer than STAT_MIN_FIELDS
+ * fields or contains garbage
+ */
+int parse_stat_fields(const char **pp, const char *end, diskstat *st);
+
+/**
+ * Parses a single line of /proc/diskstats. The name is not copied: it points
+ * into the buffer and is not terminated.
+ * @param   pp          the start of the line. On return, it points to the
+ *                      start of the next line, even if there was an error
+ * @param   end         one past the last character of the buffer
+ * @param   major       the major number of the device
+ * @param   minor       the minor number of the device
+ * @param   name        the start of the device name
+ * @param   namelen     the length of the device name
+ * @param   st          the object into which the fields are stored
+ * @return  0 if successful, 1 if the line is malformed
+ */
+int parse_diskstats_line(const char **pp, const char *end, unsigned int *major,
+                         unsigned int *minor, const char **name,
+                         size_t *namelen, diskstat *st);
+
+/**
+ * Returns the start of the line following the one that p is in.
+ * @param   p           a position in the buffer
+ * @param   end         one past the last character of the buffer
+ * @return  the start of the next line, or end if there is none
+ */
+const char *next_line(const char *p, const char *end);
+
+#endif /* DISKSTATS_H */
@@ -0,0 +1,249 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "graph.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* The number of columns before the area is allocated */
+#define GRAPH_INITIAL_WIDTH 64
+
+/* The scale is halved when the peak falls under this share of it, so that a
+   value that hovers around a power of 2 does not redraw every column */
+#define GRAPH_SHRINK 4
+
+/* -------------------------------------------------------------------------- */
+static uint64_t stacked(const uint64_t *values) {
+  uint64_t sum = 0;
+  int s;
+
+  for (s = 0; s < GRAPH_SERIES; s++)
+    sum += values[s];
+  return sum;
+}
+
+/* -------------------------------------------------------------------------- */
+static int update_scale(graph *g) {
+  uint64_t peak = history_max(&g->peak), scale = g->scale;
+
+  while (scale < peak)
+    scale *= 2;
+  while (scale > 1 && peak < scale / GRAPH_SHRINK)
+    scale /= 2;
+  if (scale == g->scale)
+    return 0;
+  g->scale = scale;
+  return 1;
+}
+
+/******************************************************************************
+ *
+ * resize_columns()
+ *
+ * keep the newest columns that fit in the new width. The oldest column moves
+ * back to 0, and the history of the peaks is rebuilt over the new width
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int resize_columns(graph *g, int width) {
+  uint64_t(*values)[GRAPH_SERIES];
+  int kept, c;
+
+  width = CLAMP(width, 1, HISTORY_MAX_WINDOW);
+  kept = MIN(width, g->width);
+  if ((values = calloc(width, sizeof(*values))) == NULL)
+    return 1;
+  for (c = 0; c < kept; c++)
+    memcpy(values[width - kept + c],
+           g->values[(g->pos + g->width - kept + c) % g->width],
+           sizeof(*values));
+
+  history_free(&g->peak);
+  if (history_init(&g->peak, 1, width) != 0) {
+    free(values);
+    return 1;
+  }
+  for (c = 0; c < width; c++)
+    history_push(&g->peak, stacked(values[c]));
+
+  free(g->values);
+  g->values = values;
+  g->width = width;
+  g->pos = 0;
+  update_scale(g);
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * draw_column()
+ *
+ * draw one column of the ring into the surface, at its own place. The series
+ * are stacked from the bottom, and the rest of the column is cleared
+ *
+ *****************************************************************************/
+
+static void draw_column(graph *g, cairo_t *cr, int c) {
+  double height = g->surface_height, bottom = height, top;
+  uint64_t sum = 0;
+  int s;
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_rectangle(cr, c, 0, 1, height);
+  cairo_fill(cr);
+
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  for (s = 0; s < GRAPH_SERIES; s++) {
+    sum += g->values[c][s];
+    top = height - MIN(sum, g->scale) * height / g->scale;
+    if (top < bottom) {
+      gdk_cairo_set_source_rgba(cr, &g->color[s]);
+      cairo_rectangle(cr, c, top, 1, bottom - top);
+      cairo_fill(cr);
+      bottom = top;
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void draw_columns(graph *g) {
+  cairo_t *cr;
+  int c;
+
+  if (g->surface == NULL)
+    return;
+
+  cr = cairo_create(g->surface);
+  for (c = 0; c < g->width; c++)
+    draw_column(g, cr, c);
+  cairo_destroy(cr);
+}
+
+/******************************************************************************
+ *
+ * ensure_surface()
+ *
+ * match the surface and the columns to the allocation of the area, which
+ * redraws all the columns if it changed
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int ensure_surface(graph *g) {
+  int width = gtk_widget_get_allocated_width(g->area);
+  int height = gtk_widget_get_allocated_height(g->area);
+
+  if (g->surface != NULL && width == g->surface_width &&
+      height == g->surface_height)
+    return 0;
+  if (width <= 0 || height <= 0 || !gtk_widget_get_realized(g->area))
+    return 1;
+
+  if (g->surface != NULL)
+    cairo_surface_destroy(g->surface);
+  g->surface = gdk_window_create_similar_surface(
+      gtk_widget_get_window(g->area), CAIRO_CONTENT_COLOR_ALPHA, width, height);
+  g->surface_width = width;
+  g->surface_height = height;
+
+  /* The surface is a ring of exactly one column per value */
+  if (width != g->width && resize_columns(g, width) != 0) {
+    cairo_surface_destroy(g->surface);
+    g->surface = NULL;
+    return 1;
+  }
+  draw_columns(g);
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static gboolean draw_cb(GtkWidget *area, cairo_t *cr, graph *g) {
+  if (ensure_surface(g) != 0)
+    return FALSE;
+
+  /* The oldest column goes to the left edge, and the columns before it wrap
+     around to the right */
+  cairo_set_source_surface(cr, g->surface, -g->pos, 0);
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_REPEAT);
+  cairo_paint(cr);
+
+  return FALSE;
+}
+
+/* -------------------------------------------------------------------------- */
+void graph_init(graph *g) {
+  memset(g, 0, sizeof(graph));
+  g->scale = 1;
+  g->area = gtk_drawing_area_new();
+  g_signal_connect(g->area, "draw", G_CALLBACK(draw_cb), g);
+  resize_columns(g, GRAPH_INITIAL_WIDTH);
+}
+
+/* -------------------------------------------------------------------------- */
+void graph_free(graph *g) {
+  if (g->area != NULL)
+    g_signal_handlers_disconnect_by_func(g->area, G_CALLBACK(draw_cb), g);
+  if (g->surface != NULL)
+    cairo_surface_destroy(g->surface);
+  history_free(&g->peak);
+  free(g->values);
+  memset(g, 0, sizeof(graph));
+}
+
+/* -------------------------------------------------------------------------- */
+void graph_set_colors(graph *g, const GdkRGBA *color) {
+  memcpy(g->color, color, sizeof(g->color));
+  draw_columns(g);
+  gtk_widget_queue_draw(g->area);
+}
+
+/* -------------------------------------------------------------------------- */
+void graph_push(graph *g, const uint64_t *values) {
+  cairo_t *cr;
+
+  if (g->values == NULL)
+    return;
+
+  memcpy(g->values[g->pos], values, sizeof(*g->values));
+  history_push(&g->peak, stacked(values));
+
+  /* A new scale redraws every column, and the new one with them */
+  if (update_scale(g))
+    draw_columns(g);
+  else if (g->surface != NULL) {
+    cr = cairo_create(g->surface);
+    draw_column(g, cr, g->pos);
+    cairo_destroy(cr);
+  }
+  g->pos = (g->pos + 1) % g->width;
+
+  gtk_widget_queue_draw(g->area);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <gtk/gtk.h>
+#include <stdint.h>
+
+#include "history.h"
+
+/* The number of series that are stacked in the graph */
+#define GRAPH_SERIES 2
+
+/* A scrolling graph of the recent values of the series, stacked. One column
+   of pixels is one value. The columns are drawn into an offscreen surface
+   that is used as a ring: each new column replaces the oldest one at pos,
+   and the surface is painted at an offset so that the graph appears to
+   scroll. Only a change of size, scale or color redraws all the columns */
+typedef struct {
+  GtkWidget *area;
+  GdkRGBA color[GRAPH_SERIES];
+
+  /* The values of the last `width` columns, oldest at pos */
+  uint64_t (*values)[GRAPH_SERIES];
+  int width;
+  int pos;
+
+  /* The maximum of the stacked values over the columns, and the value at
+     the top of the graph, a power of 2 */
+  history peak;
+  uint64_t scale;
+
+  /* The surface and its size, NULL until the area is drawn */
+  cairo_surface_t *surface;
+  int surface_width;
+  int surface_height;
+} graph;
+
+/**
+ * Creates the drawing area of a graph without any value.
+ * @param   g           The object
+ */
+void graph_init(graph *g);
+
+/**
+ * Releases the surface and the values of the graph. The area is left to its
+ * container.
+ * @param   g           The object
+ */
+void graph_free(graph *g);
+
+/**
+ * Sets the colors of the series, from the bottom up.
+ * @param   g           The object
+ * @param   color       GRAPH_SERIES colors
+ */
+void graph_set_colors(graph *g, const GdkRGBA *color);
+
+/**
+ * Adds a column to the right of the graph and draws it.
+ * @param   g           The object
+ * @param   values      GRAPH_SERIES values, from the bottom up
+ */
+void graph_push(graph *g, const uint64_t *values);
+
+#endif /* GRAPH_H */
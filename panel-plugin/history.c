@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* -------------------------------------------------------------------------- */
+static inline int clamp_window(int n) {
+  if (n < 1)
+    return 1;
+  if (n > HISTORY_MAX_WINDOW)
+    return HISTORY_MAX_WINDOW;
+  return n;
+}
+
+/* -------------------------------------------------------------------------- */
+int history_init(history *hist, int smooth, int scale) {
+  memset(hist, 0, sizeof(history));
+  hist->smooth = clamp_window(smooth);
+  hist->scale = clamp_window(scale);
+  hist->length = hist->smooth > hist->scale ? hist->smooth : hist->scale;
+
+  hist->values = calloc(hist->length, sizeof(uint64_t));
+  hist->peaks = malloc(hist->scale * sizeof(history_peak));
+  if (hist->values == NULL || hist->peaks == NULL) {
+    history_free(hist);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void history_free(history *hist) {
+  free(hist->values);
+  free(hist->peaks);
+  memset(hist, 0, sizeof(history));
+}
+
+/* -------------------------------------------------------------------------- */
+void history_reset(history *hist) {
+  if (hist->values != NULL)
+    memset(hist->values, 0, hist->length * sizeof(uint64_t));
+  hist->pos = 0;
+  hist->count = 0;
+  hist->sum = 0;
+  hist->head = 0;
+  hist->npeaks = 0;
+}
+
+/******************************************************************************
+ *
+ * history_push()
+ *
+ * the sum of the smoothing window is updated with the sample that enters it
+ * and the one that leaves it. For the maximum, the peaks that are not larger
+ * than the new sample can never be the maximum again and are dropped from the
+ * back of the deque, and the front is dropped once it leaves the window. Each
+ * sample enters and leaves the deque once, so the cost is amortized O(1)
+ *
+ *****************************************************************************/
+
+void history_push(history *hist, uint64_t value) {
+  int out, back;
+
+  if (hist->values == NULL)
+    return;
+
+  /* The slots of samples that were never pushed hold 0 */
+  out = hist->pos - hist->smooth;
+  if (out < 0)
+    out += hist->length;
+  hist->sum -= hist->values[out];
+  hist->sum += value;
+  hist->values[hist->pos] = value;
+  if (++hist->pos == hist->length)
+    hist->pos = 0;
+
+  while (hist->npeaks > 0) {
+    back = (hist->head + hist->npeaks - 1) % hist->scale;
+    if (hist->peaks[back].value > value)
+      break;
+    hist->npeaks--;
+  }
+  if (hist->npeaks > 0 &&
+      hist->peaks[hist->head].index + hist->scale <= hist->count) {
+    hist->head = (hist->head + 1) % hist->scale;
+    hist->npeaks--;
+  }
+  back = (hist->head + hist->npeaks) % hist->scale;
+  hist->peaks[back].value = value;
+  hist->peaks[back].index = hist->count;
+  hist->npeaks++;
+
+  hist->count++;
+}
+
+/* -------------------------------------------------------------------------- */
+uint64_t history_average(const history *hist) {
+  if (hist->smooth == 0)
+    return 0;
+  return hist->sum / hist->smooth;
+}
+
+/* -------------------------------------------------------------------------- */
+uint64_t history_max(const history *hist) {
+  if (hist->npeaks == 0)
+    return 0;
+  return hist->peaks[hist->head].value;
+}
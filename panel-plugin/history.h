@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+
+/* The longest window of a history, in samples */
+#define HISTORY_MAX_WINDOW 4096
+
+/* An entry of the deque of window maxima: a sample and its number */
+typedef struct {
+  uint64_t value;
+  uint64_t index;
+} history_peak;
+
+/* The recent samples of one metric. The average of the last `smooth`
+   samples and the maximum of the last `scale` samples are both maintained in
+   constant time per sample, whatever the length of the windows. Samples that
+   were never pushed count as 0 */
+typedef struct {
+  /* Ring of the last `length` samples, length = MAX(smooth, scale) */
+  uint64_t *values;
+  int length;
+  int pos;
+  int smooth;
+  int scale;
+  /* The number of samples pushed since the last reset */
+  uint64_t count;
+  /* The sum of the last `smooth` samples */
+  uint64_t sum;
+  /* Ring of at most `scale` peaks in decreasing order of value and
+     increasing order of index. The front is the maximum of the window */
+  history_peak *peaks;
+  int head;
+  int npeaks;
+} history;
+
+/**
+ * Initializes a history. The windows are clamped to 1 ...
+ * HISTORY_MAX_WINDOW.
+ * @param   hist        The object
+ * @param   smooth      The number of samples that are averaged
+ * @param   scale       The number of samples over which the maximum is taken
+ * @return  0 if successful, 1 if memory could not be allocated
+ */
+int history_init(history *hist, int smooth, int scale);
+
+/**
+ * Releases the memory held by the history. It is safe to call
+ * history_init() again afterwards.
+ * @param   hist        The object
+ */
+void history_free(history *hist);
+
+/**
+ * Forgets all the samples.
+ * @param   hist        The object
+ */
+void history_reset(history *hist);
+
+/**
+ * Adds a sample, dropping the oldest one from each window.
+ * @param   hist        The object
+ * @param   value       The sample
+ */
+void history_push(history *hist, uint64_t value);
+
+/**
+ * Returns the average of the last `smooth` samples.
+ * @param   hist        The object
+ * @return  the average, rounded down
+ */
+uint64_t history_average(const history *hist);
+
+/**
+ * Returns the maximum of the last `scale` samples.
+ * @param   hist        The object
+ * @return  the maximum
+ */
+uint64_t history_max(const history *hist);
+
+#endif /* HISTORY_H */
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "hotplug.h"
+
+#include <errno.h>
+#include <linux/netlink.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* The multicast group of the uevents of the kernel. Group 2 is udev's own */
+#define UEVENT_GROUP_KERNEL 1
+
+/* -------------------------------------------------------------------------- */
+void hotplug_init(hotplug *hp) {
+  hp->fd = -1;
+  hp->kind = HOTPLUG_NONE;
+}
+
+/******************************************************************************
+ *
+ * open_netlink()
+ *
+ * open a socket on which the kernel multicasts its uevents. Unprivileged
+ * users may receive them
+ *
+ * returns the fd, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static int open_netlink(void) {
+  struct sockaddr_nl addr;
+  int fd;
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_KOBJECT_UEVENT);
+  if (fd < 0)
+    return -1;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.nl_family = AF_NETLINK;
+  addr.nl_groups = UEVENT_GROUP_KERNEL;
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+static int open_inotify(const char *devdir) {
+  int fd;
+
+  if ((fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+    return -1;
+  if (inotify_add_watch(fd, devdir,
+                        IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM |
+                            IN_ONLYDIR) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+/* -------------------------------------------------------------------------- */
+int hotplug_open(hotplug *hp, const char *devdir) {
+  hotplug_close(hp);
+
+  if ((hp->fd = open_netlink()) >= 0)
+    hp->kind = HOTPLUG_NETLINK;
+  else if ((hp->fd = open_inotify(devdir)) >= 0)
+    hp->kind = HOTPLUG_INOTIFY;
+
+  return hp->fd;
+}
+
+/******************************************************************************
+ *
+ * is_block_uevent()
+ *
+ * check whether a uevent concerns a block device. A uevent is a header
+ * "ACTION@DEVPATH" followed by "KEY=VALUE" pairs, all terminated by a NUL
+ *
+ * returns TRUE if it does, FALSE if not
+ *
+ *****************************************************************************/
+
+static int is_block_uevent(const char *msg, size_t len) {
+  static const char key[] = "SUBSYSTEM=block";
+  const char *p = msg, *end = msg + len;
+  size_t n;
+
+  /* Not from the kernel, whose header always has an '@' */
+  if (memchr(msg, '@', strnlen(msg, len)) == NULL)
+    return 0;
+
+  while (p < end) {
+    n = strnlen(p, end - p);
+    if (n == sizeof(key) - 1 && memcmp(p, key, n) == 0)
+      return 1;
+    p += n + 1;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int read_netlink(hotplug *hp) {
+  ssize_t len;
+  int events = 0;
+
+  while ((len = recv(hp->fd, hp->buf, sizeof(hp->buf), MSG_DONTWAIT)) != 0) {
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      /* The socket overflowed and events were lost, so assume one */
+      if (errno == ENOBUFS) {
+        events++;
+        continue;
+      }
+      return errno == EAGAIN || errno == EWOULDBLOCK ? events : -1;
+    }
+    if (is_block_uevent(hp->buf, len))
+      events++;
+  }
+
+  return events;
+}
+
+/******************************************************************************
+ *
+ * read_inotify()
+ *
+ * take the pending events of the device directory. Nodes of all kinds come
+ * and go there, but rarely, so any of them counts as an event
+ *
+ * returns the number of events, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static int read_inotify(hotplug *hp) {
+  const struct inotify_event *ev;
+  ssize_t len;
+  char *p;
+  int events = 0;
+
+  while ((len = read(hp->fd, hp->buf, sizeof(hp->buf))) != 0) {
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN ? events : -1;
+    }
+    for (p = hp->buf; p < hp->buf + len; p += sizeof(*ev) + ev->len) {
+      ev = (const struct inotify_event *)p;
+      /* The directory itself went away */
+      if (ev->mask & IN_IGNORED)
+        return -1;
+      events++;
+    }
+  }
+
+  return events;
+}
+
+/* -------------------------------------------------------------------------- */
+int hotplug_read(hotplug *hp) {
+  switch (hp->kind) {
+  case HOTPLUG_NETLINK:
+    return read_netlink(hp);
+  case HOTPLUG_INOTIFY:
+    return read_inotify(hp);
+  default:
+    return -1;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+void hotplug_close(hotplug *hp) {
+  if (hp->fd >= 0)
+    close(hp->fd);
+  hotplug_init(hp);
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef HOTPLUG_H
+#define HOTPLUG_H
+
+/* The directory that the fallback watches. devtmpfs creates and removes a
+   node there for every block device, while sysfs does not report new
+   devices to inotify */
+#define HOTPLUG_DEVDIR "/dev"
+
+/* The size of the receive buffer. A uevent is at most 2048 bytes, and
+   inotify events of /dev are much shorter */
+#define HOTPLUG_BUFSIZE 8192
+
+/* Where the events come from */
+typedef enum {
+  HOTPLUG_NONE,
+  /* The uevents of the kernel, on a netlink socket */
+  HOTPLUG_NETLINK,
+  /* The creation and removal of device nodes, through inotify */
+  HOTPLUG_INOTIFY
+} hotplug_kind;
+
+/* A source of events that tells when block devices appear, disappear or
+   change, so that the devices do not have to be looked for on every update */
+typedef struct {
+  /* Non-blocking, to be polled for POLLIN, -1 if closed */
+  int fd;
+  hotplug_kind kind;
+  char buf[HOTPLUG_BUFSIZE];
+} hotplug;
+
+/**
+ * Initializes a closed object.
+ * @param   hp          The object
+ */
+void hotplug_init(hotplug *hp);
+
+/**
+ * Opens the source of events. The uevents of the kernel are preferred. If
+ * the netlink socket cannot be bound, e.g. in a network namespace of its
+ * own, the device nodes of a directory are watched instead.
+ * @param   hp          The object
+ * @param   devdir      The directory of the device nodes, usually
+ *                      HOTPLUG_DEVDIR
+ * @return  the fd to be polled for POLLIN, or -1 in case of error
+ */
+int hotplug_open(hotplug *hp, const char *devdir);
+
+/**
+ * Takes all the pending events without blocking.
+ * @param   hp          The object
+ * @return  the number of events that concern block devices, or -1 if the
+ *          source failed and must be closed
+ */
+int hotplug_read(hotplug *hp);
+
+/**
+ * Closes the source of events.
+ * @param   hp          The object
+ */
+void hotplug_close(hotplug *hp);
+
+#endif /* HOTPLUG_H */
@@ -0,0 +1,333 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "mounts.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------- */
+void mounts_init(mount_table *mt) {
+  memset(mt, 0, sizeof(mount_table));
+  mt->fd = -1;
+}
+
+/* -------------------------------------------------------------------------- */
+int mounts_open(mount_table *mt, const char *procfs) {
+  char path[PATH_MAX];
+
+  mounts_close(mt);
+
+  snprintf(path, PATH_MAX, "%s/%s", procfs, PATH_MOUNTINFO);
+  if ((mt->fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return -1;
+  if (mounts_read(mt) != 0) {
+    mounts_close(mt);
+    return -1;
+  }
+
+  return mt->fd;
+}
+
+/******************************************************************************
+ *
+ * read_all()
+ *
+ * read the whole of mountinfo into the buffer, which grows as needed. The
+ * file is generated as it is read, so it has no size to go by
+ *
+ * returns the number of bytes read, or -1 in case of error
+ *
+ *****************************************************************************/
+
+static ssize_t read_all(mount_table *mt) {
+  size_t len = 0;
+  ssize_t n;
+  char *buf;
+
+  if (lseek(mt->fd, 0, SEEK_SET) != 0)
+    return -1;
+
+  for (;;) {
+    if (mt->bufsize - len < 2) {
+      buf = realloc(mt->buf, mt->bufsize > 0 ? mt->bufsize * 2
+                                             : MOUNTS_BUFSIZE);
+      if (buf == NULL)
+        return -1;
+      mt->buf = buf;
+      mt->bufsize = mt->bufsize > 0 ? mt->bufsize * 2 : MOUNTS_BUFSIZE;
+    }
+    if ((n = read(mt->fd, mt->buf + len, mt->bufsize - len - 1)) < 0)
+      return -1;
+    if (n == 0)
+      break;
+    len += n;
+  }
+  mt->buf[len] = '\0';
+
+  return len;
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int is_octal(char c) { return c >= '0' && c <= '7'; }
+
+/******************************************************************************
+ *
+ * unescape()
+ *
+ * undo in place the escapes of the kernel, which writes spaces, tabs,
+ * newlines and backslashes in paths as \ooo
+ *
+ *****************************************************************************/
+
+static void unescape(char *s) {
+  char *d = s;
+
+  for (; *s; s++, d++) {
+    if (s[0] == '\\' && is_octal(s[1]) && is_octal(s[2]) && is_octal(s[3])) {
+      *d = (s[1] - '0') << 6 | (s[2] - '0') << 3 | (s[3] - '0');
+      s += 3;
+    } else {
+      *d = *s;
+    }
+  }
+  *d = '\0';
+}
+
+/* -------------------------------------------------------------------------- */
+static char *next_field(char **p) {
+  char *field = *p;
+
+  if (field == NULL || *field == '\0')
+    return NULL;
+  *p = strchr(field, ' ');
+  if (*p != NULL)
+    *(*p)++ = '\0';
+  return field;
+}
+
+/******************************************************************************
+ *
+ * parse_line()
+ *
+ * parse a line of mountinfo, which has been cut at its end:
+ *   id parent major:minor root point options [optional...] - fstype source
+ *   superoptions
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int parse_line(char *line, mount_entry *entry) {
+  char *p = line, *field;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    if (next_field(&p) == NULL)
+      return 1;
+  }
+  if ((field = next_field(&p)) == NULL ||
+      sscanf(field, "%u:%u", &entry->major, &entry->minor) != 2)
+    return 1;
+  if (next_field(&p) == NULL || (field = next_field(&p)) == NULL)
+    return 1;
+  unescape(field);
+  entry->point = field;
+
+  /* The options, and the optional fields up to the separator */
+  do {
+    if ((field = next_field(&p)) == NULL)
+      return 1;
+  } while (strcmp(field, "-") != 0);
+
+  if ((field = next_field(&p)) == NULL)
+    return 1;
+  entry->fstype = field;
+  if ((field = next_field(&p)) == NULL)
+    return 1;
+  unescape(field);
+  entry->source = field;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int mounts_read(mount_table *mt) {
+  mount_entry *entries;
+  char *line, *end;
+  ssize_t len;
+  int capacity;
+
+  mt->nentries = 0;
+  if ((len = read_all(mt)) < 0)
+    return 1;
+
+  for (line = mt->buf; line < mt->buf + len; line = end + 1) {
+    if ((end = strchr(line, '\n')) == NULL)
+      end = mt->buf + len;
+    *end = '\0';
+
+    if (mt->nentries == mt->capacity) {
+      capacity = mt->capacity > 0 ? mt->capacity * 2 : 64;
+      entries = realloc(mt->entries, capacity * sizeof(mount_entry));
+      if (entries == NULL)
+        return 1;
+      mt->entries = entries;
+      mt->capacity = capacity;
+    }
+    if (parse_line(line, &mt->entries[mt->nentries]) == 0)
+      mt->nentries++;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int mounts_refresh(mount_table *mt) {
+  struct pollfd pfd = {mt->fd, POLLPRI, 0};
+
+  if (mt->fd < 0 || poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLPRI))
+    return 0;
+  mounts_read(mt);
+  return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+const mount_entry *mounts_find(const mount_table *mt, const char *path) {
+  const mount_entry *best = NULL;
+  size_t len, best_len = 0;
+  int i;
+
+  /* The last of the mounts on the same point hides the others */
+  for (i = 0; i < mt->nentries; i++) {
+    len = strlen(mt->entries[i].point);
+    if (strncmp(path, mt->entries[i].point, len) != 0 ||
+        (len > 1 && path[len] != '/' && path[len] != '\0'))
+      continue;
+    if (best == NULL || len >= best_len) {
+      best = &mt->entries[i];
+      best_len = len;
+    }
+  }
+
+  return best;
+}
+
+/******************************************************************************
+ *
+ * device_name()
+ *
+ * find the name of a block device from its number, through the link that
+ * sysfs has for every device in /sys/dev/block
+ *
+ * returns 0 if successful, 1 if there is no such block device
+ *
+ *****************************************************************************/
+
+static int device_name(const char *sysfs, unsigned int major,
+                       unsigned int minor, char *name, size_t size) {
+  char path[PATH_MAX], link[PATH_MAX];
+  const char *base;
+  ssize_t len;
+
+  if (major == 0)
+    return 1;
+
+  snprintf(path, PATH_MAX, "%s/dev/block/%u:%u", sysfs, major, minor);
+  if ((len = readlink(path, link, sizeof(link) - 1)) <= 0)
+    return 1;
+  link[len] = '\0';
+
+  base = strrchr(link, '/');
+  snprintf(name, size, "%s", base != NULL ? base + 1 : link);
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int mounts_resolve(const mount_table *mt, const char *sysfs, const char *path,
+                   char *name, size_t size) {
+  char real[PATH_MAX];
+  const mount_entry *entry = NULL;
+  struct stat st;
+  int i;
+
+  if (stat(path, &st) != 0)
+    return 1;
+  if (device_name(sysfs, major(st.st_dev), minor(st.st_dev), name, size) == 0)
+    return 0;
+  if (mt == NULL)
+    return 1;
+
+  /* An anonymous device. Its mount tells where the filesystem is from,
+     e.g. the disk of a btrfs subvolume */
+  for (i = mt->nentries - 1; i >= 0 && entry == NULL; i--) {
+    if (mt->entries[i].major == major(st.st_dev) &&
+        mt->entries[i].minor == minor(st.st_dev))
+      entry = &mt->entries[i];
+  }
+  if (entry == NULL && realpath(path, real) != NULL)
+    entry = mounts_find(mt, real);
+
+  if (entry == NULL || entry->source[0] != '/' ||
+      stat(entry->source, &st) != 0 || !S_ISBLK(st.st_mode))
+    return 1;
+  return device_name(sysfs, major(st.st_rdev), minor(st.st_rdev), name, size);
+}
+
+/* -------------------------------------------------------------------------- */
+int mounts_usage(const char *path, mount_usage *usage) {
+  struct statvfs vfs;
+  uint64_t used;
+
+  if (statvfs(path, &vfs) != 0)
+    return 1;
+
+  usage->size = (uint64_t)vfs.f_blocks * vfs.f_frsize;
+  usage->avail = (uint64_t)vfs.f_bavail * vfs.f_frsize;
+  used = (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+  /* As df, the space reserved for root is not part of the size */
+  usage->used = used + usage->avail > 0
+                    ? 100.0 * used / (used + usage->avail)
+                    : 0;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void mounts_close(mount_table *mt) {
+  if (mt->fd >= 0)
+    close(mt->fd);
+  free(mt->buf);
+  free(mt->entries);
+  mounts_init(mt);
+}
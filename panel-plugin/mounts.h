@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef MOUNTS_H
+#define MOUNTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Relative to the root of procfs */
+#define PATH_MOUNTINFO "self/mountinfo"
+
+/* The initial size of the buffer for mountinfo. It grows as needed */
+#define MOUNTS_BUFSIZE 16384
+
+/* A line of mountinfo. The strings point into the buffer of the table, and
+   the octal escapes of the kernel are undone */
+typedef struct {
+  /* The device of the filesystem, as in st_dev. It is anonymous, with a
+     major number of 0, for filesystems such as btrfs and overlayfs */
+  unsigned int major;
+  unsigned int minor;
+  const char *point;
+  const char *fstype;
+  const char *source;
+} mount_entry;
+
+/* The mounts of the process, parsed from /proc/self/mountinfo. The file is
+   kept open: the kernel flags it with POLLPRI when a filesystem is mounted
+   or unmounted, so that it only needs to be parsed again then */
+typedef struct {
+  /* To be polled for POLLPRI, -1 if closed */
+  int fd;
+  char *buf;
+  size_t bufsize;
+  mount_entry *entries;
+  int nentries;
+  int capacity;
+} mount_table;
+
+/* The space of a filesystem, from statvfs() */
+typedef struct {
+  /* In bytes, for unprivileged users */
+  uint64_t size;
+  uint64_t avail;
+  /* The share of the size that is used, in % */
+  double used;
+} mount_usage;
+
+/**
+ * Initializes a closed table.
+ * @param   mt          The object
+ */
+void mounts_init(mount_table *mt);
+
+/**
+ * Opens and parses the mountinfo of the process.
+ * @param   mt          The object
+ * @param   procfs      The root of procfs, usually /proc
+ * @return  the fd to be polled for POLLPRI, or -1 in case of error
+ */
+int mounts_open(mount_table *mt, const char *procfs);
+
+/**
+ * Parses mountinfo again.
+ * @param   mt          The object
+ * @return  0 if successful, 1 in case of error
+ */
+int mounts_read(mount_table *mt);
+
+/**
+ * Parses mountinfo again if the mounts changed since the last call, without
+ * blocking. It must not be used while the fd is polled by someone else,
+ * who would take the change.
+ * @param   mt          The object
+ * @return  TRUE if the mounts changed, FALSE if not
+ */
+int mounts_refresh(mount_table *mt);
+
+/**
+ * Finds the mount that holds a path, from the longest mount point that
+ * contains it. The path should be absolute and canonical.
+ * @param   mt          The object
+ * @param   path        The path
+ * @return  the mount, or NULL if there is none
+ */
+const mount_entry *mounts_find(const mount_table *mt, const char *path);
+
+/**
+ * Finds the block device under a path: the device of the filesystem, or if
+ * it is anonymous, the block device that its mount was made from.
+ * @param   mt          The table, or NULL to only use the device of the
+ *                      filesystem
+ * @param   sysfs       The root of sysfs, usually /sys
+ * @param   path        The path, e.g. a mount point or a file under one
+ * @param   name        Receives the name of the device, e.g. dm-3
+ * @param   size        The size of name
+ * @return  0 if successful, 1 if there is no block device under the path
+ */
+int mounts_resolve(const mount_table *mt, const char *sysfs, const char *path,
+                   char *name, size_t size);
+
+/**
+ * Gets the space of the filesystem of a path.
+ * @param   path        The path
+ * @param   usage       Receives the space
+ * @return  0 if successful, 1 in case of error
+ */
+int mounts_usage(const char *path, mount_usage *usage);
+
+/**
+ * Closes the table.
+ * @param   mt          The object
+ */
+void mounts_close(mount_table *mt);
+
+#endif /* MOUNTS_H */
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "nfs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+
+/* The magic number of NFS in statfs() */
+#define NFS_SUPER_MAGIC 0x6969
+
+/* -------------------------------------------------------------------------- */
+void nfs_init(nfs_source *src) {
+  memset(src, 0, sizeof(nfs_source));
+  src->fd = -1;
+}
+
+/* -------------------------------------------------------------------------- */
+int nfs_find(const mount_table *mt, const char *path, char *point,
+             size_t size) {
+  char real[PATH_MAX];
+  const mount_entry *entry;
+  struct statfs fs;
+
+  if (statfs(path, &fs) != 0 || fs.f_type != NFS_SUPER_MAGIC ||
+      realpath(path, real) == NULL)
+    return 1;
+
+  if (mt != NULL && (entry = mounts_find(mt, real)) != NULL &&
+      strncmp(entry->fstype, "nfs", 3) == 0)
+    snprintf(point, size, "%s", entry->point);
+  else
+    snprintf(point, size, "%s", real);
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * escape()
+ *
+ * escape a path as the kernel does in mountstats, which writes spaces, tabs,
+ * newlines and backslashes as \ooo. The selected mounts are escaped once, so
+ * that their sections are found without unescaping the file
+ *
+ *****************************************************************************/
+
+static void escape(char *dst, size_t size, const char *src) {
+  size_t len = 0;
+
+  for (; *src && len + 5 < size; src++) {
+    if (strchr(" \t\n\\", *src) != NULL)
+      len += sprintf(dst + len, "\\%03o", (unsigned char)*src);
+    else
+      dst[len++] = *src;
+  }
+  dst[len] = '\0';
+}
+
+/* -------------------------------------------------------------------------- */
+int nfs_add(nfs_source *src, const char *procfs, const char *point) {
+  nfs_mount *mounts;
+
+  mounts = realloc(src->mounts, (src->nmounts + 1) * sizeof(nfs_mount));
+  if (mounts == NULL)
+    return -1;
+  src->mounts = mounts;
+
+  if (src->nmounts == 0) {
+    snprintf(src->path, PATH_MAX, "%s/%s", procfs, PATH_MOUNTSTATS);
+    if ((src->fd = open(src->path, O_RDONLY | O_CLOEXEC)) < 0)
+      return -1;
+  }
+
+  memset(&mounts[src->nmounts], 0, sizeof(nfs_mount));
+  escape(mounts[src->nmounts].point, PATH_MAX, point);
+
+  return src->nmounts++;
+}
+
+/******************************************************************************
+ *
+ * read_more()
+ *
+ * append the next chunk of mountstats to the first len bytes of the buffer,
+ * which grows as needed and is kept for the next read
+ *
+ * returns the number of bytes read, 0 at the end of the file, or -1 in case
+ * of error
+ *
+ *****************************************************************************/
+
+static ssize_t read_more(nfs_source *src, size_t len) {
+  size_t size;
+  ssize_t n;
+  char *buf;
+
+  if (src->bufsize - len < 2) {
+    size = src->bufsize > 0 ? src->bufsize * 2 : NFS_BUFSIZE;
+    if ((buf = realloc(src->buf, size)) == NULL)
+      return -1;
+    src->buf = buf;
+    src->bufsize = size;
+  }
+  if ((n = read(src->fd, src->buf + len, src->bufsize - len - 1)) < 0)
+    return -1;
+  src->buf[len + n] = '\0';
+
+  return n;
+}
+
+/* -------------------------------------------------------------------------- */
+static nfs_mount *find_mount(nfs_source *src, const char *point,
+                             size_t len) {
+  int i;
+
+  for (i = 0; i < src->nmounts; i++) {
+    if (strncmp(src->mounts[i].point, point, len) == 0 &&
+        src->mounts[i].point[len] == '\0')
+      return &src->mounts[i];
+  }
+  return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+static void parse_numbers(const char *p, uint64_t *values, int n) {
+  char *end;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    values[i] = strtoull(p, &end, 10);
+    if (end == p)
+      break;
+    p = end;
+  }
+  for (; i < n; i++)
+    values[i] = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static const char *find_text(const char *p, const char *end, const char *text,
+                             size_t len) {
+  for (; p < end && (size_t)(end - p) >= len &&
+         (p = memchr(p, text[0], end - p - len + 1)) != NULL;
+       p++) {
+    if (memcmp(p, text, len) == 0)
+      return p;
+  }
+  return NULL;
+}
+
+/******************************************************************************
+ *
+ * parse_section()
+ *
+ * parse the section of a selected mount, up to the start of the next one.
+ * The bytes line has the bytes read and written by the server in its 5th
+ * and 6th fields. The line of an operation has its count, transmissions,
+ * timeouts, bytes sent and received, and queue, round trip and execute
+ * times in ms
+ *
+ *****************************************************************************/
+
+static void parse_section(nfs_mount *mount, const char *start,
+                          const char *end) {
+  static const char *const ops[NFS_NOPS] = {" READ: ", " WRITE: "};
+  static const int ios[NFS_NOPS] = {STAT_RD_IOS, STAT_WR_IOS};
+  static const int ticks[NFS_NOPS] = {STAT_RD_TICKS, STAT_WR_TICKS};
+  uint64_t bytes[8], op[8];
+  const char *p;
+  uint64_t d;
+  int o;
+
+  memset(&mount->stat, 0, sizeof(diskstat));
+  mount->stat.nfields = STAT_MIN_FIELDS;
+
+  if ((p = find_text(start, end, "\tbytes:\t", 8)) != NULL) {
+    parse_numbers(p + 8, bytes, 8);
+    mount->stat.field[STAT_RD_SECTORS] = bytes[4] / 512;
+    mount->stat.field[STAT_WR_SECTORS] = bytes[5] / 512;
+  }
+
+  for (o = 0; o < NFS_NOPS; o++) {
+    if ((p = find_text(start, end, ops[o], strlen(ops[o]))) == NULL)
+      continue;
+    parse_numbers(p + strlen(ops[o]), op, 8);
+    mount->stat.field[ios[o]] = op[0];
+    mount->stat.field[ticks[o]] = op[7];
+    /* The requests in progress on average, as the queue of a disk */
+    mount->stat.field[STAT_TIME_IN_QUEUE] += op[7];
+
+    d = op[0] - mount->ops[o];
+    mount->rtt[o] = op[0] > mount->ops[o] && op[6] >= mount->rtt_total[o]
+                        ? (double)(op[6] - mount->rtt_total[o]) / d
+                        : 0;
+    mount->ops[o] = op[0];
+    mount->rtt_total[o] = op[6];
+  }
+}
+
+/******************************************************************************
+ *
+ * parse_sections()
+ *
+ * parse the sections that were read completely since the last call,
+ * starting at the offset *start, which is moved past them. A section is
+ * complete once the next one has started, or at the end of the file. Each
+ * section starts with a line
+ * "device <source> mounted on <point> with fstype <type> ..."
+ *
+ * returns the number of selected mounts that are still to be found
+ *
+ *****************************************************************************/
+
+static int parse_sections(nfs_source *src, size_t *start, size_t len,
+                          int eof, int left) {
+  static const char device[] = "device ", on[] = " mounted on ",
+                    with[] = " with fstype ";
+  const char *p, *point, *end = src->buf + len, *next;
+  nfs_mount *mount;
+
+  while (left > 0 && *start < len) {
+    p = src->buf + *start;
+    next = find_text(p + 1, end, "\ndevice ", 8);
+    if (next == NULL && !eof)
+      break;
+    if (next != NULL)
+      next++;
+    *start = next != NULL ? (size_t)(next - src->buf) : len;
+
+    if (strncmp(p, device, sizeof(device) - 1) != 0)
+      continue;
+
+    /* The source has no blank, as the kernel escapes them */
+    if ((point = strstr(p, on)) == NULL || (next != NULL && point > next))
+      continue;
+    point += sizeof(on) - 1;
+    if ((p = strstr(point, with)) == NULL)
+      continue;
+    if ((mount = find_mount(src, point, p - point)) == NULL || mount->found)
+      continue;
+
+    parse_section(mount, p, next != NULL ? next : end);
+    mount->found = 1;
+    left--;
+  }
+
+  return left;
+}
+
+/* -------------------------------------------------------------------------- */
+int nfs_read(nfs_source *src) {
+  size_t len = 0, start = 0;
+  ssize_t n = 1;
+  int i, left = src->nmounts;
+
+  for (i = 0; i < src->nmounts; i++)
+    src->mounts[i].found = 0;
+  if (src->nmounts == 0 || lseek(src->fd, 0, SEEK_SET) != 0)
+    return 1;
+
+  /* The sections are parsed as they arrive, and the rest of the file is
+     not read once every selected mount was found */
+  while (left > 0 && n > 0) {
+    if ((n = read_more(src, len)) < 0)
+      return 1;
+    len += n;
+    left = parse_sections(src, &start, len, n == 0, left);
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void nfs_close(nfs_source *src) {
+  if (src->nmounts > 0)
+    close(src->fd);
+  free(src->buf);
+  free(src->mounts);
+  nfs_init(src);
+}
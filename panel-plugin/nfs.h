@@ -0,0 +1,115 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef NFS_H
+#define NFS_H
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "diskstats.h"
+#include "mounts.h"
+
+/* Relative to the root of procfs */
+#define PATH_MOUNTSTATS "self/mountstats"
+
+/* The initial size of the buffer for mountstats. It grows as needed */
+#define NFS_BUFSIZE 65536
+
+/* The operations whose round trip time is kept */
+enum { NFS_READ, NFS_WRITE, NFS_NOPS };
+
+/* A selected NFS mount */
+typedef struct {
+  /* The mount point, escaped as in mountstats */
+  char point[PATH_MAX];
+  /* TRUE if the mount was in the last read */
+  int found;
+  /* The counters of the mount as those of a block device. The bytes of the
+     READ and WRITE operations are in sectors of 512 bytes, and the execute
+     time of the operations stands for the time of the requests. Fields
+     without an equivalent are 0 */
+  diskstat stat;
+  /* The total number of READ and WRITE operations and their total round
+     trip time in ms, and the average round trip time over the last two
+     reads, in ms */
+  uint64_t ops[NFS_NOPS];
+  uint64_t rtt_total[NFS_NOPS];
+  double rtt[NFS_NOPS];
+} nfs_mount;
+
+/* The NFS mounts of a set, read from /proc/self/mountstats. The file is
+   kept open and read into the same buffer every time. It has a long
+   section for every NFS mount of the system, so the sections of the
+   mounts that are not selected are skipped without being parsed. The
+   sections are parsed as they are read, and the read stops once every
+   selected mount was found. The file is open as long as there are mounts,
+   so that a zeroed source is closed */
+typedef struct {
+  char path[PATH_MAX];
+  int fd;
+  char *buf;
+  size_t bufsize;
+  nfs_mount *mounts;
+  int nmounts;
+} nfs_source;
+
+/**
+ * Initializes a closed source.
+ * @param   src         The object
+ */
+void nfs_init(nfs_source *src);
+
+/**
+ * Finds the NFS mount that holds a path.
+ * @param   mt          The table of the mounts, or NULL to take the path as
+ *                      the mount point
+ * @param   path        The path
+ * @param   point       Receives the mount point
+ * @param   size        The size of point
+ * @return  0 if successful, 1 if the path is not on NFS
+ */
+int nfs_find(const mount_table *mt, const char *path, char *point,
+             size_t size);
+
+/**
+ * Selects a mount. The file is opened with the first one.
+ * @param   src         The object
+ * @param   procfs      The root of procfs, usually /proc
+ * @param   point       The mount point, see nfs_find()
+ * @return  the index of the mount, or -1 in case of error
+ */
+int nfs_add(nfs_source *src, const char *procfs, const char *point);
+
+/**
+ * Reads the counters of the selected mounts.
+ * @param   src         The object
+ * @return  0 if successful, 1 in case of error
+ */
+int nfs_read(nfs_source *src);
+
+/**
+ * Closes the file and forgets the mounts.
+ * @param   src         The object. It must be initialized or zeroed
+ */
+void nfs_close(nfs_source *src);
+
+#endif /* NFS_H */
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "output.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+static char output[OUTPUT_BUFSIZE];
+static size_t output_len;
+
+/******************************************************************************
+ *
+ * flush_output()
+ *
+ * write the buffer to stdout, retrying on short writes
+ *
+ * returns 0 if successful, 1 in case of error, e.g. if the reader is gone
+ *
+ *****************************************************************************/
+
+int flush_output(void) {
+  size_t done = 0;
+  ssize_t len;
+
+  while (done < output_len) {
+    len = write(STDOUT_FILENO, output + done, output_len - done);
+    if (len < 0 && errno == EINTR)
+      continue;
+    if (len <= 0)
+      return 1;
+    done += len;
+  }
+  output_len = 0;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void put_char(char c) { output[output_len++] = c; }
+
+/* -------------------------------------------------------------------------- */
+void put_string(const char *s) {
+  size_t len = strlen(s);
+
+  if (len > OUTPUT_MARGIN)
+    len = OUTPUT_MARGIN;
+  memcpy(output + output_len, s, len);
+  output_len += len;
+}
+
+/* -------------------------------------------------------------------------- */
+void put_uint(uint64_t value) {
+  char digits[20];
+  int n = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0)
+    put_char(digits[--n]);
+}
+
+/******************************************************************************
+ *
+ * put_fixed()
+ *
+ * write a non-negative value with two decimals. The point does not depend on
+ * the locale, so that the output can be parsed anywhere
+ *
+ *****************************************************************************/
+
+void put_fixed(double value) {
+  uint64_t hundredths = value > 0 ? (uint64_t)(value * 100 + 0.5) : 0;
+
+  put_uint(hundredths / 100);
+  put_char('.');
+  put_char('0' + hundredths / 10 % 10);
+  put_char('0' + hundredths % 10);
+}
+
+/* -------------------------------------------------------------------------- */
+void put_padded(const char *s, int width, int left) {
+  int len = strlen(s);
+
+  if (len > OUTPUT_MARGIN / 2)
+    len = OUTPUT_MARGIN / 2;
+  if (left)
+    put_string(s);
+  for (; len < width; len++)
+    put_char(' ');
+  if (!left)
+    put_string(s);
+}
+
+/* -------------------------------------------------------------------------- */
+void put_json_string(const char *s) {
+  put_char('"');
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      put_char('\\');
+    if ((unsigned char)*s >= ' ')
+      put_char(*s);
+  }
+  put_char('"');
+}
+
+/* -------------------------------------------------------------------------- */
+int reserve_output(void) {
+  if (output_len + OUTPUT_MARGIN > OUTPUT_BUFSIZE)
+    return flush_output();
+  return 0;
+}
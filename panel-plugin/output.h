@@ -0,0 +1,87 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stdint.h>
+
+/* The output of the command line tool is built in a static buffer, so that
+   printing allocates nothing, and is written to stdout with a single write()
+   per tick. Numbers are formatted by hand and do not depend on the locale */
+#define OUTPUT_BUFSIZE 65536
+
+/* The most that a caller may append after reserve_output(). Strings are
+   truncated to it */
+#define OUTPUT_MARGIN 256
+
+/**
+ * Writes the buffer to stdout, retrying on short writes.
+ * @return  0 if successful, 1 in case of error, e.g. if the reader is gone
+ */
+int flush_output(void);
+
+/**
+ * Makes room for OUTPUT_MARGIN more characters, writing the buffer out if
+ * needed.
+ * @return  0 if successful, 1 in case of error
+ */
+int reserve_output(void);
+
+/**
+ * Appends a character.
+ * @param   c           The character
+ */
+void put_char(char c);
+
+/**
+ * Appends a string.
+ * @param   s           The string
+ */
+void put_string(const char *s);
+
+/**
+ * Appends a string padded with blanks to a width.
+ * @param   s           The string
+ * @param   width       The width
+ * @param   left        Whether the string is aligned to the left
+ */
+void put_padded(const char *s, int width, int left);
+
+/**
+ * Appends an unsigned integer.
+ * @param   value       The value
+ */
+void put_uint(uint64_t value);
+
+/**
+ * Appends a non-negative value with two decimals. Negative values are
+ * written as 0.00.
+ * @param   value       The value
+ */
+void put_fixed(double value);
+
+/**
+ * Appends a string as a JSON string, quoted and escaped.
+ * @param   s           The string
+ */
+void put_json_string(const char *s);
+
+#endif /* OUTPUT_H */
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "pressure.h"
+#include "disk.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/* -------------------------------------------------------------------------- */
+void pressure_init(pressure *psi) {
+  memset(psi, 0, sizeof(pressure));
+  psi->fd = -1;
+  psi->trigger_fd = -1;
+}
+
+/******************************************************************************
+ *
+ * parse_value()
+ *
+ * parse a decimal number such as 12.34. The kernel always uses a dot, so
+ * strtod(), which follows the locale of the panel, cannot be used
+ *
+ * returns the value
+ *
+ *****************************************************************************/
+
+static double parse_value(const char **pp, const char *end) {
+  const char *p = *pp;
+  double value = 0, scale = 1;
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    value = value * 10 + (*p - '0');
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      scale /= 10;
+      value += (*p - '0') * scale;
+    }
+  }
+
+  *pp = p;
+  return value;
+}
+
+/******************************************************************************
+ *
+ * parse_line()
+ *
+ * parse the fields of a line such as
+ * some avg10=0.12 avg60=0.05 avg300=0.01 total=123456
+ * Unknown fields are skipped, so that the kernel can add some
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int parse_line(const char **pp, const char *end, pressure_line *line) {
+  const char *p = *pp, *key;
+  size_t len;
+  int found = 0;
+
+  memset(line, 0, sizeof(pressure_line));
+  while (p < end && *p != '\n') {
+    while (p < end && *p == ' ')
+      p++;
+    key = p;
+    while (p < end && *p != '=' && *p != ' ' && *p != '\n')
+      p++;
+    len = p - key;
+    if (p == end || *p != '=')
+      continue;
+    p++;
+
+    if (len == 5 && memcmp(key, "avg10", 5) == 0) {
+      line->avg10 = parse_value(&p, end);
+      found++;
+    } else if (len == 5 && memcmp(key, "avg60", 5) == 0) {
+      line->avg60 = parse_value(&p, end);
+    } else if (len == 6 && memcmp(key, "avg300", 6) == 0) {
+      line->avg300 = parse_value(&p, end);
+    } else if (len == 5 && memcmp(key, "total", 5) == 0) {
+      for (; p < end && *p >= '0' && *p <= '9'; p++)
+        line->total = line->total * 10 + (*p - '0');
+      found++;
+    }
+    while (p < end && *p != ' ' && *p != '\n')
+      p++;
+  }
+
+  *pp = p < end ? p + 1 : p;
+  return found == 2 ? 0 : 1;
+}
+
+/* -------------------------------------------------------------------------- */
+static int open_pressure(int flags) {
+  char path[PATH_MAX];
+
+  if (snprintf(path, PATH_MAX, "%s/%s", get_procfs_root(), PATH_PRESSURE_IO) >=
+      PATH_MAX)
+    return -1;
+  return open(path, flags);
+}
+
+/* -------------------------------------------------------------------------- */
+int pressure_read(pressure *psi) {
+  char buf[256];
+  const char *p, *end;
+  ssize_t len;
+  int some = 1, full = 1;
+
+  if (psi->fd < 0 &&
+      (psi->fd = open_pressure(O_RDONLY | O_CLOEXEC)) < 0) {
+    psi->avail = 0;
+    return 1;
+  }
+
+  if ((len = pread(psi->fd, buf, sizeof(buf), 0)) <= 0) {
+    psi->avail = 0;
+    return 1;
+  }
+
+  p = buf;
+  end = buf + len;
+  while (p < end) {
+    if (end - p > 5 && memcmp(p, "some ", 5) == 0) {
+      p += 5;
+      some = parse_line(&p, end, &psi->some);
+    } else if (end - p > 5 && memcmp(p, "full ", 5) == 0) {
+      p += 5;
+      full = parse_line(&p, end, &psi->full);
+    } else {
+      while (p < end && *p++ != '\n')
+        ;
+    }
+  }
+
+  /* Before Linux 5.13, there may be no full line */
+  if (full)
+    memset(&psi->full, 0, sizeof(pressure_line));
+  psi->avail = some == 0;
+  return some;
+}
+
+/* -------------------------------------------------------------------------- */
+int pressure_trigger(pressure *psi, int percent) {
+  char buf[64];
+  int len;
+
+  if (psi->trigger_fd >= 0) {
+    close(psi->trigger_fd);
+    psi->trigger_fd = -1;
+  }
+  if (percent < 1 || percent > 100)
+    return -1;
+
+  if ((psi->trigger_fd = open_pressure(O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0)
+    return -1;
+
+  /* The trigger lives as long as the fd */
+  len = snprintf(buf, sizeof(buf), "some %d %d",
+                 PRESSURE_WINDOW / 100 * percent, PRESSURE_WINDOW);
+  if (write(psi->trigger_fd, buf, len + 1) < 0) {
+    close(psi->trigger_fd);
+    psi->trigger_fd = -1;
+  }
+
+  return psi->trigger_fd;
+}
+
+/* -------------------------------------------------------------------------- */
+void pressure_close(pressure *psi) {
+  if (psi->fd >= 0)
+    close(psi->fd);
+  if (psi->trigger_fd >= 0)
+    close(psi->trigger_fd);
+  pressure_init(psi);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef PRESSURE_H
+#define PRESSURE_H
+
+#include <stdint.h>
+
+/* The pressure stall information of the block layer, relative to the root
+   of procfs */
+#define PATH_PRESSURE_IO "pressure/io"
+
+/* The window over which the trigger measures the stall, in us. The kernel
+   only accepts windows that are multiples of 2 s from unprivileged users */
+#define PRESSURE_WINDOW 2000000
+
+/* One line of the pressure file */
+typedef struct {
+  /* The share of the time in %, averaged over 10, 60 and 300 s */
+  double avg10;
+  double avg60;
+  double avg300;
+  /* The total stall time in us */
+  uint64_t total;
+} pressure_line;
+
+typedef struct {
+  /* Kept open to be read with pread(), -1 if closed */
+  int fd;
+  /* The fd of the trigger, to be polled for POLLPRI, -1 if there is none */
+  int trigger_fd;
+  /* "some": at least one task waited for I/O. "full": all non-idle tasks
+     did */
+  pressure_line some;
+  pressure_line full;
+  /* FALSE if the kernel does not provide the file, e.g. without CONFIG_PSI
+     or when booted with psi=0 */
+  int avail;
+} pressure;
+
+/**
+ * Initializes a closed object.
+ * @param   psi         The object
+ */
+void pressure_init(pressure *psi);
+
+/**
+ * Reads the averages and totals. The file is opened on the first call.
+ * @param   psi         The object
+ * @return  0 if successful, 1 in case of error, in which case avail is FALSE
+ */
+int pressure_read(pressure *psi);
+
+/**
+ * Registers a trigger that fires when the tasks are stalled on I/O for at
+ * least a given share of PRESSURE_WINDOW. An existing trigger is replaced.
+ * The returned fd must be polled for POLLPRI, and POLLERR means that the
+ * trigger is gone.
+ * @param   psi         The object
+ * @param   percent     The share of the window, from 1 to 100
+ * @return  the fd of the trigger, or -1 in case of error
+ */
+int pressure_trigger(pressure *psi, int percent);
+
+/**
+ * Closes the file and the trigger.
+ * @param   psi         The object
+ */
+void pressure_close(pressure *psi);
+
+#endif /* PRESSURE_H */
@@ -0,0 +1,453 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "procio.h"
+#include "disk.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The initial capacity of the table. It doubles as needed */
+#define PROCIO_CAPACITY 1024
+
+/* The size of /proc/<pid>/io, which has 7 lines of at most 42 bytes */
+#define PROCIO_BUFSIZE 512
+
+/* The number of directory entries or visits between two looks at the
+   clock */
+#define PROCIO_CLOCK_STEP 32
+
+/* -------------------------------------------------------------------------- */
+static inline size_t hash_pid(int pid, size_t capacity) {
+  return ((uint32_t)pid * 2654435761u) & (capacity - 1);
+}
+
+/* -------------------------------------------------------------------------- */
+void procio_init(procio *pio) {
+  memset(pio, 0, sizeof(procio));
+}
+
+/* -------------------------------------------------------------------------- */
+int procio_open(procio *pio, const char *procfs, int budget, int max_fds) {
+  procio_close(pio);
+
+  snprintf(pio->procfs, PATH_MAX, "%s", procfs);
+  pio->budget = (uint64_t)budget * 1000u;
+  pio->max_fds = max_fds;
+  pio->capacity = PROCIO_CAPACITY;
+  pio->entries = calloc(pio->capacity, sizeof(procio_entry));
+  pio->dir = opendir(procfs);
+  if (pio->entries == NULL || pio->dir == NULL) {
+    procio_close(pio);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static procio_entry *find_slot(procio_entry *entries, size_t capacity,
+                               int pid) {
+  size_t i = hash_pid(pid, capacity);
+
+  while (entries[i].pid != 0 && entries[i].pid != pid)
+    i = (i + 1) & (capacity - 1);
+  return &entries[i];
+}
+
+/******************************************************************************
+ *
+ * grow_table()
+ *
+ * double the capacity of the table and move the entries to their new slots.
+ * The open files move with them
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int grow_table(procio *pio) {
+  size_t capacity = pio->capacity * 2, i;
+  procio_entry *entries;
+
+  if ((entries = calloc(capacity, sizeof(procio_entry))) == NULL)
+    return 1;
+  for (i = 0; i < pio->capacity; i++) {
+    if (pio->entries[i].pid != 0)
+      *find_slot(entries, capacity, pio->entries[i].pid) = pio->entries[i];
+  }
+
+  free(pio->entries);
+  pio->entries = entries;
+  pio->capacity = capacity;
+  pio->cursor = 0;
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * remove_entry()
+ *
+ * remove the process in a slot and close its file. The entries that follow
+ * in the same run are shifted back, so that lookups need no tombstones. The
+ * slot may then hold another entry
+ *
+ *****************************************************************************/
+
+static void remove_entry(procio *pio, size_t slot) {
+  size_t i = slot, j = slot, home;
+
+  if (pio->entries[slot].fd >= 0) {
+    close(pio->entries[slot].fd);
+    pio->nfds--;
+  }
+
+  for (;;) {
+    j = (j + 1) & (pio->capacity - 1);
+    if (pio->entries[j].pid == 0)
+      break;
+    /* An entry may fill the hole if its home is not between the hole and
+       itself */
+    home = hash_pid(pio->entries[j].pid, pio->capacity);
+    if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+    pio->entries[i] = pio->entries[j];
+    i = j;
+  }
+
+  memset(&pio->entries[i], 0, sizeof(procio_entry));
+  pio->count--;
+}
+
+/* -------------------------------------------------------------------------- */
+static int add_pid(procio *pio, int pid) {
+  procio_entry *entry;
+
+  if ((pio->count + 1) * 2 > pio->capacity && grow_table(pio) != 0)
+    return 1;
+
+  entry = find_slot(pio->entries, pio->capacity, pid);
+  if (entry->pid == 0) {
+    entry->pid = pid;
+    entry->fd = -1;
+    pio->count++;
+  }
+  entry->pass = pio->pass;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int parse_pid(const char *name) {
+  long pid = 0;
+
+  if (*name == '\0')
+    return 0;
+  for (; *name; name++) {
+    if (*name < '0' || *name > '9' || pid > INT_MAX / 10)
+      return 0;
+    pid = pid * 10 + (*name - '0');
+  }
+  return pid <= INT_MAX ? (int)pid : 0;
+}
+
+/******************************************************************************
+ *
+ * scan_processes()
+ *
+ * continue the scan of the list of processes until the deadline. When the
+ * scan is complete, the processes that it did not see are gone
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int scan_processes(procio *pio, uint64_t now, uint64_t deadline) {
+  struct dirent *de;
+  size_t i;
+  int n = 0, pid;
+
+  if (!pio->scanning) {
+    if (pio->scanned != 0 && now - pio->scanned < PROCIO_RESCAN)
+      return 0;
+    rewinddir(pio->dir);
+    pio->pass++;
+    pio->scanning = 1;
+  }
+
+  errno = 0;
+  while ((de = readdir(pio->dir)) != NULL) {
+    if ((pid = parse_pid(de->d_name)) > 0 && add_pid(pio, pid) != 0)
+      return 1;
+    if (++n % PROCIO_CLOCK_STEP == 0 && now_ns() >= deadline)
+      return 0;
+  }
+  if (errno != 0)
+    return 1;
+
+  for (i = 0; i < pio->capacity;) {
+    if (pio->entries[i].pid != 0 && pio->entries[i].pass != pio->pass)
+      remove_entry(pio, i);
+    else
+      i++;
+  }
+  pio->scanning = 0;
+  pio->scanned = now_ns();
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * parse_io()
+ *
+ * find the read_bytes and write_bytes counters in the contents of
+ * /proc/<pid>/io
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int parse_io(const char *buf, uint64_t *rd, uint64_t *wr) {
+  const char *p = buf;
+  int found = 0;
+
+  while (p != NULL) {
+    if (strncmp(p, "read_bytes: ", 12) == 0) {
+      *rd = strtoull(p + 12, NULL, 10);
+      found |= 1;
+    } else if (strncmp(p, "write_bytes: ", 13) == 0) {
+      *wr = strtoull(p + 13, NULL, 10);
+      found |= 2;
+    }
+    if ((p = strchr(p, '\n')) != NULL)
+      p++;
+  }
+
+  return found == 3 ? 0 : 1;
+}
+
+/******************************************************************************
+ *
+ * read_entry()
+ *
+ * read the counters of a process and compute its speed since the last
+ * visit. The file stays open while there are fewer than max_fds. The open
+ * file of a process that exited keeps failing, even if its pid was reused
+ *
+ * returns 0 if successful, 1 if the process is gone
+ *
+ *****************************************************************************/
+
+static int read_entry(procio *pio, procio_entry *entry) {
+  char buf[PROCIO_BUFSIZE], path[PATH_MAX];
+  uint64_t rd = 0, wr = 0, stamp;
+  ssize_t len;
+  double dt;
+  int fd = entry->fd;
+
+  if (fd < 0) {
+    if (snprintf(path, sizeof(path), "%s/%d/io", pio->procfs, entry->pid) >=
+        (int)sizeof(path))
+      return 1;
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+      return errno == EACCES ? (entry->denied = 1, 0) : 1;
+  }
+
+  len = pread(fd, buf, sizeof(buf) - 1, 0);
+  stamp = now_ns();
+  if (len <= 0) {
+    /* The kernel only checks the permission on read */
+    entry->denied = len < 0 && errno == EACCES;
+    if (entry->fd >= 0)
+      pio->nfds--;
+    close(fd);
+    entry->fd = -1;
+    return entry->denied ? 0 : 1;
+  }
+  buf[len] = '\0';
+
+  if (entry->fd < 0) {
+    if (pio->nfds < pio->max_fds) {
+      entry->fd = fd;
+      pio->nfds++;
+    } else {
+      close(fd);
+    }
+  }
+
+  if (parse_io(buf, &rd, &wr) != 0)
+    return 0;
+
+  if (entry->stamp != 0 && stamp > entry->stamp) {
+    dt = (stamp - entry->stamp) / 1e9;
+    entry->rate_rd = rd >= entry->rd_bytes ? (rd - entry->rd_bytes) / dt : 0;
+    entry->rate_wr = wr >= entry->wr_bytes ? (wr - entry->wr_bytes) / dt : 0;
+  }
+  entry->rd_bytes = rd;
+  entry->wr_bytes = wr;
+  entry->stamp = stamp;
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * visit_processes()
+ *
+ * read the processes of the table in turn from the cursor, until the
+ * deadline or until all of them were read once
+ *
+ *****************************************************************************/
+
+static void visit_processes(procio *pio, uint64_t deadline) {
+  procio_entry *entry;
+  size_t n;
+
+  pio->visited = 0;
+  for (n = 0; n < pio->capacity && pio->visited < pio->count; n++) {
+    entry = &pio->entries[pio->cursor];
+    if (entry->pid == 0 || entry->denied) {
+      pio->cursor = (pio->cursor + 1) & (pio->capacity - 1);
+      continue;
+    }
+
+    /* A removed entry is replaced by the next one of its run, which is
+       visited in the same slot */
+    if (read_entry(pio, entry) != 0)
+      remove_entry(pio, pio->cursor);
+    else
+      pio->cursor = (pio->cursor + 1) & (pio->capacity - 1);
+
+    if (++pio->visited % PROCIO_CLOCK_STEP == 0 && now_ns() >= deadline)
+      break;
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void read_comm(const procio *pio, procio_entry *entry) {
+  char path[PATH_MAX];
+  ssize_t len = -1;
+  int fd;
+
+  if (snprintf(path, sizeof(path), "%s/%d/comm", pio->procfs, entry->pid) <
+          (int)sizeof(path) &&
+      (fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+    len = read(fd, entry->comm, PROCIO_COMM_LENGTH - 1);
+    close(fd);
+  }
+  if (len <= 0) {
+    snprintf(entry->comm, PROCIO_COMM_LENGTH, "%d", entry->pid);
+    return;
+  }
+  entry->comm[len] = '\0';
+  entry->comm[strcspn(entry->comm, "\n")] = '\0';
+}
+
+/******************************************************************************
+ *
+ * rank_processes()
+ *
+ * find the ntop processes with the highest sum of their speeds by insertion
+ * into a short sorted list. Only the ranked processes have their name read
+ *
+ *****************************************************************************/
+
+static void rank_processes(procio *pio, int ntop) {
+  procio_entry *ranked[PROCIO_MAX_TOP];
+  procio_entry *entry;
+  double rate;
+  size_t i;
+  int n = 0, j;
+
+  for (i = 0; i < pio->capacity; i++) {
+    entry = &pio->entries[i];
+    rate = entry->rate_rd + entry->rate_wr;
+    if (entry->pid == 0 || rate <= 0)
+      continue;
+    if (n == ntop &&
+        rate <= ranked[n - 1]->rate_rd + ranked[n - 1]->rate_wr)
+      continue;
+
+    j = n < ntop ? n++ : n - 1;
+    for (; j > 0 && ranked[j - 1]->rate_rd + ranked[j - 1]->rate_wr < rate;
+         j--)
+      ranked[j] = ranked[j - 1];
+    ranked[j] = entry;
+  }
+
+  for (j = 0; j < n; j++) {
+    if (ranked[j]->comm[0] == '\0')
+      read_comm(pio, ranked[j]);
+    pio->top[j].pid = ranked[j]->pid;
+    pio->top[j].rate_rd = ranked[j]->rate_rd;
+    pio->top[j].rate_wr = ranked[j]->rate_wr;
+    memcpy(pio->top[j].comm, ranked[j]->comm, PROCIO_COMM_LENGTH);
+  }
+  pio->ntop = n;
+}
+
+/* -------------------------------------------------------------------------- */
+int procio_update(procio *pio, int ntop) {
+  uint64_t start = now_ns();
+  int ret;
+
+  if (pio->entries == NULL)
+    return 1;
+  if (ntop > PROCIO_MAX_TOP)
+    ntop = PROCIO_MAX_TOP;
+
+  /* The scan may take up to half of the budget, and the visits what is
+     left of it */
+  ret = scan_processes(pio, start, start + pio->budget / 2);
+  visit_processes(pio, start + pio->budget);
+  if (ntop > 0)
+    rank_processes(pio, ntop);
+  else
+    pio->ntop = 0;
+
+  pio->cost = now_ns() - start;
+
+  return ret;
+}
+
+/* -------------------------------------------------------------------------- */
+void procio_close(procio *pio) {
+  size_t i;
+
+  for (i = 0; i < pio->capacity; i++) {
+    if (pio->entries[i].pid != 0 && pio->entries[i].fd >= 0)
+      close(pio->entries[i].fd);
+  }
+  free(pio->entries);
+  if (pio->dir != NULL)
+    closedir(pio->dir);
+  procio_init(pio);
+}
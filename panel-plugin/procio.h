@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef PROCIO_H
+#define PROCIO_H
+
+#include <dirent.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* The most processes that procio_update() ranks */
+#define PROCIO_MAX_TOP 10
+
+/* The time that one update may take by default, in us */
+#define PROCIO_BUDGET 2000
+
+/* The most files that are kept open between updates. The others are opened
+   on every visit */
+#define PROCIO_MAX_FDS 256
+
+/* The shortest time between two scans of the list of processes, in ns */
+#define PROCIO_RESCAN 2000000000u
+
+/* As TASK_COMM_LEN of the kernel */
+#define PROCIO_COMM_LENGTH 16
+
+/* A process in the table */
+typedef struct {
+  /* 0 if the slot is free */
+  int pid;
+  /* Its /proc/<pid>/io, -1 if not kept open */
+  int fd;
+  /* TRUE if its counters may not be read, e.g. it belongs to another user */
+  int denied;
+  /* The scan of the list of processes that last saw it */
+  unsigned int pass;
+  /* The counters of the last visit and its CLOCK_MONOTONIC time in ns. The
+     time is 0 before the first visit */
+  uint64_t rd_bytes;
+  uint64_t wr_bytes;
+  uint64_t stamp;
+  /* The speed between the last two visits, in bytes/s */
+  double rate_rd;
+  double rate_wr;
+  /* Its name, only read once it is ranked. Empty until then */
+  char comm[PROCIO_COMM_LENGTH];
+} procio_entry;
+
+/* A process that is ranked by its speed */
+typedef struct {
+  int pid;
+  double rate_rd;
+  double rate_wr;
+  char comm[PROCIO_COMM_LENGTH];
+} procio_top;
+
+/* The I/O of the processes, from the read_bytes and write_bytes counters of
+   /proc/<pid>/io. The processes are kept in a table indexed by their pid, so
+   that each visit is a single pread() of a file that stays open. Every
+   update continues where the last one stopped and ends when its budget is
+   spent, so that a full round over many processes is spread over many
+   updates. The list of processes is scanned less often, and also in
+   steps */
+typedef struct {
+  char procfs[PATH_MAX];
+  DIR *dir;
+
+  /* An open addressing table with linear probing. The capacity is a power
+     of 2 and at least twice the count */
+  procio_entry *entries;
+  size_t capacity;
+  size_t count;
+  /* The slot that the next update visits first */
+  size_t cursor;
+  int nfds;
+  int max_fds;
+
+  /* The current scan of the list of processes, whether it is under way,
+     and when the last one ended */
+  unsigned int pass;
+  int scanning;
+  uint64_t scanned;
+
+  /* The time that an update may take, in ns */
+  uint64_t budget;
+  /* What the last update cost: its time in ns, and the number of processes
+     that it read */
+  uint64_t cost;
+  size_t visited;
+
+  /* The fastest processes, from the last update */
+  procio_top top[PROCIO_MAX_TOP];
+  int ntop;
+} procio;
+
+/**
+ * Initializes a closed object.
+ * @param   pio         The object
+ */
+void procio_init(procio *pio);
+
+/**
+ * Opens the list of processes. The processes are only read by
+ * procio_update().
+ * @param   pio         The object
+ * @param   procfs      The root of procfs, usually /proc
+ * @param   budget      The time that an update may take, in us
+ * @param   max_fds     The most files that are kept open
+ * @return  0 if successful, 1 in case of error
+ */
+int procio_open(procio *pio, const char *procfs, int budget, int max_fds);
+
+/**
+ * Reads the counters of as many processes as the budget allows, continues
+ * the scan of the list of processes if one is due, and ranks the processes
+ * by the sum of their speeds. A process is ranked with the speed of its
+ * last two visits, and only once it was visited twice.
+ * @param   pio         The object
+ * @param   ntop        The number of processes to rank, up to
+ *                      PROCIO_MAX_TOP
+ * @return  0 if successful, 1 in case of error
+ */
+int procio_update(procio *pio, int ntop);
+
+/**
+ * Closes all the files and releases the table.
+ * @param   pio         The object
+ */
+void procio_close(procio *pio);
+
+#endif /* PROCIO_H */
@@ -0,0 +1,213 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "rollup.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ROLLUP_MAGIC 0x52535344 /* "DSSR" */
+#define ROLLUP_VERSION 1
+
+static const uint32_t NPOINTS[ROLLUP_TIERS] = {
+    ROLLUP_RAW_POINTS, ROLLUP_MINUTE_POINTS, ROLLUP_HOUR_POINTS};
+static const int64_t WIDTH[ROLLUP_TIERS] = {0, 60 * 1000, 60 * 60 * 1000};
+
+/* -------------------------------------------------------------------------- */
+static size_t rollup_size(void) {
+  size_t size = sizeof(rollup_header);
+  int t;
+
+  for (t = 0; t < ROLLUP_TIERS; t++)
+    size += NPOINTS[t] * sizeof(rollup_point);
+  return size;
+}
+
+/* -------------------------------------------------------------------------- */
+static int is_valid(const rollup_header *header) {
+  int t;
+
+  if (header->magic != ROLLUP_MAGIC || header->version != ROLLUP_VERSION ||
+      header->nseries != ROLLUP_SERIES || header->ntiers != ROLLUP_TIERS)
+    return 0;
+  for (t = 0; t < ROLLUP_TIERS; t++) {
+    if (header->tier[t].npoints != NPOINTS[t] ||
+        header->tier[t].width != WIDTH[t] ||
+        header->tier[t].head >= NPOINTS[t])
+      return 0;
+  }
+  return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+void rollup_init(rollup *hist) { memset(hist, 0, sizeof(rollup)); }
+
+/* -------------------------------------------------------------------------- */
+int rollup_open(rollup *hist, const char *path) {
+  size_t size = rollup_size();
+  struct stat st;
+  char *map;
+  int fd, t;
+
+  if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) < 0)
+    return 1;
+  if (fstat(fd, &st) != 0 ||
+      ((size_t)st.st_size != size && ftruncate(fd, size) != 0)) {
+    close(fd);
+    return 1;
+  }
+
+  map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return 1;
+
+  hist->map = (rollup_header *)map;
+  hist->size = size;
+  map += sizeof(rollup_header);
+  for (t = 0; t < ROLLUP_TIERS; t++) {
+    hist->points[t] = (rollup_point *)map;
+    map += NPOINTS[t] * sizeof(rollup_point);
+  }
+
+  /* A new file, or one written by another version */
+  if (!is_valid(hist->map)) {
+    memset(hist->map, 0, size);
+    hist->map->magic = ROLLUP_MAGIC;
+    hist->map->version = ROLLUP_VERSION;
+    hist->map->nseries = ROLLUP_SERIES;
+    hist->map->ntiers = ROLLUP_TIERS;
+    for (t = 0; t < ROLLUP_TIERS; t++) {
+      hist->map->tier[t].npoints = NPOINTS[t];
+      hist->map->tier[t].width = WIDTH[t];
+    }
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void rollup_close(rollup *hist) {
+  if (hist->map != NULL)
+    munmap(hist->map, hist->size);
+  rollup_init(hist);
+}
+
+/******************************************************************************
+ *
+ * add_to_tier()
+ *
+ * merge a sample into the newest point of a tier if it falls in the same
+ * period, or start a new point, overwriting the oldest one
+ *
+ *****************************************************************************/
+
+static void add_to_tier(rollup *hist, int t, int64_t now,
+                        const double *values) {
+  rollup_tier *tier = &hist->map->tier[t];
+  rollup_point *point = &hist->points[t][tier->head];
+  int64_t start = tier->width > 0 ? now - now % tier->width : now;
+  int s;
+
+  if (point->count > 0 && point->start == start && tier->width > 0) {
+    for (s = 0; s < ROLLUP_SERIES; s++) {
+      if (values[s] < point->value[s].min)
+        point->value[s].min = values[s];
+      if (values[s] > point->value[s].max)
+        point->value[s].max = values[s];
+      point->value[s].sum += values[s];
+    }
+    point->count++;
+    return;
+  }
+
+  /* The clock went back. The newer points are kept rather than mixed up */
+  if (point->count > 0 && start < point->start)
+    return;
+
+  if (point->count > 0)
+    tier->head = tier->head + 1 == tier->npoints ? 0 : tier->head + 1;
+  point = &hist->points[t][tier->head];
+  point->start = start;
+  point->count = 1;
+  for (s = 0; s < ROLLUP_SERIES; s++) {
+    point->value[s].min = values[s];
+    point->value[s].max = values[s];
+    point->value[s].sum = values[s];
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+void rollup_add(rollup *hist, int64_t now, const double *values) {
+  int t;
+
+  if (hist->map == NULL)
+    return;
+  for (t = 0; t < ROLLUP_TIERS; t++)
+    add_to_tier(hist, t, now, values);
+}
+
+/* -------------------------------------------------------------------------- */
+int rollup_summary(const rollup *hist, int tier, int64_t since,
+                   rollup_value *values) {
+  const rollup_point *point;
+  uint32_t i, n, count = 0;
+  int s;
+
+  if (hist->map == NULL || tier < 0 || tier >= ROLLUP_TIERS)
+    return 1;
+
+  /* Walk back from the newest point until the period is left */
+  n = hist->map->tier[tier].npoints;
+  i = hist->map->tier[tier].head;
+  for (;;) {
+    point = &hist->points[tier][i];
+    if (point->count == 0 || point->start < since)
+      break;
+
+    for (s = 0; s < ROLLUP_SERIES; s++) {
+      if (count == 0 || point->value[s].min < values[s].min)
+        values[s].min = point->value[s].min;
+      if (count == 0 || point->value[s].max > values[s].max)
+        values[s].max = point->value[s].max;
+      values[s].sum = (count == 0 ? 0 : values[s].sum) + point->value[s].sum;
+    }
+    count += point->count;
+
+    i = i == 0 ? n - 1 : i - 1;
+    if (i == hist->map->tier[tier].head)
+      break;
+  }
+
+  if (count == 0)
+    return 1;
+  for (s = 0; s < ROLLUP_SERIES; s++)
+    values[s].sum /= count;
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The number of values recorded per sample: read and write */
+#define ROLLUP_SERIES 2
+
+/* The tiers, from the finest to the coarsest */
+enum {
+  ROLLUP_RAW,     /* one point per sample */
+  ROLLUP_MINUTES, /* one point per minute */
+  ROLLUP_HOURS,   /* one point per hour */
+  ROLLUP_TIERS
+};
+
+/* The number of points of each tier. With the default update interval, the
+   raw tier covers 15 minutes. The others cover a day and a month */
+#define ROLLUP_RAW_POINTS 3600
+#define ROLLUP_MINUTE_POINTS 1440
+#define ROLLUP_HOUR_POINTS 720
+
+/* The aggregate of one series over a point */
+typedef struct {
+  double min;
+  double max;
+  double sum;
+} rollup_value;
+
+/* A point of a tier. start is the time of the sample for the raw tier, and
+   the start of the minute or hour for the others, in ms since the epoch. 0
+   if the point is empty */
+typedef struct {
+  int64_t start;
+  uint32_t count;
+  uint32_t reserved;
+  rollup_value value[ROLLUP_SERIES];
+} rollup_point;
+
+typedef struct {
+  uint32_t npoints;
+  /* The index of the newest point */
+  uint32_t head;
+  /* The length of a point in ms, 0 for the raw tier */
+  int64_t width;
+} rollup_tier;
+
+/* The layout of the file. The points of the tiers follow the header */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t nseries;
+  uint32_t ntiers;
+  rollup_tier tier[ROLLUP_TIERS];
+} rollup_header;
+
+/* A tiered history of the speed. It lives in a memory-mapped file of fixed
+   size, so that it survives restarts and is saved by the kernel without any
+   write() */
+typedef struct {
+  rollup_header *map;
+  size_t size;
+  rollup_point *points[ROLLUP_TIERS];
+} rollup;
+
+/**
+ * Initializes a closed history.
+ * @param   hist        The object
+ */
+void rollup_init(rollup *hist);
+
+/**
+ * Maps the history file, creating it if it does not exist. A file with
+ * another layout is cleared.
+ * @param   hist        The object. It must be closed
+ * @param   path        The path of the file
+ * @return  0 if successful, 1 in case of error
+ */
+int rollup_open(rollup *hist, const char *path);
+
+/**
+ * Unmaps the history file. It is safe to call rollup_open() again
+ * afterwards.
+ * @param   hist        The object
+ */
+void rollup_close(rollup *hist);
+
+/**
+ * Records a sample in every tier. Samples must be recorded in increasing
+ * order of time, and are ignored if the history is closed.
+ * @param   hist        The object
+ * @param   now         The time of the sample, in ms since the epoch
+ * @param   values      The ROLLUP_SERIES values of the sample
+ */
+void rollup_add(rollup *hist, int64_t now, const double *values);
+
+/**
+ * Aggregates the points of a tier that start at or after a given time.
+ * @param   hist        The object
+ * @param   tier        One of the ROLLUP_* tiers
+ * @param   since       The start of the period, in ms since the epoch
+ * @param   values      The ROLLUP_SERIES aggregates. sum holds the average
+ * @return  0 if successful, 1 if there is no point in the period
+ */
+int rollup_summary(const rollup *hist, int tier, int64_t since,
+                   rollup_value *values);
+
+#endif /* ROLLUP_H */
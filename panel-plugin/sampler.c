@@ -0,0 +1,291 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "sampler.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* -------------------------------------------------------------------------- */
+void sampler_init(sampler *smp) {
+  memset(smp, 0, sizeof(sampler));
+  smp->set.fd = -1;
+  atomic_init(&smp->stop, 0);
+  atomic_init(&smp->head, 0);
+  atomic_init(&smp->tail, 0);
+  atomic_init(&smp->dropped, 0);
+}
+
+/******************************************************************************
+ *
+ * publish_layout()
+ *
+ * copy the names of the disks of the set of the thread, so that the main loop
+ * can see which disk each slot is. Only called when the set changed
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int publish_layout(sampler *smp) {
+  const diskset *set = &smp->set;
+  char(*names)[DISK_NAME_LENGTH];
+  int *ssd;
+  int i;
+
+  pthread_mutex_lock(&smp->lock);
+  if (set->ndisks > smp->nnames) {
+    names = realloc(smp->names, set->ndisks * sizeof(*names));
+    if (names != NULL)
+      smp->names = names;
+    ssd = realloc(smp->ssd, set->ndisks * sizeof(int));
+    if (ssd != NULL)
+      smp->ssd = ssd;
+    if (names == NULL || ssd == NULL) {
+      pthread_mutex_unlock(&smp->lock);
+      return 1;
+    }
+  }
+
+  for (i = 0; i < set->ndisks; i++) {
+    memcpy(smp->names[i], set->disks[i].dev_name, DISK_NAME_LENGTH);
+    smp->ssd[i] = set->disks[i].ssd;
+  }
+  smp->nnames = set->ndisks;
+  smp->generation = set->generation;
+  pthread_mutex_unlock(&smp->lock);
+
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * push_samples()
+ *
+ * push the last sample of every disk into the ring. Only the thread moves
+ * head, and only the main loop moves tail. If the main loop fell behind and
+ * the ring is full, the samples are dropped rather than overwritten
+ *
+ *****************************************************************************/
+
+static void push_samples(sampler *smp) {
+  const diskset *set = &smp->set;
+  size_t head = atomic_load_explicit(&smp->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&smp->tail, memory_order_acquire);
+  sampler_sample *sample;
+  const diskdata *data;
+  int i;
+
+  for (i = 0; i < set->ndisks; i++) {
+    if (head - tail == SAMPLER_RING_SIZE) {
+      atomic_fetch_add_explicit(&smp->dropped, set->ndisks - i,
+                                memory_order_relaxed);
+      break;
+    }
+
+    data = &set->disks[i];
+    sample = &smp->ring[head & (SAMPLER_RING_SIZE - 1)];
+    sample->stamp = data->stamp;
+    sample->generation = set->generation;
+    sample->slot = i;
+    sample->avail = data->avail;
+    sample->cur_in = data->cur_in;
+    sample->cur_out = data->cur_out;
+    memcpy(sample->metrics, data->metrics, sizeof(sample->metrics));
+    head++;
+  }
+
+  atomic_store_explicit(&smp->head, head, memory_order_release);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void add_ns(struct timespec *ts, uint64_t ns) {
+  ns += ts->tv_nsec;
+  ts->tv_sec += ns / 1000000000u;
+  ts->tv_nsec = ns % 1000000000u;
+}
+
+/******************************************************************************
+ *
+ * run()
+ *
+ * the body of the thread. It sleeps until absolute deadlines, so that the
+ * time spent sampling does not add up into drift. If it falls behind by more
+ * than a tick, the missed ticks are skipped rather than sampled in a burst
+ *
+ *****************************************************************************/
+
+static void *run(void *arg) {
+  sampler *smp = arg;
+  struct timespec deadline, now;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  while (!atomic_load_explicit(&smp->stop, memory_order_relaxed)) {
+    add_ns(&deadline, smp->interval);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > deadline.tv_sec ||
+        (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec))
+      deadline = now;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) !=
+           0)
+      ;
+
+    update_diskset(&smp->set);
+    if (smp->set.generation != smp->generation && publish_layout(smp) != 0)
+      continue;
+    push_samples(smp);
+  }
+
+  return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+int sampler_start(sampler *smp, const char *spec, int interval) {
+  sampler_stop(smp);
+
+  if (interval < SAMPLER_MIN_INTERVAL)
+    interval = SAMPLER_MIN_INTERVAL;
+  smp->interval = (uint64_t)interval * 1000000u;
+
+  if ((smp->ring = malloc(SAMPLER_RING_SIZE * sizeof(sampler_sample))) == NULL)
+    return 1;
+  if (pthread_mutex_init(&smp->lock, NULL) != 0) {
+    free(smp->ring);
+    smp->ring = NULL;
+    return 1;
+  }
+
+  /* The first sample only primes the disks */
+  init_diskset(&smp->set, spec);
+  publish_layout(smp);
+
+  if (pthread_create(&smp->thread, NULL, run, smp) != 0) {
+    close_diskset(&smp->set);
+    pthread_mutex_destroy(&smp->lock);
+    free(smp->ring);
+    sampler_init(smp);
+    return 1;
+  }
+  smp->running = 1;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void sampler_stop(sampler *smp) {
+  if (!smp->running)
+    return;
+
+  atomic_store(&smp->stop, 1);
+  pthread_join(smp->thread, NULL);
+
+  close_diskset(&smp->set);
+  pthread_mutex_destroy(&smp->lock);
+  free(smp->ring);
+  free(smp->names);
+  free(smp->ssd);
+  free(smp->aggregates);
+  sampler_init(smp);
+}
+
+/* -------------------------------------------------------------------------- */
+static void aggregate_sample(sampler_aggregate *agg,
+                             const sampler_sample *sample) {
+  int m;
+
+  agg->avail = sample->avail;
+  if (!sample->avail)
+    return;
+
+  if (agg->count == 0 || sample->cur_in > agg->peak_in)
+    agg->peak_in = sample->cur_in;
+  if (agg->count == 0 || sample->cur_out > agg->peak_out)
+    agg->peak_out = sample->cur_out;
+  agg->cur_in += sample->cur_in;
+  agg->cur_out += sample->cur_out;
+  for (m = 0; m < METRIC_COUNT; m++)
+    agg->metrics[m] += sample->metrics[m];
+  agg->count++;
+}
+
+/* -------------------------------------------------------------------------- */
+int sampler_drain(sampler *smp, diskset *set) {
+  size_t head, tail, n;
+  const sampler_sample *sample;
+  sampler_aggregate *agg;
+  diskdata *data;
+  int i, m;
+
+  if (!smp->running)
+    return 0;
+
+  /* The layout is published before the samples that refer to it, so it is
+     at least as recent as every sample up to head */
+  head = atomic_load_explicit(&smp->head, memory_order_acquire);
+  tail = atomic_load_explicit(&smp->tail, memory_order_relaxed);
+
+  pthread_mutex_lock(&smp->lock);
+  if (smp->generation != smp->seen &&
+      assign_diskset(set, smp->nnames, smp->names, smp->ssd, NULL) == 0)
+    smp->seen = smp->generation;
+  pthread_mutex_unlock(&smp->lock);
+
+  if (set->ndisks > smp->naggregates) {
+    agg = realloc(smp->aggregates, set->ndisks * sizeof(sampler_aggregate));
+    if (agg == NULL)
+      return 0;
+    smp->aggregates = agg;
+    smp->naggregates = set->ndisks;
+  }
+  memset(smp->aggregates, 0, set->ndisks * sizeof(sampler_aggregate));
+
+  for (n = tail; n != head; n++) {
+    sample = &smp->ring[n & (SAMPLER_RING_SIZE - 1)];
+    if (sample->generation == smp->seen && sample->slot < set->ndisks)
+      aggregate_sample(&smp->aggregates[sample->slot], sample);
+  }
+  atomic_store_explicit(&smp->tail, head, memory_order_release);
+
+  for (i = 0; i < set->ndisks; i++) {
+    agg = &smp->aggregates[i];
+    data = &set->disks[i];
+    if (agg->count == 0) {
+      if (head != tail && !agg->avail)
+        data->avail = FALSE;
+      continue;
+    }
+
+    data->avail = TRUE;
+    data->cur_in = agg->cur_in / agg->count;
+    data->cur_out = agg->cur_out / agg->count;
+    data->peak_in = agg->peak_in;
+    data->peak_out = agg->peak_out;
+    for (m = 0; m < METRIC_COUNT; m++)
+      data->metrics[m] = agg->metrics[m] / agg->count;
+  }
+
+  return head - tail;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "disk.h"
+
+/* The shortest sampling interval, in ms */
+#define SAMPLER_MIN_INTERVAL 10
+
+/* The number of samples that the ring holds. A power of 2 */
+#define SAMPLER_RING_SIZE 4096
+
+/* The speed and metrics of one disk at one tick of the sampler */
+typedef struct {
+  uint64_t stamp;
+  /* The layout of the disks that slot refers to */
+  unsigned int generation;
+  int slot;
+  int avail;
+  double cur_in;
+  double cur_out;
+  double metrics[METRIC_COUNT];
+} sampler_sample;
+
+/* The aggregate of the samples of one disk within one drain */
+typedef struct {
+  int count;
+  int avail;
+  double cur_in;
+  double cur_out;
+  double peak_in;
+  double peak_out;
+  double metrics[METRIC_COUNT];
+} sampler_aggregate;
+
+/* A thread that samples a diskset of its own at a fixed rate, and hands the
+   samples to the main loop through a single-producer single-consumer ring.
+   The ring is lock-free. Only the names of the disks, which change when a
+   device appears or disappears, are published under a mutex */
+typedef struct {
+  pthread_t thread;
+  int running;
+  atomic_int stop;
+  uint64_t interval;
+
+  /* Owned by the thread once it is started */
+  diskset set;
+
+  /* Written by the thread, read by the main loop */
+  sampler_sample *ring;
+  atomic_size_t head;
+  atomic_size_t tail;
+  /* The number of samples lost because the ring was full */
+  atomic_ulong dropped;
+
+  /* The names and kinds of the disks of the latest layout */
+  pthread_mutex_t lock;
+  unsigned int generation;
+  char (*names)[DISK_NAME_LENGTH];
+  int *ssd;
+  int nnames;
+
+  /* Only used by the main loop: the layout that it last copied, and the
+     accumulators of sampler_drain() */
+  unsigned int seen;
+  sampler_aggregate *aggregates;
+  int naggregates;
+} sampler;
+
+/**
+ * Initializes a stopped sampler.
+ * @param   smp         The object
+ */
+void sampler_init(sampler *smp);
+
+/**
+ * Starts sampling the disks of a specification in a new thread.
+ * @param   smp         The object. It must be stopped
+ * @param   spec        The device specification, see init_diskset()
+ * @param   interval    The sampling interval in ms. It is raised to
+ *                      SAMPLER_MIN_INTERVAL
+ * @return  0 if successful, 1 in case of error
+ */
+int sampler_start(sampler *smp, const char *spec, int interval);
+
+/**
+ * Stops the thread and releases the resources of the sampler. It is safe to
+ * call it on a stopped sampler, and to call sampler_start() again afterwards.
+ * @param   smp         The object
+ */
+void sampler_stop(sampler *smp);
+
+/**
+ * Takes the samples that the thread pushed since the last call and
+ * aggregates them into a set, as update_diskset() would. The speed and
+ * metrics of each disk are the average over the samples, and peak_in and
+ * peak_out the highest speeds. Disks without samples keep their values. The
+ * disks of the set follow the layout of the sampler.
+ * @param   smp         The object
+ * @param   set         The set, which must not be sampled otherwise
+ * @return  the number of samples taken
+ */
+int sampler_drain(sampler *smp, diskset *set);
+
+#endif /* SAMPLER_H */
@@ -0,0 +1,307 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "topology.h"
+
+#include <dirent.h>
+#include <linux/limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The states of a node while its leaves are collected */
+enum { LEAVES_NONE, LEAVES_PENDING, LEAVES_DONE };
+
+/* -------------------------------------------------------------------------- */
+void topology_init(topology *topo) { memset(topo, 0, sizeof(topology)); }
+
+/* -------------------------------------------------------------------------- */
+void topology_free(topology *topo) {
+  int n;
+
+  for (n = 0; n < topo->nnodes; n++) {
+    free(topo->nodes[n].lower);
+    free(topo->nodes[n].upper);
+    free(topo->nodes[n].leaves);
+  }
+  free(topo->nodes);
+  free(topo->sorted);
+  topology_init(topo);
+}
+
+/* -------------------------------------------------------------------------- */
+static int compare_nodes(const void *a, const void *b) {
+  return strcmp((*(const topology_node *const *)a)->name,
+                (*(const topology_node *const *)b)->name);
+}
+
+/* -------------------------------------------------------------------------- */
+static int compare_name(const void *name, const void *node) {
+  return strcmp(name, (*(const topology_node *const *)node)->name);
+}
+
+/* -------------------------------------------------------------------------- */
+int topology_find(const topology *topo, const char *name) {
+  const topology_node **found;
+
+  if (topo->sorted == NULL)
+    return -1;
+  found = bsearch(name, topo->sorted, topo->nnodes, sizeof(*topo->sorted),
+                  compare_name);
+  return found != NULL ? *found - topo->nodes : -1;
+}
+
+/* -------------------------------------------------------------------------- */
+static int add_node(topology *topo, const char *name, int disk) {
+  topology_node *nodes;
+  int capacity;
+
+  if (strlen(name) >= TOPOLOGY_NAME_LENGTH)
+    return -1;
+
+  if (topo->nnodes == topo->capacity) {
+    capacity = topo->capacity ? topo->capacity * 2 : 64;
+    if ((nodes = realloc(topo->nodes, capacity * sizeof(topology_node))) ==
+        NULL)
+      return -1;
+    topo->nodes = nodes;
+    topo->capacity = capacity;
+  }
+
+  memset(&topo->nodes[topo->nnodes], 0, sizeof(topology_node));
+  strcpy(topo->nodes[topo->nnodes].name, name);
+  topo->nodes[topo->nnodes].disk = disk;
+  topo->nodes[topo->nnodes].slot = -1;
+  return topo->nnodes++;
+}
+
+/* -------------------------------------------------------------------------- */
+static int append_index(int **array, int *n, int value) {
+  int *grown;
+  int i;
+
+  for (i = 0; i < *n; i++) {
+    if ((*array)[i] == value)
+      return 0;
+  }
+  if ((grown = realloc(*array, (*n + 1) * sizeof(int))) == NULL)
+    return 1;
+  *array = grown;
+  (*array)[(*n)++] = value;
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int add_edge(topology *topo, int upper, int lower) {
+  if (upper < 0 || lower < 0 || upper == lower)
+    return 0;
+  return append_index(&topo->nodes[upper].lower, &topo->nodes[upper].nlower,
+                      lower) ||
+         append_index(&topo->nodes[lower].upper, &topo->nodes[lower].nupper,
+                      upper);
+}
+
+/* -------------------------------------------------------------------------- */
+static void node_path(const topology *topo, const char *sysfs, int n,
+                      const char *file, char *path) {
+  const topology_node *node = &topo->nodes[n];
+
+  if (node->disk >= 0)
+    snprintf(path, PATH_MAX, "%s/block/%s/%s/%s", sysfs,
+             topo->nodes[node->disk].name, node->name, file);
+  else
+    snprintf(path, PATH_MAX, "%s/block/%s/%s", sysfs, node->name, file);
+}
+
+/******************************************************************************
+ *
+ * add_partitions()
+ *
+ * add the partitions of a disk, which are the subdirectories of its directory
+ * that have a partition file
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int add_partitions(topology *topo, const char *sysfs, int disk) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  DIR *dir;
+  int part, error = 0;
+
+  node_path(topo, sysfs, disk, "", path);
+  if ((dir = opendir(path)) == NULL)
+    return 0;
+
+  while (!error && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.' ||
+        strlen(entry->d_name) >= TOPOLOGY_NAME_LENGTH ||
+        strncmp(entry->d_name, topo->nodes[disk].name,
+                strlen(topo->nodes[disk].name)) != 0)
+      continue;
+    snprintf(path, PATH_MAX, "%s/block/%s/%s/partition", sysfs,
+             topo->nodes[disk].name, entry->d_name);
+    if (access(path, F_OK) != 0)
+      continue;
+    if ((part = add_node(topo, entry->d_name, disk)) < 0 ||
+        add_edge(topo, part, disk) != 0)
+      error = 1;
+  }
+  closedir(dir);
+
+  return error;
+}
+
+/******************************************************************************
+ *
+ * add_links()
+ *
+ * add the edges of the slaves and holders directories of a device. Each one
+ * is the mirror of the other, but both are read in case a driver only fills
+ * one of them. Links to unknown devices are ignored
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int add_links(topology *topo, const char *sysfs, int n,
+                     const char *file, int holders) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  DIR *dir;
+  int other, error = 0;
+
+  node_path(topo, sysfs, n, file, path);
+  if ((dir = opendir(path)) == NULL)
+    return 0;
+
+  while (!error && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.' ||
+        (other = topology_find(topo, entry->d_name)) < 0)
+      continue;
+    error = holders ? add_edge(topo, other, n) : add_edge(topo, n, other);
+  }
+  closedir(dir);
+
+  return error;
+}
+
+/******************************************************************************
+ *
+ * collect_leaves()
+ *
+ * collect the leaves of a node from those of its lower devices, which are
+ * collected first. Partitions are leaves. A node that is met again while its
+ * own leaves are being collected would be a cycle, and is skipped
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int collect_leaves(topology *topo, int n, char *state) {
+  topology_node *node = &topo->nodes[n];
+  const topology_node *lower;
+  int i, j;
+
+  if (state[n] != LEAVES_NONE)
+    return 0;
+  state[n] = LEAVES_PENDING;
+
+  /* A partition is the leaf of what is built on it rather than its whole
+     disk, which may hold other partitions */
+  if ((node->nlower == 0 || node->disk >= 0) &&
+      append_index(&node->leaves, &node->nleaves, n) != 0)
+    return 1;
+
+  for (i = 0; node->disk < 0 && i < node->nlower; i++) {
+    if (collect_leaves(topo, node->lower[i], state) != 0)
+      return 1;
+    lower = &topo->nodes[node->lower[i]];
+    for (j = 0; j < lower->nleaves; j++) {
+      if (append_index(&node->leaves, &node->nleaves, lower->leaves[j]) != 0)
+        return 1;
+    }
+  }
+  state[n] = LEAVES_DONE;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int topology_build(topology *topo, const char *sysfs) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  char *state;
+  DIR *dir;
+  int n, ndisks, error = 0;
+
+  topology_free(topo);
+
+  snprintf(path, PATH_MAX, "%s/block", sysfs);
+  if ((dir = opendir(path)) == NULL)
+    return 1;
+  /* A device whose name is too long is left out, as are its links */
+  while (!error && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] != '.' &&
+        strlen(entry->d_name) < TOPOLOGY_NAME_LENGTH)
+      error = add_node(topo, entry->d_name, -1) < 0;
+  }
+  closedir(dir);
+
+  ndisks = topo->nnodes;
+  for (n = 0; !error && n < ndisks; n++)
+    error = add_partitions(topo, sysfs, n);
+
+  /* The nodes do not move anymore */
+  if (!error &&
+      (topo->sorted = malloc((topo->nnodes + 1) * sizeof(*topo->sorted))) !=
+          NULL) {
+    for (n = 0; n < topo->nnodes; n++)
+      topo->sorted[n] = &topo->nodes[n];
+    qsort(topo->sorted, topo->nnodes, sizeof(*topo->sorted), compare_nodes);
+  } else {
+    error = 1;
+  }
+
+  for (n = 0; !error && n < topo->nnodes; n++)
+    error = add_links(topo, sysfs, n, "slaves", 0) ||
+            add_links(topo, sysfs, n, "holders", 1);
+
+  if (!error && (state = calloc(topo->nnodes + 1, 1)) != NULL) {
+    for (n = 0; !error && n < topo->nnodes; n++)
+      error = collect_leaves(topo, n, state);
+    free(state);
+  } else {
+    error = 1;
+  }
+
+  if (error) {
+    topology_free(topo);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+/* The longest name of a device, as DISK_NAME_LENGTH */
+#define TOPOLOGY_NAME_LENGTH 33
+
+/* A block device. The devices that it is built on are its lower devices,
+   e.g. the members of an MD array, or the physical volume under a device
+   mapper target. A partition is built on its disk */
+typedef struct {
+  char name[TOPOLOGY_NAME_LENGTH];
+  /* The index of the disk of a partition, or -1 */
+  int disk;
+  int *lower;
+  int nlower;
+  int *upper;
+  int nupper;
+  /* The devices at the bottom of this one, or this one alone if it is at
+     the bottom. Partitions are at the bottom, as their disk may hold other
+     partitions */
+  int *leaves;
+  int nleaves;
+  /* The index of the disk that monitors this device, or -1. Left to the
+     user of the topology */
+  int slot;
+} topology_node;
+
+/* The graph of the block devices of the system, from the holders and slaves
+   links and the partitions in sysfs. It has no cycle. It is only rebuilt
+   when the list of devices changes */
+typedef struct {
+  topology_node *nodes;
+  int nnodes;
+  int capacity;
+  /* The nodes in the order of their names, for topology_find() */
+  const topology_node **sorted;
+} topology;
+
+/**
+ * Initializes an empty topology.
+ * @param   topo        The object
+ */
+void topology_init(topology *topo);
+
+/**
+ * Releases the memory held by the topology. It is safe to call
+ * topology_init() or topology_build() again afterwards.
+ * @param   topo        The object
+ */
+void topology_free(topology *topo);
+
+/**
+ * Rebuilds the topology from /sys/block. Every node starts without a slot.
+ * @param   topo        The object
+ * @param   sysfs       The root of sysfs, e.g. /sys
+ * @return  0 if successful, 1 in case of error, in which case the topology
+ *          is empty
+ */
+int topology_build(topology *topo, const char *sysfs);
+
+/**
+ * Looks up a device by its name.
+ * @param   topo        The object
+ * @param   name        The name of the device, e.g. md0
+ * @return  the index of the node, or -1 if there is none
+ */
+int topology_find(const topology *topo, const char *name);
+
+#endif /* TOPOLOGY_H */
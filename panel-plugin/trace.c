@@ -0,0 +1,475 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "trace.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static const unsigned char MAGIC[4] = {'D', 'S', 'T', 'R'};
+
+/* The longest varint, for 64 bits */
+#define VARINT_MAX 10
+
+/* -------------------------------------------------------------------------- */
+static inline uint64_t zigzag(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline int64_t unzigzag(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+/* -------------------------------------------------------------------------- */
+static inline void put_varint(trace_writer *trace, uint64_t value) {
+  while (value >= 0x80) {
+    trace->buf[trace->len++] = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  trace->buf[trace->len++] = value;
+}
+
+/* -------------------------------------------------------------------------- */
+void trace_writer_init(trace_writer *trace) {
+  memset(trace, 0, sizeof(trace_writer));
+  trace->fd = -1;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_writer_flush(trace_writer *trace) {
+  size_t done = 0;
+  ssize_t len;
+
+  while (done < trace->len) {
+    if ((len = write(trace->fd, trace->buf + done, trace->len - done)) <= 0)
+      return 1;
+    done += len;
+  }
+  trace->size += trace->len;
+  trace->len = 0;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int ensure_space(trace_writer *trace, size_t need) {
+  unsigned char *buf;
+
+  if (trace->len + need <= trace->bufsize)
+    return 0;
+  if (trace_writer_flush(trace) != 0)
+    return 1;
+  if (need > trace->bufsize) {
+    if ((buf = realloc(trace->buf, need)) == NULL)
+      return 1;
+    trace->buf = buf;
+    trace->bufsize = need;
+  }
+  return 0;
+}
+
+/******************************************************************************
+ *
+ * start_file()
+ *
+ * open the file for appending and buffer the header of a new segment. The
+ * next sample is preceded by a devices record, so that every file can be
+ * read on its own
+ *
+ * returns 0 if successful, 1 in case of error
+ *
+ *****************************************************************************/
+
+static int start_file(trace_writer *trace) {
+  struct timespec ts;
+  struct stat st;
+
+  trace->fd =
+      open(trace->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (trace->fd < 0)
+    return 1;
+  if (fstat(trace->fd, &st) != 0) {
+    close(trace->fd);
+    trace->fd = -1;
+    return 1;
+  }
+
+  trace->size = st.st_size;
+  trace->generation = 0;
+  trace->ndisks = -1;
+  trace->prev_stamp = now_ns();
+
+  memcpy(trace->buf, MAGIC, sizeof(MAGIC));
+  trace->len = sizeof(MAGIC);
+  trace->buf[trace->len++] = TRACE_VERSION;
+  trace->buf[trace->len++] = STAT_NFIELDS;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  put_varint(trace, (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+  put_varint(trace, trace->prev_stamp);
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_writer_open(trace_writer *trace, const char *path,
+                      uint64_t max_size) {
+  trace->path = strdup(path);
+  trace->buf = malloc(TRACE_BUFSIZE);
+  trace->bufsize = TRACE_BUFSIZE;
+  trace->max_size = max_size;
+  if (trace->path == NULL || trace->buf == NULL || start_file(trace) != 0) {
+    trace_writer_close(trace);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int rotate(trace_writer *trace) {
+  char path[PATH_MAX];
+
+  if (trace_writer_flush(trace) != 0)
+    return 1;
+  close(trace->fd);
+  trace->fd = -1;
+
+  snprintf(path, PATH_MAX, "%s.1", trace->path);
+  rename(trace->path, path);
+
+  return start_file(trace);
+}
+
+/* -------------------------------------------------------------------------- */
+static int write_devices(trace_writer *trace, const diskset *set) {
+  diskstat *prev;
+  size_t len;
+  int i;
+
+  if (ensure_space(trace, 1 + VARINT_MAX +
+                              set->ndisks * (VARINT_MAX + DISK_NAME_LENGTH + 1)))
+    return 1;
+  if (set->ndisks > trace->ndisks) {
+    if ((prev = realloc(trace->prev, set->ndisks * sizeof(diskstat))) == NULL)
+      return 1;
+    trace->prev = prev;
+  }
+
+  trace->buf[trace->len++] = TRACE_DEVICES;
+  put_varint(trace, set->ndisks);
+  for (i = 0; i < set->ndisks; i++) {
+    len = strlen(set->disks[i].dev_name);
+    put_varint(trace, len);
+    memcpy(trace->buf + trace->len, set->disks[i].dev_name, len);
+    trace->len += len;
+    trace->buf[trace->len++] = (set->disks[i].ssd ? TRACE_SSD : 0) |
+                               (set->disks[i].counted ? 0 : TRACE_UNCOUNTED);
+  }
+
+  if (set->ndisks > 0)
+    memset(trace->prev, 0, set->ndisks * sizeof(diskstat));
+  trace->ndisks = set->ndisks;
+  trace->generation = set->generation;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_write(trace_writer *trace, const diskset *set) {
+  const diskstat *st;
+  uint64_t stamp;
+  int i, f;
+
+  if (trace->fd < 0)
+    return 1;
+
+  if ((trace->generation != set->generation || trace->ndisks != set->ndisks) &&
+      write_devices(trace, set) != 0)
+    return 1;
+
+  /* A single device is not read through /proc/diskstats. If it could never
+     be read, it has no time of its own */
+  stamp = set->fd < 0 && set->ndisks > 0 ? set->disks[0].stamp : set->stamp;
+  if (stamp == 0)
+    stamp = now_ns();
+
+  if (ensure_space(trace, 1 + VARINT_MAX +
+                              set->ndisks * (2 + STAT_NFIELDS * VARINT_MAX)))
+    return 1;
+  trace->buf[trace->len++] = TRACE_SAMPLE;
+  put_varint(trace, zigzag(stamp - trace->prev_stamp));
+  trace->prev_stamp = stamp;
+
+  for (i = 0; i < set->ndisks; i++) {
+    trace->buf[trace->len++] = set->disks[i].avail != 0;
+    if (!set->disks[i].avail)
+      continue;
+
+    st = &set->disks[i].stats.raw;
+    put_varint(trace, st->nfields);
+    for (f = 0; f < st->nfields; f++)
+      put_varint(trace, zigzag(st->field[f] - trace->prev[i].field[f]));
+    trace->prev[i] = *st;
+  }
+
+  if (trace->max_size > 0 && trace->size + trace->len > trace->max_size)
+    return rotate(trace);
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void trace_writer_restart(trace_writer *trace) { trace->ndisks = -1; }
+
+/* -------------------------------------------------------------------------- */
+void trace_writer_close(trace_writer *trace) {
+  if (trace->fd >= 0) {
+    trace_writer_flush(trace);
+    close(trace->fd);
+  }
+  free(trace->path);
+  free(trace->buf);
+  free(trace->prev);
+  trace_writer_init(trace);
+}
+
+/* -------------------------------------------------------------------------- */
+static int get_varint(trace_reader *trace, uint64_t *value) {
+  int shift;
+
+  *value = 0;
+  for (shift = 0; shift < 64 && trace->pos < trace->len; shift += 7) {
+    *value |= (uint64_t)(trace->buf[trace->pos] & 0x7f) << shift;
+    if ((trace->buf[trace->pos++] & 0x80) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+void trace_reader_init(trace_reader *trace) {
+  memset(trace, 0, sizeof(trace_reader));
+}
+
+/******************************************************************************
+ *
+ * read_header()
+ *
+ * read the header of a segment. The time line of the trace is not affected,
+ * as the samples of the segment continue that of the previous one
+ *
+ * returns 0 if successful, 1 if the header is corrupt
+ *
+ *****************************************************************************/
+
+static int read_header(trace_reader *trace) {
+  const unsigned char *p = trace->buf + trace->pos;
+
+  if (trace->len - trace->pos < sizeof(MAGIC) + 2 ||
+      memcmp(p, MAGIC, sizeof(MAGIC)) != 0 || p[sizeof(MAGIC)] < 1 ||
+      p[sizeof(MAGIC)] > TRACE_VERSION)
+    return 1;
+  trace->pos += sizeof(MAGIC) + 2;
+
+  if (get_varint(trace, &trace->start_realtime) != 0 ||
+      get_varint(trace, &trace->start) != 0)
+    return 1;
+  trace->segments++;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_reader_open(trace_reader *trace, const char *path) {
+  struct stat st;
+  ssize_t len;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return 1;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(MAGIC) + 2 ||
+      (trace->buf = malloc(st.st_size)) == NULL) {
+    close(fd);
+    return 1;
+  }
+
+  while (trace->len < (size_t)st.st_size &&
+         (len = read(fd, trace->buf + trace->len, st.st_size - trace->len)) > 0)
+    trace->len += len;
+  close(fd);
+
+  if (read_header(trace) != 0) {
+    trace_reader_close(trace);
+    return 1;
+  }
+  trace->stamp = trace->start;
+  trace->seen_segments = trace->segments;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int read_devices(trace_reader *trace) {
+  uint64_t n, len;
+  void *p;
+  int i;
+
+  if (get_varint(trace, &n) != 0 || n > 65536)
+    return 1;
+
+  if (n > (uint64_t)trace->ndisks) {
+    if ((p = realloc(trace->names, n * DISK_NAME_LENGTH)) == NULL)
+      return 1;
+    trace->names = p;
+    if ((p = realloc(trace->ssd, n * sizeof(int))) == NULL)
+      return 1;
+    trace->ssd = p;
+    if ((p = realloc(trace->counted, n * sizeof(int))) == NULL)
+      return 1;
+    trace->counted = p;
+    if ((p = realloc(trace->stats, n * sizeof(diskstat))) == NULL)
+      return 1;
+    trace->stats = p;
+    if ((p = realloc(trace->avail, n * sizeof(int))) == NULL)
+      return 1;
+    trace->avail = p;
+  }
+  trace->ndisks = n;
+
+  for (i = 0; i < trace->ndisks; i++) {
+    if (get_varint(trace, &len) != 0 || len >= DISK_NAME_LENGTH ||
+        trace->len - trace->pos < len + 1)
+      return 1;
+    memcpy(trace->names[i], trace->buf + trace->pos, len);
+    trace->names[i][len] = '\0';
+    trace->pos += len;
+    trace->ssd[i] = (trace->buf[trace->pos] & TRACE_SSD) != 0;
+    trace->counted[i] = (trace->buf[trace->pos++] & TRACE_UNCOUNTED) == 0;
+    trace->avail[i] = 0;
+  }
+
+  if (trace->ndisks > 0)
+    memset(trace->stats, 0, trace->ndisks * sizeof(diskstat));
+  trace->generation++;
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+static int read_sample(trace_reader *trace) {
+  uint64_t value, nfields;
+  int i, f;
+
+  if (get_varint(trace, &value) != 0)
+    return 1;
+  trace->stamp += unzigzag(value);
+
+  for (i = 0; i < trace->ndisks; i++) {
+    if (trace->pos == trace->len)
+      return 1;
+    if (!(trace->avail[i] = trace->buf[trace->pos++]))
+      continue;
+
+    if (get_varint(trace, &nfields) != 0 || nfields > STAT_NFIELDS)
+      return 1;
+    trace->stats[i].nfields = nfields;
+    for (f = 0; f < (int)nfields; f++) {
+      if (get_varint(trace, &value) != 0)
+        return 1;
+      trace->stats[i].field[f] += unzigzag(value);
+    }
+  }
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_read(trace_reader *trace) {
+  while (trace->pos < trace->len) {
+    switch (trace->buf[trace->pos++]) {
+    case TRACE_DEVICES:
+      if (read_devices(trace) != 0)
+        return 1;
+      break;
+
+    case TRACE_SAMPLE:
+      return read_sample(trace);
+
+    case TRACE_HEADER:
+      trace->pos--;
+      if (read_header(trace) != 0)
+        return 1;
+      break;
+
+    default:
+      return 1;
+    }
+  }
+
+  return 1;
+}
+
+/* -------------------------------------------------------------------------- */
+int trace_replay(trace_reader *trace, diskset *set) {
+  int i;
+
+  if (trace_read(trace) != 0)
+    return 1;
+
+  if (trace->generation != trace->seen) {
+    if (assign_diskset(set, trace->ndisks,
+                       (const char(*)[DISK_NAME_LENGTH])trace->names,
+                       trace->ssd, trace->counted) != 0)
+      return 1;
+    trace->seen = trace->generation;
+  }
+
+  /* The first sample of a segment was taken by another run, and cannot be
+     compared with the last one of the previous segment */
+  if (trace->segments != trace->seen_segments) {
+    for (i = 0; i < set->ndisks; i++)
+      set->disks[i].primed = FALSE;
+    trace->seen_segments = trace->segments;
+  }
+
+  return feed_diskset(set, trace->stamp, trace->stats, trace->avail);
+}
+
+/* -------------------------------------------------------------------------- */
+void trace_reader_close(trace_reader *trace) {
+  free(trace->buf);
+  free(trace->names);
+  free(trace->ssd);
+  free(trace->counted);
+  free(trace->stats);
+  free(trace->avail);
+  trace_reader_init(trace);
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "disk.h"
+
+/* A trace is one or more segments, each a header followed by records. All
+   integers are LEB128 varints.
+
+   header   "DSTR", the version and STAT_NFIELDS as single bytes, then the
+            CLOCK_REALTIME and CLOCK_MONOTONIC times at which it was started,
+            in ns
+   devices  TRACE_DEVICES, the number of disks, then for each the length of
+            its name, the name and its flags as a single byte
+   sample   TRACE_SAMPLE, the time since the previous sample in ns, then for
+            each disk whether it was present and, if it was, the number of
+            fields and the difference of each field to the previous sample
+            of the disk, zigzag encoded
+
+   A devices record comes before the first sample of a segment and whenever
+   the disks change. The samples that follow it are relative to 0.
+
+   Every time the recording starts, a segment is appended to the file, so
+   that restarting the plugin does not erase what was recorded before. The
+   samples of a segment continue the time line of the previous one, and the
+   disks are primed again. Version 1 traces have a single segment */
+#define TRACE_VERSION 2
+
+/* The header starts with the first byte of "DSTR" */
+enum { TRACE_DEVICES = 1, TRACE_SAMPLE = 2, TRACE_HEADER = 'D' };
+
+/* The flags of a disk. A disk is not counted if its traffic is already that
+   of the devices it is built on, see get_diskset_speed(). Version 1 only
+   had TRACE_SSD, and counted every disk */
+enum { TRACE_SSD = 1 << 0, TRACE_UNCOUNTED = 1 << 1 };
+
+/* The size of the buffer of the writer. It is written out when full, and
+   by trace_writer_flush(), which the plugin calls every few seconds */
+#define TRACE_BUFSIZE 65536
+
+/* Writes the samples of a set to a file. When the file exceeds its maximum
+   size, it is renamed with a .1 suffix, replacing the previous one, and a new
+   file is started */
+typedef struct {
+  int fd;
+  char *path;
+  uint64_t max_size;
+  uint64_t size;
+  unsigned char *buf;
+  size_t len;
+  size_t bufsize;
+  /* The layout of the set that the last devices record describes, and the
+     previous sample of each of its disks */
+  unsigned int generation;
+  int ndisks;
+  diskstat *prev;
+  uint64_t prev_stamp;
+} trace_writer;
+
+/* Reads a trace. The whole file is loaded when it is opened */
+typedef struct {
+  unsigned char *buf;
+  size_t len;
+  size_t pos;
+  uint64_t start_realtime;
+  uint64_t start;
+  /* The disks of the last devices record. generation changes with them */
+  unsigned int generation;
+  int ndisks;
+  char (*names)[DISK_NAME_LENGTH];
+  int *ssd;
+  int *counted;
+  /* The last sample */
+  uint64_t stamp;
+  diskstat *stats;
+  int *avail;
+  /* The number of segments read so far */
+  unsigned int segments;
+  /* The layout and the segment that trace_replay() last gave to its set */
+  unsigned int seen;
+  unsigned int seen_segments;
+} trace_reader;
+
+/**
+ * Initializes a closed writer.
+ * @param   trace       The object
+ */
+void trace_writer_init(trace_writer *trace);
+
+/**
+ * Starts a new segment at the end of a trace, creating the file if it does
+ * not exist.
+ * @param   trace       The object. It must be closed
+ * @param   path        The path of the file
+ * @param   max_size    The size in bytes above which the file is rotated, 0
+ *                      to never rotate it
+ * @return  0 if successful, 1 in case of error
+ */
+int trace_writer_open(trace_writer *trace, const char *path,
+                      uint64_t max_size);
+
+/**
+ * Records the last sample of a set. The record is only buffered.
+ * @param   trace       The object
+ * @param   set         The set, after update_diskset()
+ * @return  0 if successful, 1 in case of error
+ */
+int trace_write(trace_writer *trace, const diskset *set);
+
+/**
+ * Makes the next sample start with a devices record, e.g. after the set was
+ * initialized again. The generation of the set then starts over, so the
+ * writer cannot tell that its disks changed.
+ * @param   trace       The object
+ */
+void trace_writer_restart(trace_writer *trace);
+
+/**
+ * Writes out the buffered records.
+ * @param   trace       The object
+ * @return  0 if successful, 1 in case of error
+ */
+int trace_writer_flush(trace_writer *trace);
+
+/**
+ * Writes out the buffered records and closes the file. It is safe to call
+ * trace_writer_open() again afterwards.
+ * @param   trace       The object
+ */
+void trace_writer_close(trace_writer *trace);
+
+/**
+ * Initializes a closed reader.
+ * @param   trace       The object
+ */
+void trace_reader_init(trace_reader *trace);
+
+/**
+ * Loads a trace and reads its header.
+ * @param   trace       The object. It must be closed
+ * @param   path        The path of the file
+ * @return  0 if successful, 1 in case of error
+ */
+int trace_reader_open(trace_reader *trace, const char *path);
+
+/**
+ * Reads the next sample into stamp, stats and avail. Devices records are
+ * read on the way.
+ * @param   trace       The object
+ * @return  0 if successful, 1 at the end of the trace or if it is corrupt
+ */
+int trace_read(trace_reader *trace);
+
+/**
+ * Reads the next sample and feeds it to a set, whose disks follow those of
+ * the trace. The speed and metrics of the set are then those that
+ * update_diskset() computed when the sample was live. Which disks count
+ * towards the speed of the set is recorded too, so that it does not depend
+ * on the devices of the machine that replays the trace.
+ * @param   trace       The object
+ * @param   set         The set, which must not be open
+ * @return  0 if successful, 1 at the end of the trace or in case of error
+ */
+int trace_replay(trace_reader *trace, diskset *set);
+
+/**
+ * Releases the trace. It is safe to call trace_reader_open() again
+ * afterwards.
+ * @param   trace       The object
+ */
+void trace_reader_close(trace_reader *trace);
+
+#endif /* TRACE_H */
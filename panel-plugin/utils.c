@@ -19,13 +19,17 @@
  * ------------------------------------------------------------------------------------------------- 
  */
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <limits.h>
 #include <locale.h>
+#include <math.h>
 #include <glib.h>
 #include <glib/gprintf.h>
 #include <glib/gi18n.h>
 
+#include "utils.h"
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -69,36 +73,112 @@ unsigned long max_array( unsigned long array[], int size )
 }
 
 
+/* The numeric conventions of the locale and the translated unit names. They are
+   looked up again only when LC_NUMERIC or LC_MESSAGES changes */
+typedef struct
+{
+    char numeric[LOCALE_NAME_LENGTH];
+    char messages[LOCALE_NAME_LENGTH];
+    char decimal_point[8];
+    char thousands_sep[8];
+    int grouping;
+    const char* unit_names[UNITS_COUNT][4];
+} locale_cache;
+
+static locale_cache cache;
+
+
 /* ---------------------------------------------------------------------------------------------- */
-char* format_byte_humanreadable(char* string, int stringsize, double number, int digits, gboolean as_bits)
+static void update_locale_cache( void )
+{
+    static const char* unit_names[UNITS_COUNT][4] = {
+        { N_("B"), N_("KiB"), N_("MiB"), N_("GiB") },
+        { N_("B"), N_("kB"), N_("MB"), N_("GB") },
+        { N_("bps"), N_("Kbps"), N_("Mbps"), N_("Gbps") }
+    };
+    const char* numeric = setlocale( LC_NUMERIC, NULL );
+    const char* messages = setlocale( LC_MESSAGES, NULL );
+    struct lconv* localeinfo;
+    int i, j;
+
+    if (numeric == NULL)
+    {
+        numeric = "C";
+    }
+    if (messages == NULL)
+    {
+        messages = "C";
+    }
+    if (cache.grouping != 0 && strcmp( cache.numeric, numeric ) == 0
+        && strcmp( cache.messages, messages ) == 0)
+    {
+        return;
+    }
+
+    localeinfo = localeconv();
+    g_strlcpy( cache.numeric, numeric, sizeof(cache.numeric) );
+    g_strlcpy( cache.messages, messages, sizeof(cache.messages) );
+    g_strlcpy( cache.decimal_point, localeinfo->decimal_point, sizeof(cache.decimal_point) );
+    g_strlcpy( cache.thousands_sep, localeinfo->thousands_sep, sizeof(cache.thousands_sep) );
+    cache.grouping = localeinfo->grouping[0] <= 0 ? INT_MAX : localeinfo->grouping[0];
+
+    for (i = 0; i < UNITS_COUNT; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            cache.unit_names[i][j] = _(unit_names[i][j]);
+        }
+    }
+}
+
+
+/* ---------------------------------------------------------------------------------------------- */
+static char* append( char* str, const char* end, const char* s )
 {
+    while (*s != 0 && str < end)
+    {
+        *str++ = *s++;
+    }
+    return str;
+}
+
+
+/* ---------------------------------------------------------------------------------------------- */
+char* format_bytes( char* string, int stringsize, double number, int digits, byte_units units,
+                    int width )
+{
+    static const uint64_t powers[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+                                       100000000, 1000000000 };
+    char number_digits[BUFSIZ];
     char* str = string;
-    char buffer[BUFSIZ], formatstring[BUFSIZ];
-    char* bufptr = buffer;
-    char* unit_names[] = { N_("B"), N_("KiB"), N_("MiB"), N_("GiB") };
-    char* unit_names_bits[] = { N_("bps"), N_("Kbps"), N_("Mbps"), N_("Gbps") };
-    unsigned int uidx = 0;
-    double number_displayed = 0;
-    double thousand_divider = as_bits ? 1000 : 1024;
-    unsigned int i;
-    int numberOfIntegerChars, count;
-    struct lconv* localeinfo = localeconv();
-    int grouping = (int)localeinfo->grouping[0] == 0 ? INT_MAX : (int)localeinfo->grouping[0];
-    
+    const char* end = string + stringsize - 1;
+    const char* unit;
+    unsigned int uidx = 1;
+    double thousand_divider = units == UNITS_IEC ? 1024 : 1000;
+    double number_displayed, magnitude, scaled, rest;
+    uint64_t value;
+    int numberOfIntegerChars, ndigits, length, count, negative, i;
+    char c;
+
+    if (stringsize <= 0)
+    {
+        return NULL;
+    }
+    update_locale_cache();
+
     /* Start with kilo and adapt to bits values*/
-    uidx = 1;
     number_displayed = number / thousand_divider;
-    if (as_bits)
+    if (units == UNITS_BITS)
     {
         number_displayed *= 8;
     }
-    
+
     /* sensible value for digits */
     if (digits < 0 || digits >= 10)
     {
         digits = 2;
     }
-    
+
     /* 1 digit for values above MiB/s unit size */
     if (digits > 1 && number_displayed > thousand_divider * thousand_divider)
     {
@@ -106,58 +186,117 @@ char* format_byte_humanreadable(char* string, int stringsize, double number, int
     }
 
     /* calculate number and appropriate unit size for display */
-    while(number_displayed >= thousand_divider && uidx < (sizeof(unit_names) / sizeof(unit_names[0]) - 1))
+    while (number_displayed >= thousand_divider && uidx < 3)
     {
         number_displayed /= thousand_divider;
         uidx++;
     }
+    unit = cache.unit_names[units][uidx];
+
+    /* The digits of the number in fixed point, the last ones being the fraction. Ties are
+       rounded to even as printf() does, which needs the exact residue from fma(). Beyond the
+       mantissa, printf() itself is exact and cheap enough */
+    negative = number_displayed < 0;
+    magnitude = negative ? -number_displayed : number_displayed;
+    if (!isfinite( magnitude ))
+    {
+        magnitude = 0;
+    }
+    scaled = magnitude * powers[digits];
+    if (scaled < 4503599627370496.0)
+    {
+        value = (uint64_t)scaled;
+        if (fma( magnitude, powers[digits], -(double)value ) < 0)
+        {
+            value--;
+        }
+        rest = fma( magnitude, powers[digits], -((double)value + 0.5) );
+        if (rest > 0 || (rest == 0 && (value & 1)))
+        {
+            value++;
+        }
+
+        ndigits = 0;
+        do
+        {
+            number_digits[ndigits++] = '0' + value % 10;
+            value /= 10;
+        } while (value > 0 || ndigits <= digits);
+        for (i = 0; i < ndigits / 2; i++)
+        {
+            c = number_digits[i];
+            number_digits[i] = number_digits[ndigits - 1 - i];
+            number_digits[ndigits - 1 - i] = c;
+        }
+    }
+    else
+    {
+        snprintf( number_digits, sizeof(number_digits), "%.*f", digits, magnitude );
+        for (i = 0, ndigits = 0; number_digits[i] != 0; i++)
+        {
+            if (g_ascii_isdigit( number_digits[i] ))
+            {
+                number_digits[ndigits++] = number_digits[i];
+            }
+        }
+    }
+    numberOfIntegerChars = ndigits - digits;
 
-    /* format number first */
-    snprintf(formatstring, BUFSIZ, "%%.%df", digits);
-    snprintf(buffer, BUFSIZ, formatstring, number_displayed);
-    
-    /* get the number of integer characters */
-    count = numberOfIntegerChars = ( digits > 0
-                        ? ( strstr( buffer, localeinfo->decimal_point ) - buffer )
-                        :   strlen( buffer ) );
-    
-    
     /* check for length */
-    if( numberOfIntegerChars / grouping + (int)strlen( buffer ) > stringsize )
+    length = negative + numberOfIntegerChars
+        + (numberOfIntegerChars - 1) / cache.grouping * (int)strlen( cache.thousands_sep )
+        + (digits > 0 ? (int)strlen( cache.decimal_point ) + digits : 0);
+    if (length >= stringsize)
     {
         return NULL;
     }
-    
-    
+
+    /* right-align in the field */
+    length += 1 + strlen( unit );
+    for (i = length; i < width && str < end; i++)
+    {
+        *str++ = ' ';
+    }
+
+    if (negative)
+    {
+        *str++ = '-';
+    }
+
     /* insert the thousands separator */
-    while (*bufptr != 0 && *bufptr != localeinfo->decimal_point[0])
+    for (count = numberOfIntegerChars, i = 0; count > 0; count--, i++)
     {
-        if (count % grouping == 0 && count != numberOfIntegerChars)
+        if (count % cache.grouping == 0 && count != numberOfIntegerChars)
         {
-            for (i = 0; i < strlen( localeinfo->thousands_sep ); i++)
-            {
-                *str++ = localeinfo->thousands_sep[i];
-            }
+            str = append( str, end, cache.thousands_sep );
+        }
+        if (str < end)
+        {
+            *str++ = number_digits[i];
         }
-        
-        *str++ = *bufptr++;
-        count--;
     }
-    
+
     /* Copy the rest of the number */
-    while (digits > 0 && *bufptr != 0)
+    if (digits > 0)
     {
-        *str++ = *bufptr++;
+        str = append( str, end, cache.decimal_point );
+        for (; i < ndigits && str < end; i++)
+        {
+            *str++ = number_digits[i];
+        }
     }
-    
-    /* Add space */
-    *str++ = ' ';
 
-    /* terminate with 0 finally */
+    /* Add space and the unit name */
+    str = append( str, end, " " );
+    str = append( str, end, unit );
     *str = 0;
-    
-    /* Add the unit name */
-    g_strlcat(string, as_bits ? _(unit_names_bits[uidx]) : _(unit_names[uidx]), stringsize);
 
     return string;
 }
+
+
+/* ---------------------------------------------------------------------------------------------- */
+char* format_byte_humanreadable(char* string, int stringsize, double number, int digits, gboolean as_bits)
+{
+    return format_bytes( string, stringsize, number, digits, as_bits ? UNITS_BITS : UNITS_IEC, 0 );
+}
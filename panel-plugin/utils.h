@@ -21,6 +21,36 @@
 
 #include <glib.h>
 
+/* The longest name of a locale that is cached */
+#define LOCALE_NAME_LENGTH 256
+
+/* The units in which format_bytes() displays a number of bytes */
+typedef enum
+{
+    UNITS_IEC,          /* KiB, MiB, GiB */
+    UNITS_SI,           /* kB, MB, GB */
+    UNITS_BITS,         /* Kbps, Mbps, Gbps */
+    UNITS_COUNT
+} byte_units;
+
+/**
+ * Formats the number into a number of the appropriate unit with a thousands
+ * separator, respecting the current locale, like format_byte_humanreadable().
+ * The conventions of the locale are cached and only looked up again when the
+ * locale changes, and the number is formatted in fixed point without
+ * allocating. The result is always terminated, and right-aligned if it is
+ * shorter than the width.
+ * @param   string      a character array in which the result is stored
+ * @param   stringsize  the size of the character array
+ * @param   number      the number of bytes that should be formatted
+ * @param   digits      the number of digits after the decimal point
+ * @param   units       the units to use
+ * @param   width       the width of the field, 0 for none
+ * @return  the string or <code>NULL</code> if the number does not fit
+ */
+char* format_bytes( char* string, int stringsize, double number, int digits, byte_units units,
+                    int width );
+
 /**
  * Formats the number into a number of the appropriate byte unit with
  * a thousands separator, respecting the current locale. It appends
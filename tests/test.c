@@ -0,0 +1,135 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "test.h"
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int checks;
+static int failures;
+
+/* The state of the random generator */
+static uint64_t state = 0x9e3779b97f4a7c15ull;
+
+/* -------------------------------------------------------------------------- */
+int test_check(int ok, const char *what, const char *file, int line) {
+  checks++;
+  if (!ok) {
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    failures++;
+  }
+  return ok;
+}
+
+/* -------------------------------------------------------------------------- */
+int test_status(void) {
+  fprintf(stderr, "%d checks, %d failed\n", checks, failures);
+  return failures > 0;
+}
+
+/* -------------------------------------------------------------------------- */
+void test_seed(uint64_t seed) { state = seed; }
+
+/* -------------------------------------------------------------------------- */
+uint64_t test_random_u64(void) {
+  /* xorshift64* */
+  state ^= state >> 12;
+  state ^= state << 25;
+  state ^= state >> 27;
+  return state * 0x2545f4914f6cdd1dull;
+}
+
+/* -------------------------------------------------------------------------- */
+int test_make_root(char *root) {
+  const char *tmpdir = getenv("TMPDIR");
+
+  if (tmpdir == NULL || *tmpdir == '\0')
+    tmpdir = "/tmp";
+  if (snprintf(root, PATH_MAX, "%s/diskspeed-test.XXXXXX", tmpdir) >=
+      PATH_MAX)
+    return 1;
+  return mkdtemp(root) == NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+int test_make_dirs(const char *root, const char *path) {
+  char full[PATH_MAX];
+  char *p;
+
+  if (snprintf(full, PATH_MAX, "%s/%s", root, path) >= PATH_MAX)
+    return 1;
+  for (p = full + strlen(root) + 1; (p = strchr(p, '/')) != NULL; p++) {
+    *p = '\0';
+    if (mkdir(full, 0700) != 0 && access(full, F_OK) != 0)
+      return 1;
+    *p = '/';
+  }
+  return mkdir(full, 0700) != 0 && access(full, F_OK) != 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int test_write_file(const char *root, const char *path, const char *fmt,
+                    ...) {
+  char full[PATH_MAX];
+  va_list ap;
+  FILE *fp;
+  int result;
+
+  if (snprintf(full, PATH_MAX, "%s/%s", root, path) >= PATH_MAX ||
+      (fp = fopen(full, "w")) == NULL)
+    return 1;
+  va_start(ap, fmt);
+  result = vfprintf(fp, fmt, ap) < 0;
+  va_end(ap);
+  return fclose(fp) != 0 || result;
+}
+
+/* -------------------------------------------------------------------------- */
+void test_remove_root(const char *root) {
+  char path[PATH_MAX];
+  struct dirent *entry;
+  struct stat st;
+  DIR *dir;
+
+  if ((dir = opendir(root)) != NULL) {
+    while ((entry = readdir(dir)) != NULL) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0 ||
+          snprintf(path, PATH_MAX, "%s/%s", root, entry->d_name) >= PATH_MAX)
+        continue;
+      if (lstat(path, &st) == 0 && S_ISDIR(st.st_mode))
+        test_remove_root(path);
+      else
+        unlink(path);
+    }
+    closedir(dir);
+  }
+  rmdir(root);
+}
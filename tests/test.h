@@ -0,0 +1,96 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The exit status that tells automake that a test was skipped */
+#define TEST_SKIP 77
+
+/* Reports a failed check without stopping the test */
+#define CHECK(cond) test_check((cond), #cond, __FILE__, __LINE__)
+
+/**
+ * Counts a check, and reports it if it failed.
+ * @param   ok          Whether the check passed
+ * @param   what        The text of the check
+ * @param   file        The file of the check
+ * @param   line        The line of the check
+ * @return  ok
+ */
+int test_check(int ok, const char *what, const char *file, int line);
+
+/**
+ * Returns the exit status of the test from the checks so far.
+ * @return  0 if every check passed, 1 otherwise
+ */
+int test_status(void);
+
+/**
+ * Sets the state of the random generator, so that a test draws the same
+ * numbers on every run and a failure can be reproduced.
+ * @param   seed        The state. It must not be 0
+ */
+void test_seed(uint64_t seed);
+
+/**
+ * Draws the next number of the random generator, an xorshift64*.
+ * @return  the number
+ */
+uint64_t test_random_u64(void);
+
+/**
+ * Creates a temporary directory for a fake tree.
+ * @param   root        Receives the path of the directory. It must hold
+ *                      PATH_MAX characters
+ * @return  0 if successful, 1 in case of error
+ */
+int test_make_root(char *root);
+
+/**
+ * Creates a directory and its parents under a root.
+ * @param   root        The root
+ * @param   path        The directory, relative to the root
+ * @return  0 if successful, 1 in case of error
+ */
+int test_make_dirs(const char *root, const char *path);
+
+/**
+ * Writes a file under a root, in place rather than through a new file, so
+ * that descriptors that are already open on it see the new contents, as
+ * they would with sysfs and procfs.
+ * @param   root        The root
+ * @param   path        The file, relative to the root
+ * @param   fmt         The format of the contents, as for printf()
+ * @return  0 if successful, 1 in case of error
+ */
+int test_write_file(const char *root, const char *path, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/**
+ * Removes a fake tree and everything under it.
+ * @param   root        The root
+ */
+void test_remove_root(const char *root);
+
+#endif /* TEST_H */
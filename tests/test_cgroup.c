@@ -0,0 +1,189 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "cgroup.h"
+#include "test.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* The time between two updates, in µs */
+#define TEST_INTERVAL 20000
+
+/* The number of leaves of the tree that is read within a budget */
+#define TEST_LEAVES 300
+
+/* -------------------------------------------------------------------------- */
+static int write_iostat(const char *root, const char *path,
+                        unsigned long long rbytes, unsigned long long wbytes) {
+  char file[PATH_MAX];
+
+  if (snprintf(file, PATH_MAX, "cg/%s/io.stat", path) >= PATH_MAX)
+    return 1;
+  /* A device that is not selected comes first */
+  return test_write_file(root, file,
+                         "8:16 rbytes=999999999 wbytes=999999999 rios=1 "
+                         "wios=1 dbytes=0 dios=0\n"
+                         "8:0 rbytes=%llu wbytes=%llu rios=1 wios=1 dbytes=0 "
+                         "dios=0\n",
+                         rbytes, wbytes);
+}
+
+/* -------------------------------------------------------------------------- */
+static int find_top(const cgroup_tree *cg, const char *path) {
+  int i;
+
+  for (i = 0; i < cg->ntop; i++) {
+    if (strcmp(cg->top[i].path, path) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/******************************************************************************
+ *
+ * test_leaves()
+ *
+ * only the leaves are read and ranked, by the speed of the selected device,
+ * and a leaf that gets a child stops being one
+ *
+ *****************************************************************************/
+
+static void test_leaves(const char *root) {
+  const char *const names[] = {"sda"};
+  char path[PATH_MAX], sysfs[PATH_MAX];
+  cgroup_tree cg;
+
+  if (!CHECK(test_make_dirs(root, "sys/class/block/sda") == 0) ||
+      !CHECK(test_write_file(root, "sys/class/block/sda/dev", "8:0\n") == 0) ||
+      !CHECK(test_make_dirs(root, "cg/a/x") == 0) ||
+      !CHECK(test_make_dirs(root, "cg/a/y") == 0) ||
+      !CHECK(test_make_dirs(root, "cg/b") == 0) ||
+      !CHECK(write_iostat(root, "a", 0, 0) == 0) ||
+      !CHECK(write_iostat(root, "a/x", 1000, 0) == 0) ||
+      !CHECK(write_iostat(root, "a/y", 1000, 0) == 0) ||
+      !CHECK(write_iostat(root, "b", 1000, 0) == 0))
+    return;
+
+  if (!CHECK(snprintf(path, PATH_MAX, "%s/cg", root) < PATH_MAX) ||
+      !CHECK(snprintf(sysfs, PATH_MAX, "%s/sys", root) < PATH_MAX))
+    return;
+  cgroup_init(&cg);
+  if (!CHECK(cgroup_open(&cg, path, CGROUP_BUDGET) == 0)) {
+    cgroup_close(&cg);
+    return;
+  }
+  CHECK(cgroup_select(&cg, sysfs, names, 1) == 0 && cg.ndevs == 1);
+
+  /* The first read of each leaf has no speed yet */
+  CHECK(cgroup_update(&cg, CGROUP_MAX_TOP) == 0);
+  CHECK(cg.visited == 3 && cg.ntop == 0);
+
+  /* The parent is far ahead of its children, but is never ranked */
+  usleep(TEST_INTERVAL);
+  CHECK(write_iostat(root, "a", 1000000000, 0) == 0);
+  CHECK(write_iostat(root, "a/x", 2000, 0) == 0);
+  CHECK(write_iostat(root, "a/y", 1000, 4000) == 0);
+  CHECK(write_iostat(root, "b", 3000, 0) == 0);
+  CHECK(cgroup_update(&cg, CGROUP_MAX_TOP) == 0);
+  CHECK(cg.visited == 3 && cg.ntop == 3);
+  CHECK(find_top(&cg, "a/y") == 0 && find_top(&cg, "b") == 1 &&
+        find_top(&cg, "a/x") == 2);
+  CHECK(find_top(&cg, "a") < 0);
+  if (cg.ntop == 3)
+    CHECK(cg.top[0].rate[CGROUP_RBYTES] == 0 &&
+          cg.top[0].rate[CGROUP_WBYTES] > cg.top[1].rate[CGROUP_RBYTES]);
+
+  /* a/x gets a child, and is no longer read */
+  if (CHECK(test_make_dirs(root, "cg/a/x/z") == 0) &&
+      CHECK(write_iostat(root, "a/x/z", 0, 0) == 0)) {
+    usleep(TEST_INTERVAL);
+    CHECK(write_iostat(root, "a/x", 10000, 0) == 0);
+    CHECK(cgroup_update(&cg, CGROUP_MAX_TOP) == 0);
+    CHECK(cg.visited == 3);
+    CHECK(find_top(&cg, "a/x") < 0 && find_top(&cg, "a/x/z") < 0);
+  }
+
+  cgroup_close(&cg);
+}
+
+/******************************************************************************
+ *
+ * test_budget()
+ *
+ * without any time to spare, an update only reads some of the leaves, and
+ * the next ones continue from there until every leaf was read
+ *
+ *****************************************************************************/
+
+static void test_budget(const char *root) {
+  char path[PATH_MAX];
+  cgroup_tree cg;
+  int i, updates, unread;
+
+  for (i = 0; i < TEST_LEAVES; i++) {
+    snprintf(path, PATH_MAX, "cg/many/%d", i);
+    if (!CHECK(test_make_dirs(root, path) == 0))
+      return;
+    snprintf(path, PATH_MAX, "many/%d", i);
+    if (!CHECK(write_iostat(root, path, 0, 0) == 0))
+      return;
+  }
+
+  if (!CHECK(snprintf(path, PATH_MAX, "%s/cg/many", root) < PATH_MAX))
+    return;
+  cgroup_init(&cg);
+  if (!CHECK(cgroup_open(&cg, path, 0) == 0)) {
+    cgroup_close(&cg);
+    return;
+  }
+
+  for (updates = 0; updates < TEST_LEAVES; updates++) {
+    CHECK(cgroup_update(&cg, CGROUP_MAX_TOP) == 0);
+    CHECK(cg.visited > 0 && cg.visited < TEST_LEAVES);
+    for (i = 0, unread = 0; i < cg.nnodes; i++)
+      unread += cg.nodes[i].nchildren == 0 && cg.nodes[i].stamp == 0;
+    if (unread == 0)
+      break;
+  }
+  CHECK(updates > 0 && updates < TEST_LEAVES);
+
+  cgroup_close(&cg);
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void) {
+  char root[PATH_MAX];
+
+  if (test_make_root(root) != 0) {
+    perror("mkdtemp");
+    return 1;
+  }
+  test_leaves(root);
+  test_budget(root);
+  test_remove_root(root);
+
+  return test_status();
+}
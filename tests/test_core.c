@@ -0,0 +1,320 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "disk.h"
+#include "pressure.h"
+#include "test.h"
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+/* The time between two samples, in µs */
+#define TEST_INTERVAL 20000
+
+/* The counters of a fake device */
+typedef struct {
+  unsigned long long rd_ios, rd_sectors, wr_ios, wr_sectors;
+} fake_counters;
+
+/* -------------------------------------------------------------------------- */
+static int is_close(double value, double expected) {
+  return fabs(value - expected) <= 1e-9 * fabs(expected);
+}
+
+/******************************************************************************
+ *
+ * write_stat()
+ *
+ * write the stat file of a fake device under /sys/block, with 17 fields
+ *
+ *****************************************************************************/
+
+static int write_stat(const char *root, const char *name,
+                      const fake_counters *c) {
+  char path[PATH_MAX];
+
+  snprintf(path, PATH_MAX, "sys/block/%s/stat", name);
+  return test_write_file(root, path,
+                         "%llu 0 %llu 10 %llu 0 %llu 20 0 30 40 0 0 0 0 0 0\n",
+                         c->rd_ios, c->rd_sectors, c->wr_ios, c->wr_sectors);
+}
+
+/******************************************************************************
+ *
+ * write_diskstats()
+ *
+ * write /proc/diskstats with sda and, if it is given, sdb
+ *
+ *****************************************************************************/
+
+static int write_diskstats(const char *root, const fake_counters *sda,
+                           const fake_counters *sdb) {
+  static const char line[] =
+      "%4d %7d %s %llu 0 %llu 10 %llu 0 %llu 20 0 30 40 0 0 0 0 0 0\n";
+  char buf[1024];
+  int len;
+
+  len = snprintf(buf, sizeof(buf), line, 8, 0, "sda", sda->rd_ios,
+                 sda->rd_sectors, sda->wr_ios, sda->wr_sectors);
+  if (sdb != NULL)
+    snprintf(buf + len, sizeof(buf) - len, line, 8, 16, "sdb", sdb->rd_ios,
+             sdb->rd_sectors, sdb->wr_ios, sdb->wr_sectors);
+  return test_write_file(root, "proc/diskstats", "%s", buf);
+}
+
+/******************************************************************************
+ *
+ * check_rate()
+ *
+ * check the speed and the IOPS of a disk of a set against the counters that
+ * changed between its last two samples, which it knows the time of
+ *
+ *****************************************************************************/
+
+static void check_rate(const diskdata *data, const fake_counters *prev,
+                       const fake_counters *cur) {
+  double delta_t = (data->stamp - data->prev_stamp) / 1e9;
+
+  CHECK(data->avail);
+  CHECK(data->stamp > data->prev_stamp);
+  CHECK(is_close(data->cur_in,
+                 (cur->rd_sectors - prev->rd_sectors) * 512 / delta_t));
+  CHECK(is_close(data->cur_out,
+                 (cur->wr_sectors - prev->wr_sectors) * 512 / delta_t));
+  CHECK(is_close(get_metric(data, METRIC_RD_IOPS),
+                 (cur->rd_ios - prev->rd_ios) / delta_t));
+  CHECK(is_close(get_metric(data, METRIC_WR_IOPS),
+                 (cur->wr_ios - prev->wr_ios) / delta_t));
+}
+
+/******************************************************************************
+ *
+ * test_single()
+ *
+ * a lone disk, which is read from its stat file: a known rate, a reset that
+ * reports nothing and is the reference of the next sample, and the removal
+ * of the device
+ *
+ *****************************************************************************/
+
+static void test_single(const char *root) {
+  fake_counters c0 = {100, 2000, 50, 1000};
+  fake_counters c1 = {164, 4048, 82, 2024};
+  fake_counters reset = {1, 8, 1, 8};
+  fake_counters c2 = {33, 1032, 17, 520};
+  uint64_t before_first, after_first, before_second, after_second;
+  double bytes, slowest, fastest;
+  diskset set;
+  diskdata *data;
+
+  if (!CHECK(test_make_dirs(root, "sys/block/sda") == 0) ||
+      !CHECK(write_stat(root, "sda", &c0) == 0))
+    return;
+
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  before_first = now_ns();
+  CHECK(init_diskset(&set, "sda"));
+  after_first = now_ns();
+  if (!CHECK(set.ndisks == 1 && set.fd < 0)) {
+    close_diskset(&set);
+    return;
+  }
+  data = &set.disks[0];
+  CHECK(data->avail && data->cur_in == 0 && data->cur_out == 0);
+
+  /* The time of each sample is taken within the calls, so the rate is
+     within the bounds of the times around them */
+  usleep(TEST_INTERVAL);
+  CHECK(write_stat(root, "sda", &c1) == 0);
+  before_second = now_ns();
+  update_diskset(&set);
+  after_second = now_ns();
+  bytes = (c1.rd_sectors - c0.rd_sectors) * 512.0;
+  slowest = bytes / ((after_second - before_first) / 1e9);
+  fastest = bytes / ((before_second - after_first) / 1e9);
+  CHECK(data->avail);
+  CHECK(data->cur_in >= slowest && data->cur_in <= fastest);
+  CHECK(is_close(data->cur_in / get_metric(data, METRIC_RD_IOPS),
+                 bytes / (c1.rd_ios - c0.rd_ios)));
+  CHECK(is_close(data->cur_out / data->cur_in, 0.5));
+
+  usleep(TEST_INTERVAL);
+  CHECK(write_stat(root, "sda", &reset) == 0);
+  update_diskset(&set);
+  CHECK(data->avail && data->cur_in == 0 && data->cur_out == 0);
+  CHECK(get_metric(data, METRIC_RD_IOPS) == 0);
+
+  usleep(TEST_INTERVAL);
+  CHECK(write_stat(root, "sda", &c2) == 0);
+  update_diskset(&set);
+  CHECK(data->avail && data->cur_in > 0);
+  CHECK(is_close(data->cur_in / get_metric(data, METRIC_RD_IOPS),
+                 (c2.rd_sectors - reset.rd_sectors) * 512.0 /
+                     (c2.rd_ios - reset.rd_ios)));
+
+  test_remove_root(root);
+  update_diskset(&set);
+  CHECK(!data->avail);
+
+  close_diskset(&set);
+}
+
+/******************************************************************************
+ *
+ * test_set()
+ *
+ * a set of two disks, which are read from /proc/diskstats: known rates, a
+ * reset of one of them, and one disappearing and coming back
+ *
+ *****************************************************************************/
+
+static void test_set(const char *root) {
+  fake_counters a0 = {100, 2000, 50, 1000}, b0 = {10, 80, 20, 160};
+  fake_counters a1 = {228, 6096, 114, 3048}, b1 = {42, 1104, 84, 2208};
+  fake_counters a2 = {356, 10192, 178, 5096}, b2 = {1, 8, 1, 8};
+  fake_counters a3 = {420, 12240, 210, 6120}, b3 = {17, 520, 9, 264};
+  diskset set;
+
+  if (!CHECK(test_make_dirs(root, "proc") == 0) ||
+      !CHECK(test_make_dirs(root, "sys/block") == 0) ||
+      !CHECK(write_diskstats(root, &a0, &b0) == 0))
+    return;
+
+  memset(&set, 0, sizeof(diskset));
+  set.fd = -1;
+  CHECK(init_diskset(&set, "sd*"));
+  if (!CHECK(set.ndisks == 2 && set.fd >= 0) ||
+      !CHECK(strcmp(set.disks[0].dev_name, "sda") == 0 &&
+             strcmp(set.disks[1].dev_name, "sdb") == 0)) {
+    close_diskset(&set);
+    return;
+  }
+
+  usleep(TEST_INTERVAL);
+  CHECK(write_diskstats(root, &a1, &b1) == 0);
+  update_diskset(&set);
+  check_rate(&set.disks[0], &a0, &a1);
+  check_rate(&set.disks[1], &b0, &b1);
+
+  /* The counters of sdb went backwards */
+  usleep(TEST_INTERVAL);
+  CHECK(write_diskstats(root, &a2, &b2) == 0);
+  update_diskset(&set);
+  check_rate(&set.disks[0], &a1, &a2);
+  CHECK(set.disks[1].avail);
+  CHECK(set.disks[1].cur_in == 0 && set.disks[1].cur_out == 0);
+  CHECK(get_metric(&set.disks[1], METRIC_WR_IOPS) == 0);
+
+  /* and the reset sample is the reference of the next one */
+  usleep(TEST_INTERVAL);
+  CHECK(write_diskstats(root, &a3, &b3) == 0);
+  update_diskset(&set);
+  check_rate(&set.disks[0], &a2, &a3);
+  check_rate(&set.disks[1], &b2, &b3);
+
+  /* sdb disappears, then comes back without reporting its whole counters */
+  usleep(TEST_INTERVAL);
+  CHECK(write_diskstats(root, &a3, NULL) == 0);
+  update_diskset(&set);
+  CHECK(set.ndisks == 2 && set.disks[0].avail && !set.disks[1].avail);
+  CHECK(set.disks[0].cur_in == 0);
+
+  usleep(TEST_INTERVAL);
+  CHECK(write_diskstats(root, &a3, &b1) == 0);
+  update_diskset(&set);
+  CHECK(set.ndisks == 2 && set.disks[1].avail);
+  CHECK(set.disks[1].cur_in == 0 && set.disks[1].cur_out == 0);
+
+  close_diskset(&set);
+}
+
+/******************************************************************************
+ *
+ * test_pressure()
+ *
+ * the pressure of the block layer is read from the procfs root, and follows
+ * the file
+ *
+ *****************************************************************************/
+
+static void test_pressure(const char *root) {
+  pressure psi;
+
+  if (!CHECK(test_make_dirs(root, "proc/pressure") == 0) ||
+      !CHECK(test_write_file(root, "proc/pressure/io",
+                             "some avg10=1.50 avg60=0.25 avg300=0.00 "
+                             "total=123456\n"
+                             "full avg10=0.50 avg60=0.00 avg300=0.00 "
+                             "total=654\n") == 0))
+    return;
+
+  pressure_init(&psi);
+  CHECK(pressure_read(&psi) == 0 && psi.avail);
+  CHECK(is_close(psi.some.avg10, 1.5) && is_close(psi.some.avg60, 0.25));
+  CHECK(psi.some.total == 123456 && psi.full.total == 654);
+
+  CHECK(test_write_file(root, "proc/pressure/io",
+                        "some avg10=3.00 avg60=0.25 avg300=0.00 "
+                        "total=223456\n") == 0);
+  CHECK(pressure_read(&psi) == 0 && psi.avail);
+  CHECK(is_close(psi.some.avg10, 3.0) && psi.some.total == 223456);
+  CHECK(psi.full.total == 0);
+  pressure_close(&psi);
+}
+
+/* -------------------------------------------------------------------------- */
+static int make_fake_root(char *root) {
+  char sysfs[PATH_MAX], procfs[PATH_MAX];
+
+  if (test_make_root(root) != 0) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(sysfs, PATH_MAX, "%s/sys", root);
+  snprintf(procfs, PATH_MAX, "%s/proc", root);
+  set_disk_roots(sysfs, procfs);
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void) {
+  char root[PATH_MAX];
+
+  /* The single disk removes its tree to make the device disappear */
+  if (make_fake_root(root) != 0)
+    return 1;
+  test_single(root);
+
+  if (make_fake_root(root) != 0)
+    return 1;
+  test_set(root);
+  test_pressure(root);
+  test_remove_root(root);
+
+  return test_status();
+}
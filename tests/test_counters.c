@@ -0,0 +1,193 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "counters.h"
+#include "test.h"
+
+#include <string.h>
+
+/* The largest store that is tried. Not a multiple of the vector length, so
+   that the padding rows are exercised */
+#define TEST_ROWS 67
+
+/* The seed of the generator, fixed so that a failure can be reproduced */
+#define TEST_SEED 0x9e3779b97f4a7c15ull
+
+static const char *const IMPL_NAMES[COUNTERS_NIMPLS] = {"scalar", "sse2",
+                                                        "avx2"};
+
+/******************************************************************************
+ *
+ * random_pair()
+ *
+ * pick a previous and a current value of a counter. Most counters grow,
+ * some are reset and go backwards, and some are near the edges of 64 bits,
+ * where the borrow of the subtraction and the conversion to double are
+ * easiest to get wrong
+ *
+ *****************************************************************************/
+
+static void random_pair(uint64_t *prev, uint64_t *cur) {
+  uint64_t r = test_random_u64();
+
+  switch (r % 6) {
+  case 0:
+    *prev = test_random_u64();
+    *cur = test_random_u64();
+    break;
+  case 1:
+    *prev = UINT64_MAX - (r >> 58);
+    *cur = *prev + (r >> 60);
+    break;
+  case 2:
+    *prev = r >> 20;
+    *cur = 0;
+    break;
+  case 3:
+    *prev = 0;
+    *cur = r | 1ull << 63;
+    break;
+  default:
+    *prev = r >> (r % 64);
+    *cur = *prev + (test_random_u64() >> (test_random_u64() % 64));
+    break;
+  }
+}
+
+/******************************************************************************
+ *
+ * test_impls()
+ *
+ * the same counters, updated with every implementation that the CPU
+ * supports, give identical deltas, rates and previous values, and these are
+ * the ones of the obvious formula
+ *
+ *****************************************************************************/
+
+static void test_impls(int rows, double inv_dt) {
+  counter_store stores[COUNTERS_NIMPLS];
+  counter_store *ref = &stores[COUNTERS_SCALAR];
+  uint64_t prev[STAT_NFIELDS][TEST_ROWS], cur[STAT_NFIELDS][TEST_ROWS];
+  uint64_t d;
+  int impl, f, i;
+
+  for (f = 0; f < STAT_NFIELDS; f++)
+    for (i = 0; i < rows; i++)
+      random_pair(&prev[f][i], &cur[f][i]);
+
+  for (impl = 0; impl < COUNTERS_NIMPLS; impl++) {
+    counter_store_init(&stores[impl]);
+    if (!counter_store_has_impl(impl))
+      continue;
+    if (!CHECK(counter_store_resize(&stores[impl], rows) == 0))
+      return;
+    for (f = 0; f < STAT_NFIELDS; f++) {
+      memcpy(stores[impl].prev[f], prev[f], rows * sizeof(uint64_t));
+      memcpy(stores[impl].cur[f], cur[f], rows * sizeof(uint64_t));
+    }
+    counter_store_update_impl(&stores[impl], inv_dt, impl);
+  }
+
+  for (f = 0; f < STAT_NFIELDS; f++) {
+    for (i = 0; i < rows; i++) {
+      d = cur[f][i] >= prev[f][i] ? cur[f][i] - prev[f][i] : 0;
+      CHECK(ref->delta[f][i] == d);
+      CHECK(ref->rate[f][i] == (double)d * inv_dt);
+      CHECK(ref->prev[f][i] == cur[f][i]);
+    }
+  }
+
+  for (impl = 0; impl < COUNTERS_NIMPLS; impl++) {
+    if (impl == COUNTERS_SCALAR || !counter_store_has_impl(impl))
+      continue;
+    for (f = 0; f < STAT_NFIELDS; f++) {
+      if (!CHECK(memcmp(stores[impl].delta[f], ref->delta[f],
+                        rows * sizeof(uint64_t)) == 0 &&
+                 memcmp(stores[impl].rate[f], ref->rate[f],
+                        rows * sizeof(double)) == 0 &&
+                 memcmp(stores[impl].prev[f], ref->prev[f],
+                        rows * sizeof(uint64_t)) == 0))
+        fprintf(stderr, "%s differs from scalar: %d rows, field %d\n",
+                IMPL_NAMES[impl], rows, f);
+    }
+  }
+
+  for (impl = 0; impl < COUNTERS_NIMPLS; impl++)
+    counter_store_free(&stores[impl]);
+}
+
+/******************************************************************************
+ *
+ * test_default()
+ *
+ * the implementation that is picked by default gives what the scalar one
+ * gives
+ *
+ *****************************************************************************/
+
+static void test_default(void) {
+  counter_store a, b;
+  int f, i;
+
+  counter_store_init(&a);
+  counter_store_init(&b);
+  if (CHECK(counter_store_resize(&a, TEST_ROWS) == 0) &&
+      CHECK(counter_store_resize(&b, TEST_ROWS) == 0)) {
+    for (f = 0; f < STAT_NFIELDS; f++) {
+      for (i = 0; i < TEST_ROWS; i++) {
+        random_pair(&a.prev[f][i], &a.cur[f][i]);
+        b.prev[f][i] = a.prev[f][i];
+        b.cur[f][i] = a.cur[f][i];
+      }
+    }
+    counter_store_update(&a, 50.0);
+    counter_store_update_impl(&b, 50.0, COUNTERS_SCALAR);
+    for (f = 0; f < STAT_NFIELDS; f++)
+      CHECK(memcmp(a.delta[f], b.delta[f], TEST_ROWS * sizeof(uint64_t)) ==
+                0 &&
+            memcmp(a.rate[f], b.rate[f], TEST_ROWS * sizeof(double)) == 0);
+  }
+  counter_store_free(&a);
+  counter_store_free(&b);
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void) {
+  static const double INV_DT[] = {1.0, 50.0, 1.0 / 3.0, 1e-9};
+  int impl, rows, n;
+
+  test_seed(TEST_SEED);
+
+  for (impl = 0; impl < COUNTERS_NIMPLS; impl++)
+    if (!counter_store_has_impl(impl))
+      printf("%s is not supported here, skipping it\n", IMPL_NAMES[impl]);
+
+  for (rows = 1; rows <= TEST_ROWS; rows++)
+    for (n = 0; n < 20; n++)
+      test_impls(rows, INV_DT[n % 4]);
+  test_default();
+
+  return test_status();
+}
@@ -0,0 +1,340 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "diskstats.h"
+#include "test.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The number of random cases of each property */
+#define TEST_CASES 2000
+
+/* Room for a line with more fields than any kernel prints */
+#define TEST_LINE 1024
+
+/* The seed of the generator, fixed so that a failure can be reproduced */
+#define TEST_SEED 0x2545f4914f6cdd1dull
+
+/* A generated line and what the parser should find in it */
+typedef struct {
+  char text[TEST_LINE];
+  size_t len;
+  unsigned int major, minor;
+  char name[32];
+  uint64_t field[STAT_NFIELDS + 3];
+  int nfields;
+} test_line;
+
+/* -------------------------------------------------------------------------- */
+static unsigned int random_below(unsigned int n) {
+  return (unsigned int)(test_random_u64() % n);
+}
+
+/******************************************************************************
+ *
+ * random_counter()
+ *
+ * pick a counter, favouring the values where a parser is most likely to go
+ * wrong: 0, small numbers and numbers that need all 64 bits
+ *
+ *****************************************************************************/
+
+static uint64_t random_counter(void) {
+  switch (random_below(4)) {
+  case 0:
+    return 0;
+  case 1:
+    return random_below(1000);
+  case 2:
+    return UINT64_MAX - random_below(1000);
+  default:
+    return test_random_u64() >> random_below(64);
+  }
+}
+
+/******************************************************************************
+ *
+ * make_line()
+ *
+ * generate a line of /proc/diskstats with a number of fields, separated by
+ * random runs of blanks as the kernel pads the device numbers
+ *
+ *****************************************************************************/
+
+static void make_line(test_line *line, int nfields) {
+  static const char *const BLANKS[] = {" ", "  ", "\t", " \t "};
+  size_t len;
+  int i;
+
+  line->major = random_below(2) ? random_below(300) : UINT32_MAX;
+  line->minor = random_below(1 << 20);
+  snprintf(line->name, sizeof(line->name), "%s%u",
+           random_below(2) ? "sd" : "nvme0n", random_below(100));
+  line->nfields = nfields;
+
+  len = snprintf(line->text, TEST_LINE, "%s%u%s%u%s%s",
+                 BLANKS[random_below(4)], line->major, BLANKS[random_below(4)],
+                 line->minor, BLANKS[random_below(4)], line->name);
+  for (i = 0; i < nfields; i++) {
+    line->field[i] = random_counter();
+    len += snprintf(line->text + len, TEST_LINE - len, "%s%" PRIu64,
+                    BLANKS[random_below(4)], line->field[i]);
+  }
+  if (random_below(2))
+    len += snprintf(line->text + len, TEST_LINE - len, "%s",
+                    BLANKS[random_below(4)]);
+  line->text[len++] = '\n';
+  line->len = len;
+}
+
+/******************************************************************************
+ *
+ * check_parsed()
+ *
+ * check what the parser found in a line against what was generated
+ *
+ *****************************************************************************/
+
+static void check_parsed(const test_line *line, unsigned int major,
+                         unsigned int minor, const char *name, size_t namelen,
+                         const diskstat *st) {
+  int kept = line->nfields < STAT_NFIELDS ? line->nfields : STAT_NFIELDS;
+  int i;
+
+  CHECK(major == line->major && minor == line->minor);
+  CHECK(namelen == strlen(line->name) &&
+        memcmp(name, line->name, namelen) == 0);
+  CHECK(st->nfields == kept);
+  for (i = 0; i < kept; i++)
+    CHECK(st->field[i] == line->field[i]);
+  for (i = kept; i < STAT_NFIELDS; i++)
+    CHECK(st->field[i] == 0);
+}
+
+/******************************************************************************
+ *
+ * test_round_trip()
+ *
+ * a line in each format that kernels print, and one with fields that a
+ * future kernel might add, parses back to the fields it was made from
+ *
+ *****************************************************************************/
+
+static void test_round_trip(void) {
+  static const int FORMATS[] = {11, 15, 17, STAT_NFIELDS + 3};
+  test_line line;
+  diskstat st;
+  unsigned int major, minor;
+  const char *p, *name;
+  size_t namelen;
+  int n;
+
+  for (n = 0; n < TEST_CASES; n++) {
+    make_line(&line, FORMATS[n % 4]);
+    /* Poison the fields, so that the ones not printed must be cleared */
+    memset(&st, 0xff, sizeof(st));
+
+    p = line.text;
+    CHECK(parse_diskstats_line(&p, line.text + line.len, &major, &minor,
+                               &name, &namelen, &st) == 0);
+    CHECK(p == line.text + line.len);
+    check_parsed(&line, major, minor, name, namelen, &st);
+
+    /* The same fields, as /sys/block/<dev>/stat has them */
+    memset(&st, 0xff, sizeof(st));
+    p = name + namelen;
+    CHECK(parse_stat_fields(&p, line.text + line.len, &st) == 0);
+    CHECK(p == line.text + line.len);
+    check_parsed(&line, major, minor, name, namelen, &st);
+  }
+}
+
+/******************************************************************************
+ *
+ * test_buffer()
+ *
+ * a buffer of many lines, in formats that may differ from line to line,
+ * parses line by line, and the last line need not end with a newline
+ *
+ *****************************************************************************/
+
+static void test_buffer(void) {
+  static test_line lines[64];
+  char *buf, *end;
+  const char *p, *name;
+  unsigned int major, minor;
+  size_t namelen;
+  diskstat st;
+  int nlines, i;
+
+  if ((buf = malloc(sizeof(lines))) == NULL) {
+    CHECK(buf != NULL);
+    return;
+  }
+  for (nlines = 1; nlines <= 64; nlines++) {
+    end = buf;
+    for (i = 0; i < nlines; i++) {
+      make_line(&lines[i], STAT_MIN_FIELDS + random_below(10));
+      memcpy(end, lines[i].text, lines[i].len);
+      end += lines[i].len;
+    }
+    if (random_below(2))
+      end--;
+
+    p = buf;
+    for (i = 0; i < nlines; i++) {
+      CHECK(parse_diskstats_line(&p, end, &major, &minor, &name, &namelen,
+                                 &st) == 0);
+      check_parsed(&lines[i], major, minor, name, namelen, &st);
+    }
+    CHECK(p == end);
+  }
+  free(buf);
+}
+
+/******************************************************************************
+ *
+ * test_truncated()
+ *
+ * every prefix of a line either fails or parses to a prefix of its fields,
+ * and the parser stays within the buffer. The prefix is copied to a buffer
+ * of its own size, so that a read past the end is caught by a checker
+ *
+ *****************************************************************************/
+
+static void test_truncated(void) {
+  test_line line;
+  char *buf;
+  const char *p, *name;
+  unsigned int major, minor;
+  size_t namelen, len;
+  diskstat st;
+  int n, i, result;
+
+  for (n = 0; n < TEST_CASES / 10; n++) {
+    make_line(&line, 11 + 2 * random_below(4));
+    for (len = 0; len < line.len; len++) {
+      if ((buf = malloc(len ? len : 1)) == NULL) {
+        CHECK(buf != NULL);
+        return;
+      }
+      memcpy(buf, line.text, len);
+
+      p = buf;
+      result =
+          parse_diskstats_line(&p, buf + len, &major, &minor, &name, &namelen,
+                               &st);
+      CHECK(p == buf + len);
+      if (result == 0) {
+        CHECK(major == line.major && minor == line.minor);
+        CHECK(st.nfields >= STAT_MIN_FIELDS && st.nfields <= line.nfields);
+        /* The last field may have been cut short */
+        for (i = 0; i < st.nfields - 1; i++)
+          CHECK(st.field[i] == line.field[i]);
+        CHECK(st.field[i] <= line.field[i]);
+      }
+      free(buf);
+    }
+  }
+}
+
+/******************************************************************************
+ *
+ * test_garbage()
+ *
+ * random bytes, drawn mostly from the characters that the parser looks at,
+ * never make it stall, read past the buffer or report a line that does not
+ * have the fields it should. A valid line that follows garbage still parses
+ *
+ *****************************************************************************/
+
+static void test_garbage(void) {
+  static const char ALPHABET[] = "0123456789 \t\n-+xsda\0\377";
+  test_line line;
+  char *buf;
+  const char *p, *prev, *end, *name;
+  unsigned int major, minor;
+  size_t namelen, len, i;
+  diskstat st;
+  int n, j;
+
+  for (n = 0; n < TEST_CASES; n++) {
+    len = 1 + random_below(200);
+    make_line(&line, STAT_MIN_FIELDS + random_below(7));
+    if ((buf = malloc(len + 1 + line.len)) == NULL) {
+      CHECK(buf != NULL);
+      return;
+    }
+    for (i = 0; i < len; i++)
+      buf[i] = random_below(8) ? ALPHABET[random_below(sizeof(ALPHABET) - 1)]
+                               : (char)random_below(256);
+    buf[len] = '\n';
+
+    /* The garbage alone */
+    p = buf;
+    end = buf + len;
+    while (p < end) {
+      prev = p;
+      if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen,
+                               &st) == 0) {
+        CHECK(st.nfields >= STAT_MIN_FIELDS && st.nfields <= STAT_NFIELDS);
+        for (j = st.nfields; j < STAT_NFIELDS; j++)
+          CHECK(st.field[j] == 0);
+      }
+      if (!CHECK(p > prev && p <= end))
+        break;
+    }
+
+    /* The line after it is found again */
+    memcpy(buf + len + 1, line.text, line.len);
+    end = buf + len + 1 + line.len;
+    p = buf;
+    for (;;) {
+      prev = p;
+      if (parse_diskstats_line(&p, end, &major, &minor, &name, &namelen,
+                               &st) == 0 &&
+          p == end)
+        break;
+      if (!CHECK(p > prev && p < end))
+        break;
+    }
+    if (p == end)
+      check_parsed(&line, major, minor, name, namelen, &st);
+    free(buf);
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void) {
+  test_seed(TEST_SEED);
+  test_round_trip();
+  test_buffer();
+  test_truncated();
+  test_garbage();
+
+  return test_status();
+}
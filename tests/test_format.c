@@ -0,0 +1,304 @@
+/*
+ * Copyright 2017 Tarun Prabhu <tarun.prabhu@gmail.com>
+ * ----------------------------------------------------------------------------
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the Free
+ *  Software Foundation; either version 2 of the License, or (at your option)
+ *  any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 675 Mass
+ * Ave, Cambridge, MA 02139, USA.
+ *
+ * ----------------------------------------------------------------------------
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "test.h"
+#include "utils.h"
+
+#include <limits.h>
+#include <locale.h>
+#include <string.h>
+
+/* Large enough for any number that the old code could format */
+#define TEST_BUFSIZE 512
+
+/* The seed of the generator, fixed so that a failure can be reproduced */
+#define TEST_SEED 0x243f6a8885a308d3ull
+
+/* A number formatted in the C locale, and what it must look like */
+typedef struct {
+  double number;
+  int digits;
+  byte_units units;
+  int width;
+  const char *expected;
+} golden;
+
+static const golden GOLDEN[] = {
+    /* IEC */
+    {0, 2, UNITS_IEC, 0, "0.00 KiB"},
+    {1536, 2, UNITS_IEC, 0, "1.50 KiB"},
+    {1024000, 2, UNITS_IEC, 0, "1000.00 KiB"},
+    {1572864, 2, UNITS_IEC, 0, "1.50 MiB"},
+    /* One digit above a MiB, and no unit above GiB */
+    {5e12, 2, UNITS_IEC, 0, "4656.6 GiB"},
+    /* SI */
+    {1500, 2, UNITS_SI, 0, "1.50 kB"},
+    {999, 2, UNITS_SI, 0, "1.00 kB"},
+    {1e6, 2, UNITS_SI, 0, "1.00 MB"},
+    {5e9, 2, UNITS_SI, 0, "5.0 GB"},
+    /* Bits */
+    {125, 2, UNITS_BITS, 0, "1.00 Kbps"},
+    {125000, 2, UNITS_BITS, 0, "1.00 Mbps"},
+    {1250000, 3, UNITS_BITS, 0, "10.000 Mbps"},
+    {2e8, 2, UNITS_BITS, 0, "1.6 Gbps"},
+    /* Ties are rounded to even, as printf() does */
+    {1152, 2, UNITS_IEC, 0, "1.12 KiB"},
+    {1408, 2, UNITS_IEC, 0, "1.38 KiB"},
+    {1536, 0, UNITS_IEC, 0, "2 KiB"},
+    {2560, 0, UNITS_IEC, 0, "2 KiB"},
+    {1280, 1, UNITS_IEC, 0, "1.2 KiB"},
+    {1792, 1, UNITS_IEC, 0, "1.8 KiB"},
+    /* Out of range digits fall back to 2 */
+    {1536, -1, UNITS_IEC, 0, "1.50 KiB"},
+    {1536, 10, UNITS_IEC, 0, "1.50 KiB"},
+    /* Right-aligned in a field */
+    {1536, 2, UNITS_IEC, 12, "    1.50 KiB"},
+    {1536, 2, UNITS_IEC, 4, "1.50 KiB"}};
+
+/* Locales that group thousands, of which the first that is installed is
+   tried, with what 1000 KiB must look like in them */
+static const struct {
+  const char *name;
+  const char *expected;
+} GROUPED[] = {{"de_DE.UTF-8", "1.000,00 KiB"}, {"de_DE.utf8", "1.000,00 KiB"},
+               {"de_DE", "1.000,00 KiB"},       {"en_US.UTF-8", "1,000.00 KiB"},
+               {"en_US.utf8", "1,000.00 KiB"},  {"en_US", "1,000.00 KiB"}};
+
+/******************************************************************************
+ *
+ * old_format()
+ *
+ * format_byte_humanreadable() as it was before format_bytes(), with
+ * snprintf() and the separators inserted afterwards. The unit names are not
+ * translated. Negative numbers are not compared, since it put a separator
+ * after their sign
+ *
+ *****************************************************************************/
+
+static char *old_format(char *string, int stringsize, double number,
+                        int digits, int as_bits) {
+  char *str = string;
+  char buffer[BUFSIZ], formatstring[BUFSIZ];
+  char *bufptr = buffer;
+  const char *unit_names[] = {"B", "KiB", "MiB", "GiB"};
+  const char *unit_names_bits[] = {"bps", "Kbps", "Mbps", "Gbps"};
+  unsigned int uidx = 0;
+  double number_displayed = 0;
+  double thousand_divider = as_bits ? 1000 : 1024;
+  unsigned int i;
+  int numberOfIntegerChars, count;
+  struct lconv *localeinfo = localeconv();
+  int grouping = (int)localeinfo->grouping[0] == 0
+                     ? INT_MAX
+                     : (int)localeinfo->grouping[0];
+
+  uidx = 1;
+  number_displayed = number / thousand_divider;
+  if (as_bits)
+    number_displayed *= 8;
+
+  if (digits < 0 || digits >= 10)
+    digits = 2;
+
+  if (digits > 1 && number_displayed > thousand_divider * thousand_divider)
+    digits = 1;
+
+  while (number_displayed >= thousand_divider &&
+         uidx < (sizeof(unit_names) / sizeof(unit_names[0]) - 1)) {
+    number_displayed /= thousand_divider;
+    uidx++;
+  }
+
+  snprintf(formatstring, BUFSIZ, "%%.%df", digits);
+  snprintf(buffer, BUFSIZ, formatstring, number_displayed);
+
+  count = numberOfIntegerChars =
+      (digits > 0 ? (strstr(buffer, localeinfo->decimal_point) - buffer)
+                  : (int)strlen(buffer));
+
+  if (numberOfIntegerChars / grouping + (int)strlen(buffer) > stringsize)
+    return NULL;
+
+  while (*bufptr != 0 && *bufptr != localeinfo->decimal_point[0]) {
+    if (count % grouping == 0 && count != numberOfIntegerChars) {
+      for (i = 0; i < strlen(localeinfo->thousands_sep); i++)
+        *str++ = localeinfo->thousands_sep[i];
+    }
+    *str++ = *bufptr++;
+    count--;
+  }
+
+  while (digits > 0 && *bufptr != 0)
+    *str++ = *bufptr++;
+
+  *str++ = ' ';
+  *str = 0;
+
+  strcat(string, as_bits ? unit_names_bits[uidx] : unit_names[uidx]);
+
+  return string;
+}
+
+/* -------------------------------------------------------------------------- */
+static void check_format(double number, int digits, byte_units units,
+                         int width, const char *expected) {
+  char string[TEST_BUFSIZE];
+
+  if (!CHECK(format_bytes(string, sizeof(string), number, digits, units,
+                          width) != NULL &&
+             strcmp(string, expected) == 0))
+    fprintf(stderr, "  %.17g with %d digits: \"%s\", expected \"%s\"\n",
+            number, digits, string, expected);
+}
+
+/******************************************************************************
+ *
+ * check_old()
+ *
+ * format a number like the old code did, in IEC units and in bits, and
+ * compare
+ *
+ *****************************************************************************/
+
+static void check_old(double number, int digits) {
+  char expected[TEST_BUFSIZE], string[TEST_BUFSIZE];
+
+  old_format(expected, sizeof(expected), number, digits, FALSE);
+  check_format(number, digits, UNITS_IEC, 0, expected);
+  if (CHECK(format_byte_humanreadable(string, sizeof(string), number, digits,
+                                      FALSE) != NULL))
+    CHECK(strcmp(string, expected) == 0);
+
+  old_format(expected, sizeof(expected), number, digits, TRUE);
+  check_format(number, digits, UNITS_BITS, 0, expected);
+}
+
+/******************************************************************************
+ *
+ * test_against_old()
+ *
+ * numbers of every magnitude, ties of every number of digits, and the
+ * boundaries between units, format as the old code formatted them in the
+ * current locale
+ *
+ *****************************************************************************/
+
+static void test_against_old(void) {
+  static const double FRACTIONS[] = {0.5,   0.25,   0.75,   0.125,
+                                     0.375, 0.625,  0.875,  0.0625,
+                                     0.005, 0.0049, 0.0051, 0.95};
+  static const double BOUNDARIES[] = {999.995, 1000,    1023.995,
+                                      1024,    1048576, 1048577,
+                                      1e9,     1e12,    1e15};
+  double number;
+  int digits, m, i;
+
+  for (digits = 0; digits < 4; digits++) {
+    for (m = 0; m < 1100; m++)
+      for (i = 0; i < (int)(sizeof(FRACTIONS) / sizeof(FRACTIONS[0])); i++)
+        check_old((m + FRACTIONS[i]) * 1024, digits);
+
+    for (i = 0; i < (int)(sizeof(BOUNDARIES) / sizeof(BOUNDARIES[0])); i++) {
+      check_old(BOUNDARIES[i], digits);
+      check_old(BOUNDARIES[i] * 1024, digits);
+      check_old(BOUNDARIES[i] * 125, digits);
+    }
+
+    for (i = 0; i < 20000; i++) {
+      /* Up to 2^50, with a random number of significant bits */
+      number = (double)(test_random_u64() >> (14 + test_random_u64() % 50));
+      if (i % 2)
+        number += (double)(test_random_u64() >> 11) / 9007199254740992.0;
+      check_old(number, digits);
+    }
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+static void test_golden(void) {
+  char string[4];
+  size_t i;
+
+  for (i = 0; i < sizeof(GOLDEN) / sizeof(GOLDEN[0]); i++)
+    check_format(GOLDEN[i].number, GOLDEN[i].digits, GOLDEN[i].units,
+                 GOLDEN[i].width, GOLDEN[i].expected);
+
+  /* Too small for the number */
+  CHECK(format_bytes(string, sizeof(string), 1536, 2, UNITS_IEC, 0) == NULL);
+}
+
+/******************************************************************************
+ *
+ * test_grouped()
+ *
+ * in a locale that groups thousands, the separators are those of the
+ * locale, the old code agrees, and switching back and forth between locales
+ * is noticed by the cache of format_bytes()
+ *
+ * returns 0 if such a locale is installed, 1 otherwise
+ *
+ *****************************************************************************/
+
+static int test_grouped(void) {
+  size_t i;
+
+  for (i = 0; i < sizeof(GROUPED) / sizeof(GROUPED[0]); i++)
+    if (setlocale(LC_NUMERIC, GROUPED[i].name) != NULL)
+      break;
+  if (i == sizeof(GROUPED) / sizeof(GROUPED[0]))
+    return 1;
+
+  check_format(1024000, 2, UNITS_IEC, 0, GROUPED[i].expected);
+  test_against_old();
+
+  setlocale(LC_NUMERIC, "C");
+  check_format(1024000, 2, UNITS_IEC, 0, "1000.00 KiB");
+  setlocale(LC_NUMERIC, GROUPED[i].name);
+  check_format(1024000, 2, UNITS_IEC, 0, GROUPED[i].expected);
+  setlocale(LC_NUMERIC, "C");
+
+  return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+int main(void) {
+  test_seed(TEST_SEED);
+  setlocale(LC_NUMERIC, "C");
+  test_golden();
+  test_against_old();
+
+  /* The same conventions under another name, which the cache looks up
+     again */
+  if (setlocale(LC_NUMERIC, "C.UTF-8") != NULL) {
+    test_golden();
+    test_against_old();
+    setlocale(LC_NUMERIC, "C");
+  }
+
+  if (test_grouped() != 0)
+    printf("No locale that groups thousands is installed, skipping them\n");
+
+  return test_status();
+}